@@ -0,0 +1,851 @@
+/*
+ * Benchmark for the path library, built and run by "make bench".
+ * Synthetic path lists of various sizes and shapes are generated,
+ * and the work done for each option of the path program is timed on
+ * them, along with the memory allocated and the hardware counters if
+ * they can be read.  The time per path is compared between the sizes
+ * so that work which grows faster than the size of the list is noticed.
+ *
+ * Copyright (c) 2000 David I. Bell
+ * Permission is granted to use, distribute, or modify this source,
+ * provided that this copyright notice remains intact.
+ */
+
+#if defined(__linux__)
+#define	_GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/perf_event.h>)
+#define	HAVE_PERF_EVENT
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+#endif
+
+#include "libpath.h"
+
+
+/*
+ * Boolean definitions.
+ */
+typedef	int	BOOL;
+
+#define	FALSE	((BOOL) 0)
+#define	TRUE	((BOOL) 1)
+
+
+/*
+ * Each benchmark is repeated until it has run for at least this long,
+ * but no more than the maximum number of times.
+ */
+#define	MIN_TIME_NS		20000000LL
+#define	MAX_REPEATS		100000
+
+
+/*
+ * The time per path is compared between each size of path list and the
+ * next larger one, starting at the size where the fixed costs of a run
+ * no longer dominate.  Each size is ten times the previous one, so that
+ * quadratic work makes the time per path grow ten times, whereas cache
+ * misses only make it grow a few times.
+ */
+#define	SCALE_BASE_SIZE		1000
+#define	SCALE_LIMIT		4.0
+
+
+/*
+ * The maximum number of sizes of path lists.
+ */
+#define	MAX_SIZES		8
+
+
+/*
+ * Where the DOT path is placed in a generated path list.
+ */
+typedef	int	DOT_PLACE;
+
+#define	DOT_NONE	((DOT_PLACE) 0)
+#define	DOT_FRONT	((DOT_PLACE) 1)
+#define	DOT_MIDDLE	((DOT_PLACE) 2)
+#define	DOT_BACK	((DOT_PLACE) 3)
+
+
+/*
+ * The shape of a generated path list.
+ */
+typedef	struct
+{
+	const char *	name;		/* name of shape */
+	int		dupPercent;	/* percentage of duplicated paths */
+	DOT_PLACE	dotPlace;	/* where DOT is placed */
+	int		nameLength;	/* approximate length of path names */
+} SHAPE;
+
+
+/*
+ * A generated path list and the paths used as arguments for it.
+ */
+typedef	struct
+{
+	char *		value;		/* path list string */
+	size_t		length;		/* length of path list string */
+	char **		args;		/* paths for the options */
+	int		argCount;	/* number of paths for the options */
+	int		size;		/* number of paths in path list */
+} INPUT;
+
+
+/*
+ * The counts of memory allocated by the library.
+ */
+typedef	struct
+{
+	long	allocCount;	/* number of allocations */
+	long	allocBytes;	/* number of bytes allocated */
+} ALLOC_COUNTS;
+
+
+/*
+ * The hardware counters which are read if they are available.
+ */
+#define	COUNTER_CYCLES		0
+#define	COUNTER_INSTRUCTIONS	1
+#define	COUNTER_CACHE_MISSES	2
+#define	COUNTER_COUNT		3
+
+
+/*
+ * An option of the path program which is benchmarked.
+ * The routine does the work the program does for the option on a path
+ * list, using a new context each time as the program does.
+ */
+typedef	struct
+{
+	const char *	name;		/* option name */
+	int		action;		/* library action, or zero */
+	int		flags;		/* check flags, or nonzero to sort */
+	void		(*func)(PATH_CONTEXT * context, const INPUT * input,
+				int action, int flags);
+} BENCH;
+
+
+/*
+ * The result of one benchmark.
+ */
+typedef	struct
+{
+	double	nsPerRun;	/* time per run */
+	double	allocsPerRun;	/* allocations per run */
+	double	bytesPerRun;	/* bytes allocated per run */
+	double	counters[COUNTER_COUNT];	/* counters per run */
+	BOOL	haveCounters;	/* counters were read */
+} RESULT;
+
+
+/*
+ * Local procedures.
+ */
+static	void	Usage(void);
+static	void	MakeInput(INPUT * input, const SHAPE * shape, int size);
+static	void	FreeInput(INPUT * input);
+static	void	AppendName(char ** bufPtr, const char * prefix, long id,
+			int nameLength);
+static	unsigned int	Random(void);
+static	void	RunBench(const BENCH * bench, const INPUT * input,
+			RESULT * result);
+static	void	*	CountAllocate(void * data, size_t size);
+static	void	CountRelease(void * data, void * ptr, size_t size);
+static	long long	Now(void);
+static	BOOL	OpenCounters(void);
+static	void	StartCounters(void);
+static	BOOL	ReadCounters(double * values);
+static	void	BenchLoad(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	void	BenchApply(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	void	BenchPresent(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	void	BenchCheck(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	void	BenchList(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	void	BenchSerialize(PATH_CONTEXT * context, const INPUT * input,
+			int action, int flags);
+static	int	SortCallback(const void * p1, const void * p2);
+
+
+/*
+ * The shapes of the path lists which are generated.
+ */
+static	const SHAPE	shapeTable[] =
+{
+	{"unique",	0,	DOT_NONE,	12},
+	{"dup50",	50,	DOT_NONE,	12},
+	{"long",	10,	DOT_NONE,	160},
+	{"dotfront",	10,	DOT_FRONT,	24},
+	{"dotmiddle",	10,	DOT_MIDDLE,	24},
+	{"dotback",	10,	DOT_BACK,	24},
+	{NULL,		0,	DOT_NONE,	0}
+};
+
+
+/*
+ * The options which are benchmarked.
+ * The options which just set flags for others are not included.
+ */
+static	const BENCH	benchTable[] =
+{
+	{"(none)",	0,			0,	BenchLoad},
+	{"-a",		PATH_ADD_AFTER,		0,	BenchApply},
+	{"-b",		PATH_ADD_BEFORE,	0,	BenchApply},
+	{"-r",		PATH_REMOVE,		0,	BenchApply},
+	{"-ra",		PATH_REMOVE_AFTER,	0,	BenchApply},
+	{"-rb",		PATH_REMOVE_BEFORE,	0,	BenchApply},
+	{"-ma",		PATH_MOVE_AFTER,	0,	BenchApply},
+	{"-mb",		PATH_MOVE_BEFORE,	0,	BenchApply},
+	{"-tp",		0,			0,	BenchPresent},
+	{"-ri",		0,	PATH_REMOVE_INVALID,	BenchCheck},
+	{"-rr",		0,	PATH_REMOVE_RELATIVE,	BenchCheck},
+	{"-dn",		0,	PATH_DEMOTE_NETWORK,	BenchCheck},
+	{"-l",		0,			0,	BenchList},
+	{"-ls",		0,			1,	BenchList},
+	{"-print",	0,			0,	BenchSerialize},
+	{NULL,		0,			0,	NULL}
+};
+
+
+/*
+ * The default sizes of the path lists.
+ */
+static	const int	defaultSizes[] = {10, 100, 1000, 10000, 100000, 0};
+
+
+/*
+ * Counts of allocations, state for random numbers, and the file
+ * descriptors for the hardware counters.
+ */
+static	ALLOC_COUNTS	allocCounts;
+static	unsigned int	randomState;
+static	int		counterFds[COUNTER_COUNT];
+static	BOOL		haveCounters;
+static	volatile long	sink;
+
+
+int
+main(int argc, const char ** argv)
+{
+	const SHAPE *	shape;
+	const BENCH *	bench;
+	const char *	onlyOption;
+	const char *	onlyShape;
+	INPUT		input;
+	RESULT		result;
+	double		perPath[MAX_SIZES];
+	double		growth;
+	int		sizes[MAX_SIZES];
+	int		sizeCount;
+	int		maxSize;
+	int		index;
+	int		nonlinearCount;
+
+	onlyOption = NULL;
+	onlyShape = NULL;
+	maxSize = 100000;
+
+	for (index = 1; index < argc; index++)
+	{
+		if ((strcmp(argv[index], "-max") == 0) && (index + 1 < argc))
+			maxSize = atoi(argv[++index]);
+		else if ((strcmp(argv[index], "-option") == 0) &&
+			(index + 1 < argc))
+		{
+			onlyOption = argv[++index];
+		}
+		else if ((strcmp(argv[index], "-shape") == 0) &&
+			(index + 1 < argc))
+		{
+			onlyShape = argv[++index];
+		}
+		else
+			Usage();
+	}
+
+	sizeCount = 0;
+
+	for (index = 0; defaultSizes[index]; index++)
+	{
+		if (defaultSizes[index] <= maxSize)
+			sizes[sizeCount++] = defaultSizes[index];
+	}
+
+	if (sizeCount == 0)
+		Usage();
+
+	haveCounters = OpenCounters();
+
+	if (!haveCounters)
+		printf("Hardware counters are not available\n\n");
+
+	printf("%-8s %-10s %7s %12s %9s %9s %11s %12s %12s %10s\n",
+		"option", "shape", "paths", "ns/run", "ns/path",
+		"allocs", "bytes", "cycles", "instrs", "misses");
+
+	nonlinearCount = 0;
+
+	for (bench = benchTable; bench->name; bench++)
+	{
+		if (onlyOption && (strcmp(onlyOption, bench->name) != 0))
+			continue;
+
+		for (shape = shapeTable; shape->name; shape++)
+		{
+			if (onlyShape && (strcmp(onlyShape, shape->name) != 0))
+				continue;
+
+			for (index = 0; index < sizeCount; index++)
+			{
+				MakeInput(&input, shape, sizes[index]);
+
+				RunBench(bench, &input, &result);
+
+				perPath[index] = result.nsPerRun / sizes[index];
+
+				printf("%-8s %-10s %7d %12.0f %9.1f %9.1f %11.0f",
+					bench->name, shape->name, sizes[index],
+					result.nsPerRun, perPath[index],
+					result.allocsPerRun, result.bytesPerRun);
+
+				if (result.haveCounters)
+				{
+					printf(" %12.0f %12.0f %10.0f\n",
+						result.counters[COUNTER_CYCLES],
+						result.counters[COUNTER_INSTRUCTIONS],
+						result.counters[COUNTER_CACHE_MISSES]);
+				}
+				else
+					printf(" %12s %12s %10s\n", "-", "-", "-");
+
+				FreeInput(&input);
+
+				if ((index == 0) ||
+					(sizes[index - 1] < SCALE_BASE_SIZE))
+				{
+					continue;
+				}
+
+				growth = perPath[index] / perPath[index - 1];
+
+				if (growth > SCALE_LIMIT)
+				{
+					printf("NONLINEAR: %s on %s: time per path "
+						"grows %.1f times from %d to %d "
+						"paths\n", bench->name,
+						shape->name, growth,
+						sizes[index - 1], sizes[index]);
+
+					nonlinearCount++;
+				}
+			}
+		}
+	}
+
+	if (nonlinearCount)
+	{
+		printf("\n%d benchmarks grow faster than linearly\n",
+			nonlinearCount);
+
+		return 2;
+	}
+
+	return 0;
+}
+
+
+/*
+ * Print the usage of the program and exit.
+ */
+static void
+Usage(void)
+{
+	fprintf(stderr,
+	"Usage: pathbench [-max size] [-option name] [-shape name]\n");
+
+	exit(1);
+}
+
+
+/*
+ * Generate a path list of the specified shape and number of paths,
+ * along with the paths to use as arguments for the options.  Half of
+ * the arguments are in the path list and half are not.  The same
+ * path list is generated each time for the same shape and size.
+ */
+static void
+MakeInput(INPUT * input, const SHAPE * shape, int size)
+{
+	char *	cp;
+	long	uniqueCount;
+	long	id;
+	int	dotIndex;
+	int	index;
+
+	randomState = 1;
+
+	input->size = size;
+	input->value = (char *) malloc((size_t) size *
+		(shape->nameLength + 32) + 2);
+	input->argCount = size / 10 + 1;
+	input->args = (char **) malloc(sizeof(char *) * input->argCount);
+
+	if ((input->value == NULL) || (input->args == NULL))
+	{
+		fprintf(stderr, "Cannot allocate path list\n");
+
+		exit(1);
+	}
+
+	switch (shape->dotPlace)
+	{
+		case DOT_FRONT:
+			dotIndex = 0;
+			break;
+
+		case DOT_MIDDLE:
+			dotIndex = size / 2;
+			break;
+
+		case DOT_BACK:
+			dotIndex = size - 1;
+			break;
+
+		default:
+			dotIndex = -1;
+			break;
+	}
+
+	cp = input->value;
+	uniqueCount = 0;
+
+	for (index = 0; index < size; index++)
+	{
+		if (index > 0)
+			*cp++ = ':';
+
+		if (index == dotIndex)
+		{
+			*cp++ = '.';
+
+			continue;
+		}
+
+		if (uniqueCount && ((Random() % 100) < shape->dupPercent))
+			id = Random() % uniqueCount;
+		else
+			id = uniqueCount++;
+
+		AppendName(&cp, "/bench", id, shape->nameLength);
+	}
+
+	*cp = '\0';
+	input->length = cp - input->value;
+
+	for (index = 0; index < input->argCount; index++)
+	{
+		input->args[index] = (char *) malloc(shape->nameLength + 32);
+
+		if (input->args[index] == NULL)
+		{
+			fprintf(stderr, "Cannot allocate path\n");
+
+			exit(1);
+		}
+
+		cp = input->args[index];
+
+		if ((index % 2) && uniqueCount)
+			AppendName(&cp, "/bench", Random() % uniqueCount,
+				shape->nameLength);
+		else
+			AppendName(&cp, "/other", index, shape->nameLength);
+
+		*cp = '\0';
+	}
+}
+
+
+/*
+ * Free a generated path list.
+ */
+static void
+FreeInput(INPUT * input)
+{
+	int	index;
+
+	for (index = 0; index < input->argCount; index++)
+		free(input->args[index]);
+
+	free(input->args);
+	free(input->value);
+}
+
+
+/*
+ * Append a path name made from a prefix and a number to a buffer,
+ * padding it with a directory name to the approximate length.
+ */
+static void
+AppendName(char ** bufPtr, const char * prefix, long id, int nameLength)
+{
+	char *	cp;
+	int	count;
+
+	cp = *bufPtr;
+	cp += sprintf(cp, "%s/", prefix);
+
+	for (count = (int) (cp - *bufPtr) + 12; count < nameLength; count++)
+		*cp++ = 'a' + (count % 26);
+
+	cp += sprintf(cp, "/%ld", id);
+
+	*bufPtr = cp;
+}
+
+
+/*
+ * Return a pseudo random number, which is the same sequence each run.
+ */
+static unsigned int
+Random(void)
+{
+	randomState = randomState * 1103515245 + 12345;
+
+	return (randomState >> 8) & 0xffffff;
+}
+
+
+/*
+ * Run a benchmark on a path list repeatedly until enough time has
+ * passed, and return the average time, allocations and counters.
+ */
+static void
+RunBench(const BENCH * bench, const INPUT * input, RESULT * result)
+{
+	PATH_ALLOCATOR	allocator;
+	PATH_CONTEXT *	context;
+	long long	startTime;
+	long long	elapsed;
+	long		repeats;
+	int		index;
+
+	allocator.allocate = CountAllocate;
+	allocator.release = CountRelease;
+	allocator.data = &allocCounts;
+
+	allocCounts.allocCount = 0;
+	allocCounts.allocBytes = 0;
+
+	for (index = 0; index < COUNTER_COUNT; index++)
+		result->counters[index] = 0;
+
+	if (haveCounters)
+		StartCounters();
+
+	repeats = 0;
+	startTime = Now();
+
+	do
+	{
+		if (PathCreate(&allocator, &context) != PATH_OK)
+		{
+			fprintf(stderr, "Cannot create path context\n");
+
+			exit(1);
+		}
+
+		bench->func(context, input, bench->action, bench->flags);
+
+		PathDestroy(context);
+
+		repeats++;
+		elapsed = Now() - startTime;
+	}
+	while ((elapsed < MIN_TIME_NS) && (repeats < MAX_REPEATS));
+
+	result->haveCounters = FALSE;
+
+	if (haveCounters)
+		result->haveCounters = ReadCounters(result->counters);
+
+	for (index = 0; index < COUNTER_COUNT; index++)
+		result->counters[index] /= repeats;
+
+	result->nsPerRun = (double) elapsed / repeats;
+	result->allocsPerRun = (double) allocCounts.allocCount / repeats;
+	result->bytesPerRun = (double) allocCounts.allocBytes / repeats;
+}
+
+
+/*
+ * Allocator for the library which counts the allocations.
+ */
+static void *
+CountAllocate(void * data, size_t size)
+{
+	ALLOC_COUNTS *	counts;
+
+	counts = (ALLOC_COUNTS *) data;
+	counts->allocCount++;
+	counts->allocBytes += size;
+
+	return malloc(size);
+}
+
+
+static void
+CountRelease(void * data, void * ptr, size_t size)
+{
+	free(ptr);
+}
+
+
+/*
+ * Return the current time in nanoseconds.
+ */
+static long long
+Now(void)
+{
+	struct	timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+ * Open the hardware counters for this process as a group.
+ * Only user mode is counted so that no special privilege is needed.
+ * Returns TRUE if they were opened.
+ */
+static BOOL
+OpenCounters(void)
+{
+#ifdef	HAVE_PERF_EVENT
+	static	const int	configs[COUNTER_COUNT] =
+	{
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES
+	};
+	struct	perf_event_attr	attr;
+	int	index;
+
+	for (index = 0; index < COUNTER_COUNT; index++)
+	{
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[index];
+		attr.disabled = (index == 0);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+
+		counterFds[index] = syscall(SYS_perf_event_open, &attr, 0, -1,
+			(index == 0) ? -1 : counterFds[0], 0);
+
+		if (counterFds[index] < 0)
+		{
+			while (--index >= 0)
+				close(counterFds[index]);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+
+/*
+ * Reset and start the hardware counters.
+ */
+static void
+StartCounters(void)
+{
+#ifdef	HAVE_PERF_EVENT
+	ioctl(counterFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(counterFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+
+/*
+ * Stop the hardware counters and read their values.
+ * Returns TRUE if they were read.
+ */
+static BOOL
+ReadCounters(double * values)
+{
+#ifdef	HAVE_PERF_EVENT
+	uint64_t	buf[COUNTER_COUNT + 1];
+#endif
+	int		index;
+
+	for (index = 0; index < COUNTER_COUNT; index++)
+		values[index] = 0;
+
+#ifdef	HAVE_PERF_EVENT
+	ioctl(counterFds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+	if (read(counterFds[0], buf, sizeof(buf)) != sizeof(buf))
+		return FALSE;
+
+	for (index = 0; index < COUNTER_COUNT; index++)
+		values[index] = (double) buf[index + 1];
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+
+/*
+ * Just load the path list, which removes the duplicated paths as the
+ * program does when no options are given.
+ */
+static void
+BenchLoad(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	PathLoadBuffer(context, input->value, input->length);
+}
+
+
+/*
+ * Load the path list and apply an action to each of the arguments.
+ */
+static void
+BenchApply(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	int	index;
+
+	PathLoadBuffer(context, input->value, input->length);
+
+	for (index = 0; index < input->argCount; index++)
+		PathApply(context, action, input->args[index]);
+}
+
+
+/*
+ * Load the path list and test whether each of the arguments is present.
+ */
+static void
+BenchPresent(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	int	index;
+
+	PathLoadBuffer(context, input->value, input->length);
+
+	for (index = 0; index < input->argCount; index++)
+		sink += PathContains(context, input->args[index]);
+}
+
+
+/*
+ * Load the path list and check its paths.
+ * The generated paths do not exist, so this measures the overhead of
+ * checking rather than the speed of the filesystem.
+ */
+static void
+BenchCheck(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	PATH_CHECK	check;
+
+	memset(&check, 0, sizeof(check));
+	check.flags = flags;
+
+	PathLoadBuffer(context, input->value, input->length);
+	PathCheck(context, &check);
+}
+
+
+/*
+ * Load the path list and make the table of paths for listing them,
+ * sorting it if the flags are nonzero.  The paths are not printed.
+ */
+static void
+BenchList(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	const char **	table;
+	int		count;
+
+	PathLoadBuffer(context, input->value, input->length);
+
+	count = PathCount(context);
+	table = (const char **) malloc(sizeof(const char *) * (count + 1));
+
+	if (table == NULL)
+		return;
+
+	PathTable(context, table);
+
+	if (flags)
+		qsort(table, count, sizeof(const char *), SortCallback);
+
+	sink += (long) table[0];
+
+	free(table);
+}
+
+
+/*
+ * Load the path list and make the string for printing it.
+ */
+static void
+BenchSerialize(PATH_CONTEXT * context, const INPUT * input, int action,
+	int flags)
+{
+	char *	buf;
+	size_t	length;
+
+	PathLoadBuffer(context, input->value, input->length);
+
+	buf = (char *) malloc(input->length + 1);
+
+	if (buf == NULL)
+		return;
+
+	PathSerialize(context, buf, input->length + 1, &length);
+
+	sink += length;
+
+	free(buf);
+}
+
+
+/*
+ * Function called by qsort to compare two paths.
+ */
+static int
+SortCallback(const void * p1, const void * p2)
+{
+	return strcmp(*((const char **) p1), *((const char **) p2));
+}
@@ -0,0 +1,3014 @@
+/*
+ * Library to manipulate colon-separated path lists.
+ * This holds the set of paths and the actions on it for the path program,
+ * and can also be used by other programs.  See libpath.h for the interface.
+ *
+ * Copyright (c) 2000 David I. Bell
+ * Permission is granted to use, distribute, or modify this source,
+ * provided that this copyright notice remains intact.
+ */
+
+#if defined(__linux__)
+#define	_GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+
+#if defined(__linux__)
+#include <sys/vfs.h>
+#include <sys/sysmacros.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define	HAVE_IO_URING
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#if __has_include(<linux/openat2.h>)
+#define	HAVE_OPENAT2
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+#endif
+#endif
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#define	HAVE_SIMD
+#include <immintrin.h>
+#endif
+
+#include "libpath.h"
+
+
+/*
+ * Boolean definitions.
+ */
+typedef	int	BOOL;
+
+#define	FALSE	((BOOL) 0)
+#define	TRUE	((BOOL) 1)
+
+
+/*
+ * Special path definitions
+ */
+#define	PATH_DIVIDER	':'
+#define	ROOT_CHARACTER	'/'
+#define	DOT_PATH	"."
+
+
+/*
+ * The results of checking the validity of a path.
+ */
+typedef	int	STATUS;
+
+#define	STATUS_KEEP	((STATUS) 0)
+#define	STATUS_REMOVE	((STATUS) 1)
+#define	STATUS_ERROR	((STATUS) 2)
+
+
+/*
+ * The initial number of chains in the hash table of paths.
+ * This must be a power of two.
+ */
+#define	HASH_INITIAL_SIZE	64
+
+
+/*
+ * Constants for the FNV-1a hash of path names.
+ */
+#define	HASH_BASIS	2166136261U
+#define	HASH_PRIME	16777619U
+
+
+/*
+ * The size of the buffer on the stack for normalizing a path which is
+ * only being looked up.
+ */
+#define	CONTAINS_BUFFER_SIZE	1024
+
+
+/*
+ * An entry in the set of paths.  Each entry is linked into a doubly
+ * linked list which holds the order of the paths, and into a chain of
+ * the hash table which lets the path be found quickly by its name.
+ * Paths which were loaded from a path string point into the context's
+ * copy of the string, and other paths have their own copy of the name.
+ */
+typedef	struct	PATH_ENTRY	PATH_ENTRY;
+
+struct	PATH_ENTRY
+{
+	PATH_ENTRY *	next;		/* next path in list order */
+	PATH_ENTRY *	prev;		/* previous path in list order */
+	PATH_ENTRY *	hashNext;	/* next path in the same hash chain */
+	const char *	name;		/* path name */
+	char *		copy;		/* copy of name to be freed, or NULL */
+	unsigned int	hash;		/* hash value of the path name */
+};
+
+
+/*
+ * A context, which holds the paths we are working on.
+ * This is an ordered set of path names which never contains duplicates.
+ * The order is kept in a circular doubly linked list headed by head,
+ * and the hash table of chains finds the entry for a path name, so that
+ * paths can be found, removed, or added at either end in constant time.
+ * Entries which are removed are kept on a free list for reuse.
+ */
+struct	PATH_CONTEXT
+{
+	PATH_ALLOCATOR	allocator;	/* allocator for memory */
+	PATH_ENTRY	head;		/* head of list of paths */
+	PATH_ENTRY **	hashTable;	/* hash table of paths */
+	unsigned int	hashSize;	/* number of chains in hash table */
+	int		count;		/* number of paths */
+	PATH_ENTRY *	freeEntries;	/* entries which can be reused */
+	char *		loadString;	/* copy of the loaded path string */
+	size_t		loadSize;	/* size of the copy */
+	int		flags;		/* PATH_NORMALIZE flags */
+	char *		scratch;	/* buffer for normalizing a path */
+	size_t		scratchSize;	/* size of the buffer */
+	PATH_STATS	stats;		/* counts of work done */
+};
+
+
+/*
+ * Definitions for finding the status of the paths being checked.
+ * Paths are only checked as a batch when there are at least this
+ * many of them, and at most this many threads are used to do it.
+ * The ring used for checking the paths holds at most this many entries.
+ */
+#define	STAT_BATCH_MIN		4
+#define	STAT_MAX_WORKERS	16
+#define	STAT_RING_SIZE		256
+
+
+/*
+ * When there is a time limit for finding the status of the paths,
+ * up to this many threads are used so that nearly every path is started
+ * at once and one hung filesystem does not delay the checks of others.
+ */
+#define	STAT_MAX_TIMED_WORKERS	64
+
+
+/*
+ * When finding paths within another root directory without openat2,
+ * directories are opened only to look up the names in them, and at most
+ * this many symbolic links are followed for one path.
+ */
+#if defined(O_PATH)
+#define	ROOT_OPEN_FLAGS		(O_PATH | O_CLOEXEC)
+#else
+#define	ROOT_OPEN_FLAGS		(O_RDONLY | O_CLOEXEC)
+#endif
+
+#define	ROOT_MAX_LINKS		40
+
+
+/*
+ * When paths being checked share directories, each shared directory is
+ * opened once and the paths beneath it are found relative to it, so that
+ * the kernel does not look up the shared directories again for each path.
+ * At most this many shared directories are kept open at once.
+ */
+#define	STAT_MAX_PREFIXES	256
+
+
+/*
+ * Where the status of a path is found from when it is beneath a shared
+ * directory.  An error found when opening the directory is the result
+ * for all of the paths beneath it.
+ */
+typedef	struct
+{
+	int		fd;		/* directory or AT_FDCWD */
+	const char *	name;		/* name relative to the directory */
+	int		error;		/* error for the directory or zero */
+} STAT_PLACE;
+
+
+/*
+ * A shared directory which has been opened, as a prefix of a path.
+ */
+typedef	struct
+{
+	const char *	path;		/* path starting with the prefix */
+	size_t		length;		/* length of the prefix */
+	int		fd;		/* descriptor for the directory or -1 */
+	int		error;		/* error when opening it or zero */
+} STAT_PREFIX;
+
+
+/*
+ * Table of filesystem types which can be reported, as found by statfs.
+ * Network and user space filesystems are slow to search, and so can
+ * be moved behind the local ones.
+ */
+static	const PATH_FS_TYPE	fsTypeTable[] =
+{
+	{0xEF53,	"ext4",		FALSE},
+	{0x58465342,	"xfs",		FALSE},
+	{0x9123683E,	"btrfs",	FALSE},
+	{0x01021994,	"tmpfs",	FALSE},
+	{0x794C7630,	"overlay",	FALSE},
+	{0x73717368,	"squashfs",	FALSE},
+	{0x2FC12FC1,	"zfs",		FALSE},
+	{0x9FA0,	"proc",		FALSE},
+	{0x62656572,	"sysfs",	FALSE},
+	{0x4D44,	"vfat",		FALSE},
+	{0x6969,	"nfs",		TRUE},
+	{0x517B,	"smb",		TRUE},
+	{0xFF534D42,	"cifs",		TRUE},
+	{0xFE534D42,	"smb2",		TRUE},
+	{0x5346414F,	"afs",		TRUE},
+	{0x00C36400,	"ceph",		TRUE},
+	{0x0BD00BD0,	"lustre",	TRUE},
+	{0x47504653,	"gpfs",		TRUE},
+	{0x01021997,	"9p",		TRUE},
+	{0x65735546,	"fuse",		TRUE},
+	{0x6E667364,	"nfsd",		TRUE},
+	{0,		NULL,		FALSE}
+};
+
+
+/*
+ * A batch of paths whose status is being found by a group of threads.
+ * Each thread takes the next path from the table until they are all done.
+ * If there is a time limit, then the batch has its own copy of the paths
+ * and the threads store their results while holding the lock.  Once the
+ * batch has expired they no longer store them at all, since the waiting
+ * thread has given up on them, and the last user of the batch frees it.
+ */
+typedef	struct
+{
+	PATH_STAT *	table;		/* table of paths */
+	const STAT_PLACE *	places;	/* places of paths or NULL */
+	int		count;		/* number of paths in table */
+	int		next;		/* index of next path to be done */
+	int		doneCount;	/* number of paths which are done */
+	int		users;		/* threads still using the batch */
+	BOOL		fsTypes;	/* filesystem types are wanted */
+	BOOL		timeStat;	/* time taken for each path is wanted */
+	int		rootFd;		/* root to find paths in, or -1 */
+	BOOL		timed;		/* batch has a time limit */
+	BOOL		expired;	/* time limit has expired */
+	pthread_mutex_t	lock;		/* lock for results when timed */
+	pthread_cond_t	doneCond;	/* signaled when all paths are done */
+} STAT_BATCH;
+
+
+/*
+ * Local procedures.
+ */
+static	void *	Allocate(PATH_CONTEXT * context, size_t size);
+static	void	Release(PATH_CONTEXT * context, void * ptr, size_t size);
+static	void *	DefaultAllocate(void * data, size_t size);
+static	void	DefaultRelease(void * data, void * ptr, size_t size);
+static	PATH_ENTRY *	FindPath(PATH_CONTEXT * context,
+			const char * path, unsigned int hash);
+static	int	AddPath(PATH_CONTEXT * context, const char * path,
+			BOOL atFront);
+static	int	AddHashedPath(PATH_CONTEXT * context, const char * path,
+			unsigned int hash, BOOL atFront, BOOL copy);
+static	int	LoadPath(PATH_CONTEXT * context, char * str, int length);
+static	const char *	Normalized(PATH_CONTEXT * context, const char * path);
+static	int	NormalizePath(char * path, int length);
+static	void	RemoveEntry(PATH_CONTEXT * context, PATH_ENTRY * entry);
+static	void	MoveEntry(PATH_ENTRY * entry, PATH_ENTRY * before);
+static	int	EntrySortCallback(const void * addr1, const void * addr2);
+static	int	GrowHashTable(PATH_CONTEXT * context);
+static	unsigned int	HashPath(const char * path);
+static	int	NextDividerScalar(const char * str, int index, int length);
+
+#if defined(HAVE_SIMD)
+static	int	NextDividerSse2(const char * str, int index, int length);
+static	int	NextDividerAvx2(const char * str, int index, int length);
+#endif
+
+static	STATUS	CheckPath(const PATH_STAT * info, const PATH_CHECK * check);
+static	STATUS	CheckAlias(PATH_STAT * info, const PATH_STAT ** aliasTable,
+			unsigned int aliasSize, const PATH_CHECK * check);
+static	void	Report(const PATH_STAT * info, int problem,
+			const PATH_CHECK * check);
+static	void	StatPathsThreaded(PATH_STAT * table,
+			const STAT_PLACE * places, int count, BOOL fsTypes,
+			BOOL timeStat, int rootFd);
+static	void	StatPathsTimed(PATH_STAT * table, int count, BOOL fsTypes,
+			BOOL timeStat, int rootFd, int timeoutMs);
+static	void *	StatWorker(void * arg);
+static	void	StatPath(PATH_STAT * info, const STAT_PLACE * place,
+			BOOL fsTypes, BOOL timeStat, int rootFd);
+static	STAT_PLACE *	SharePrefixes(PATH_STAT * table, int count,
+			int * prefixFds, int * prefixCountPtr);
+static	size_t	SharedDirLength(const char * path1, const char * path2);
+static	void	OpenPrefix(STAT_PREFIX * stack, int * depthPtr,
+			const char * path, size_t length, int * prefixFds,
+			int * prefixCountPtr);
+static	int	PathSortCallback(const void * addr1, const void * addr2);
+static	int	OpenInRoot(int rootFd, const char * path);
+static	int	WalkInRoot(int rootFd, const char * path);
+static	long	ElapsedNs(const struct timespec * start);
+static	void	ReleaseBatch(STAT_BATCH * batch);
+static	const PATH_FS_TYPE *	FindFsType(const char * path, int fd);
+
+#if defined(HAVE_IO_URING)
+static	BOOL	StatPathsUring(PATH_STAT * table, const STAT_PLACE * places,
+			int count, BOOL timeStat);
+#endif
+
+
+/*
+ * Create a new context holding an empty path list, using the specified
+ * allocator for its memory, or malloc and free if it is NULL.
+ * Returns PATH_OK and stores the context, or returns an error.
+ */
+int
+PathCreate(const PATH_ALLOCATOR * allocator, PATH_CONTEXT ** contextPtr)
+{
+	PATH_CONTEXT *	context;
+	PATH_ALLOCATOR	defaultAllocator;
+
+	if (contextPtr == NULL)
+		return PATH_ERR_ARGUMENT;
+
+	*contextPtr = NULL;
+
+	if (allocator == NULL)
+	{
+		defaultAllocator.allocate = DefaultAllocate;
+		defaultAllocator.release = DefaultRelease;
+		defaultAllocator.data = NULL;
+
+		allocator = &defaultAllocator;
+	}
+
+	if ((allocator->allocate == NULL) || (allocator->release == NULL))
+		return PATH_ERR_ARGUMENT;
+
+	context = (PATH_CONTEXT *) allocator->allocate(allocator->data,
+		sizeof(PATH_CONTEXT));
+
+	if (context == NULL)
+		return PATH_ERR_MEMORY;
+
+	memset(context, 0, sizeof(PATH_CONTEXT));
+
+	context->allocator = *allocator;
+	context->head.next = &context->head;
+	context->head.prev = &context->head;
+	context->hashSize = HASH_INITIAL_SIZE;
+	context->hashTable = (PATH_ENTRY **) Allocate(context,
+		sizeof(PATH_ENTRY *) * context->hashSize);
+
+	if (context->hashTable == NULL)
+	{
+		Release(context, context, sizeof(PATH_CONTEXT));
+
+		return PATH_ERR_MEMORY;
+	}
+
+	memset(context->hashTable, 0, sizeof(PATH_ENTRY *) * context->hashSize);
+
+	*contextPtr = context;
+
+	return PATH_OK;
+}
+
+
+/*
+ * Destroy a context, freeing all of its memory.
+ */
+void
+PathDestroy(PATH_CONTEXT * context)
+{
+	PATH_ENTRY *	entry;
+
+	if (context == NULL)
+		return;
+
+	PathClear(context);
+
+	while (context->freeEntries != NULL)
+	{
+		entry = context->freeEntries;
+		context->freeEntries = entry->hashNext;
+
+		Release(context, entry, sizeof(PATH_ENTRY));
+	}
+
+	if (context->loadString != NULL)
+		Release(context, context->loadString, context->loadSize);
+
+	if (context->scratch != NULL)
+		Release(context, context->scratch, context->scratchSize);
+
+	Release(context, context->hashTable,
+		sizeof(PATH_ENTRY *) * context->hashSize);
+
+	Release(context, context, sizeof(PATH_CONTEXT));
+}
+
+
+/*
+ * Set the flags which say how the context handles the paths given to it.
+ * These apply to paths given afterwards, so they are normally set before
+ * the path list is loaded.
+ */
+int
+PathSetFlags(PATH_CONTEXT * context, int flags)
+{
+	if ((context == NULL) || (flags & ~PATH_NORMALIZE))
+		return PATH_ERR_ARGUMENT;
+
+	context->flags = flags;
+
+	return PATH_OK;
+}
+
+
+/*
+ * Set the path list from a path string, replacing any existing paths.
+ */
+int
+PathLoad(PATH_CONTEXT * context, const char * str)
+{
+	if (str == NULL)
+		return PATH_ERR_ARGUMENT;
+
+	return PathLoadBuffer(context, str, strlen(str));
+}
+
+
+/*
+ * Set the path list from a path string of the specified length which
+ * need not be terminated, replacing any existing paths.
+ * The string is split into its component paths in one pass, finding
+ * the dividers many characters at a time when the processor allows it,
+ * and hashing each path as soon as its end is found.  Only the first
+ * occurrence of a path is kept, and a null path is converted into the
+ * explicit name for the current directory.  The copy of the string
+ * which the paths point into is reused when it is large enough.
+ */
+int
+PathLoadBuffer(PATH_CONTEXT * context, const char * str, size_t length)
+{
+	int	(*nextDivider)(const char *, int, int);
+	char *	copy;
+	int	start;
+	int	end;
+	int	status;
+
+	if ((context == NULL) || (str == NULL) || (length > INT_MAX - 1))
+		return PATH_ERR_ARGUMENT;
+
+	PathClear(context);
+
+	/*
+	 * An empty string is an empty list rather than a single empty path.
+	 */
+	if (length == 0)
+		return PATH_OK;
+
+	/*
+	 * Keep a copy of the string which the paths can point into.
+	 */
+	if (context->loadSize < length + 1)
+	{
+		copy = (char *) Allocate(context, length + 1);
+
+		if (copy == NULL)
+			return PATH_ERR_MEMORY;
+
+		if (context->loadString != NULL)
+			Release(context, context->loadString, context->loadSize);
+
+		context->loadString = copy;
+		context->loadSize = length + 1;
+	}
+
+	copy = context->loadString;
+
+	memcpy(copy, str, length);
+	copy[length] = '\0';
+
+	context->stats.bytesCopied += length;
+
+	/*
+	 * Select the fastest method of finding dividers which the
+	 * processor supports.
+	 */
+	nextDivider = NextDividerScalar;
+
+#if defined(HAVE_SIMD)
+	nextDivider = NextDividerSse2;
+
+	if (__builtin_cpu_supports("avx2"))
+		nextDivider = NextDividerAvx2;
+#endif
+
+	/*
+	 * Terminate and add each path in turn.  Be careful to make sure
+	 * that all empty paths are seen (such as that caused by a trailing
+	 * colon).
+	 */
+	start = 0;
+
+	for (;;)
+	{
+		end = nextDivider(copy, start, (int) length);
+
+		copy[end] = '\0';
+
+		status = LoadPath(context, copy + start, end - start);
+
+		if (status != PATH_OK)
+			return status;
+
+		if (end == (int) length)
+			return PATH_OK;
+
+		start = end + 1;
+	}
+}
+
+
+/*
+ * Hash one path of the given length found while splitting a path string
+ * and add it to the end of the set of paths if it is not already present.
+ * A null path is converted into the explicit name for the current directory.
+ * The path is normalized where it is if that is wanted.
+ */
+static int
+LoadPath(PATH_CONTEXT * context, char * str, int length)
+{
+	unsigned int	hash;
+	int		index;
+
+	if (length == 0)
+		return AddPath(context, DOT_PATH, FALSE);
+
+	if (context->flags & PATH_NORMALIZE)
+		length = NormalizePath(str, length);
+
+	hash = HASH_BASIS;
+
+	for (index = 0; index < length; index++)
+	{
+		hash ^= (unsigned char) str[index];
+		hash *= HASH_PRIME;
+	}
+
+	return AddHashedPath(context, str, hash, FALSE, FALSE);
+}
+
+
+/*
+ * Return the normalized form of a path if paths are being normalized,
+ * using the context's buffer for it, or else the path itself.
+ * Returns NULL if the buffer could not be allocated.
+ */
+static const char *
+Normalized(PATH_CONTEXT * context, const char * path)
+{
+	size_t	length;
+	char *	buf;
+
+	if (!(context->flags & PATH_NORMALIZE))
+		return path;
+
+	length = strlen(path);
+
+	if ((length > INT_MAX - 1) || (length == 0))
+		return (length ? NULL : path);
+
+	if (context->scratchSize < length + 1)
+	{
+		buf = (char *) Allocate(context, length + 1);
+
+		if (buf == NULL)
+			return NULL;
+
+		if (context->scratch != NULL)
+			Release(context, context->scratch, context->scratchSize);
+
+		context->scratch = buf;
+		context->scratchSize = length + 1;
+	}
+
+	memcpy(context->scratch, path, length + 1);
+
+	NormalizePath(context->scratch, (int) length);
+
+	return context->scratch;
+}
+
+
+/*
+ * Normalize a path of the specified length where it is, only looking at
+ * its characters and not at the filesystem.  Repeated and trailing
+ * slashes and "." components are removed, and ".." components directly
+ * after the root are removed since the parent of the root is the root.
+ * Other ".." components are kept since a symbolic link before one can
+ * make it refer somewhere else.  A path which becomes empty is the name
+ * for the current directory.  Returns the new length of the path, which
+ * is terminated.  The path must have room for the terminating character.
+ */
+static int
+NormalizePath(char * path, int length)
+{
+	BOOL	absolute;
+	int	in;
+	int	out;
+	int	start;
+	int	count;
+
+	absolute = (path[0] == ROOT_CHARACTER);
+	in = 0;
+	out = 0;
+
+	if (absolute)
+		path[out++] = ROOT_CHARACTER;
+
+	while (in < length)
+	{
+		while ((in < length) && (path[in] == ROOT_CHARACTER))
+			in++;
+
+		start = in;
+
+		while ((in < length) && (path[in] != ROOT_CHARACTER))
+			in++;
+
+		count = in - start;
+
+		if ((count == 0) || ((count == 1) && (path[start] == '.')))
+			continue;
+
+		if (absolute && (out == 1) && (count == 2) &&
+			(path[start] == '.') && (path[start + 1] == '.'))
+		{
+			continue;
+		}
+
+		if ((out > 0) && (path[out - 1] != ROOT_CHARACTER))
+			path[out++] = ROOT_CHARACTER;
+
+		memmove(path + out, path + start, count);
+		out += count;
+	}
+
+	if (out == 0)
+		path[out++] = '.';
+
+	path[out] = '\0';
+
+	return out;
+}
+
+
+/*
+ * Return the offset of the next path divider in a string of the specified
+ * length, starting at the specified offset.  Returns the length of the
+ * string if there are no more dividers.
+ */
+static int
+NextDividerScalar(const char * str, int index, int length)
+{
+	while ((index < length) && (str[index] != PATH_DIVIDER))
+		index++;
+
+	return index;
+}
+
+#if defined(HAVE_SIMD)
+
+/*
+ * Find the next path divider comparing 16 characters at a time
+ * using SSE2 instructions.  The remainder is checked one at a time.
+ */
+static int
+NextDividerSse2(const char * str, int index, int length)
+{
+	__m128i	dividers;
+	__m128i	chars;
+	int	mask;
+
+	dividers = _mm_set1_epi8(PATH_DIVIDER);
+
+	while (index + 16 <= length)
+	{
+		chars = _mm_loadu_si128((const __m128i *) (str + index));
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chars, dividers));
+
+		if (mask)
+			return index + __builtin_ctz(mask);
+
+		index += 16;
+	}
+
+	return NextDividerScalar(str, index, length);
+}
+
+/*
+ * Find the next path divider comparing 32 characters at a time
+ * using AVX2 instructions.  This is only called when the processor
+ * supports them.  The remainder is checked using SSE2.
+ */
+__attribute__((target("avx2")))
+static int
+NextDividerAvx2(const char * str, int index, int length)
+{
+	__m256i		dividers;
+	__m256i		chars;
+	unsigned int	mask;
+
+	dividers = _mm256_set1_epi8(PATH_DIVIDER);
+
+	while (index + 32 <= length)
+	{
+		chars = _mm256_loadu_si256((const __m256i *) (str + index));
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, dividers));
+
+		if (mask)
+			return index + __builtin_ctz(mask);
+
+		index += 32;
+	}
+
+	return NextDividerSse2(str, index, length);
+}
+#endif
+
+
+/*
+ * Remove all of the paths from the path list.
+ */
+void
+PathClear(PATH_CONTEXT * context)
+{
+	while (context->head.next != &context->head)
+		RemoveEntry(context, context->head.next);
+}
+
+
+/*
+ * Apply an action to the specified path.
+ * Each action takes constant time since the set of paths is hashed.
+ * A null path is converted into the explicit name for the current directory.
+ * A path which is already present is moved rather than removed and added
+ * again, so that the path given can be one of the names in the list.
+ */
+int
+PathApply(PATH_CONTEXT * context, int action, const char * path)
+{
+	PATH_ENTRY *	entry;
+	PATH_ENTRY *	head;
+
+	if ((context == NULL) || (path == NULL))
+		return PATH_ERR_ARGUMENT;
+
+	if (*path == '\0')
+		path = DOT_PATH;
+
+	path = Normalized(context, path);
+
+	if (path == NULL)
+		return PATH_ERR_MEMORY;
+
+	entry = FindPath(context, path, HashPath(path));
+	head = &context->head;
+
+	/*
+	 * A path added before the current paths always ends up first
+	 * since only the first occurrence of a path is kept, so adding
+	 * it that way moves any existing occurrence to the front.
+	 */
+	switch (action)
+	{
+		case PATH_REMOVE:
+			if (entry != NULL)
+				RemoveEntry(context, entry);
+
+			return PATH_OK;
+
+		case PATH_ADD_AFTER:
+			if (entry != NULL)
+				return PATH_OK;
+
+			return AddPath(context, path, FALSE);
+
+		case PATH_REMOVE_AFTER:
+			if (entry == NULL)
+				return AddPath(context, path, FALSE);
+
+			/* fall into next case */
+
+		case PATH_MOVE_AFTER:
+			if (entry != NULL)
+				MoveEntry(entry, head);
+
+			return PATH_OK;
+
+		case PATH_ADD_BEFORE:
+		case PATH_REMOVE_BEFORE:
+			if (entry == NULL)
+				return AddPath(context, path, TRUE);
+
+			/* fall into next case */
+
+		case PATH_MOVE_BEFORE:
+			if (entry != NULL)
+				MoveEntry(entry, head->next);
+
+			return PATH_OK;
+
+		default:
+			return PATH_ERR_ARGUMENT;
+	}
+}
+
+
+/*
+ * Put the paths of the path list into the order given by a table of
+ * all of its paths, such as one made by PathTable and then rearranged.
+ * Returns PATH_ERR_ARGUMENT without changing the order if the table does
+ * not hold exactly the paths in the list.
+ */
+int
+PathReorder(PATH_CONTEXT * context, const char ** table, int count)
+{
+	PATH_ENTRY **	entries;
+	PATH_ENTRY **	sorted;
+	size_t		size;
+	int		index;
+	int		status;
+
+	if ((context == NULL) || (table == NULL) || (count != context->count))
+		return PATH_ERR_ARGUMENT;
+
+	if (count == 0)
+		return PATH_OK;
+
+	size = sizeof(PATH_ENTRY *) * count;
+	entries = (PATH_ENTRY **) Allocate(context, size);
+	sorted = (PATH_ENTRY **) Allocate(context, size);
+
+	if ((entries == NULL) || (sorted == NULL))
+	{
+		if (entries != NULL)
+			Release(context, entries, size);
+
+		if (sorted != NULL)
+			Release(context, sorted, size);
+
+		return PATH_ERR_MEMORY;
+	}
+
+	/*
+	 * Find the entry for every path, and make sure that none of them
+	 * is given twice by sorting the entries and comparing neighbours.
+	 */
+	status = PATH_OK;
+
+	for (index = 0; index < count; index++)
+	{
+		entries[index] = FindPath(context, table[index],
+			HashPath(table[index]));
+
+		if (entries[index] == NULL)
+			status = PATH_ERR_ARGUMENT;
+
+		sorted[index] = entries[index];
+	}
+
+	if (status == PATH_OK)
+	{
+		qsort(sorted, count, sizeof(PATH_ENTRY *), EntrySortCallback);
+
+		for (index = 1; index < count; index++)
+		{
+			if (sorted[index] == sorted[index - 1])
+				status = PATH_ERR_ARGUMENT;
+		}
+	}
+
+	/*
+	 * Move each entry to the end of the list in turn.
+	 */
+	if (status == PATH_OK)
+	{
+		for (index = 0; index < count; index++)
+			MoveEntry(entries[index], &context->head);
+	}
+
+	Release(context, entries, size);
+	Release(context, sorted, size);
+
+	return status;
+}
+
+
+/*
+ * Function called by qsort to compare the addresses of two entries.
+ */
+static int
+EntrySortCallback(const void * addr1, const void * addr2)
+{
+	const PATH_ENTRY *	entry1;
+	const PATH_ENTRY *	entry2;
+
+	entry1 = *(const PATH_ENTRY **) addr1;
+	entry2 = *(const PATH_ENTRY **) addr2;
+
+	return (entry1 > entry2) - (entry1 < entry2);
+}
+
+
+/*
+ * Return the number of paths in the path list.
+ */
+int
+PathCount(const PATH_CONTEXT * context)
+{
+	return context->count;
+}
+
+
+/*
+ * Return whether the specified path is in the path list.
+ * Nothing in the context is changed, not even the counts of work done,
+ * so that several threads can use the same context for this at once.
+ * A path being normalized is copied into a buffer on the stack, or from
+ * malloc if it is too long for that.
+ */
+int
+PathContains(const PATH_CONTEXT * context, const char * path)
+{
+	const PATH_ENTRY *	entry;
+	char			buf[CONTAINS_BUFFER_SIZE];
+	char *			copy;
+	size_t			length;
+	unsigned int		hash;
+
+	if (*path == '\0')
+		path = DOT_PATH;
+
+	copy = NULL;
+
+	if (context->flags & PATH_NORMALIZE)
+	{
+		length = strlen(path);
+
+		if (length > INT_MAX - 1)
+			return FALSE;
+
+		copy = buf;
+
+		if (length >= sizeof(buf))
+		{
+			copy = (char *) malloc(length + 1);
+
+			if (copy == NULL)
+				return FALSE;
+		}
+
+		memcpy(copy, path, length + 1);
+		NormalizePath(copy, (int) length);
+		path = copy;
+	}
+
+	hash = HashPath(path);
+	entry = context->hashTable[hash & (context->hashSize - 1)];
+
+	while ((entry != NULL) &&
+		((entry->hash != hash) || (strcmp(entry->name, path) != 0)))
+	{
+		entry = entry->hashNext;
+	}
+
+	if ((copy != NULL) && (copy != buf))
+		free(copy);
+
+	return (entry != NULL);
+}
+
+
+/*
+ * Return the first path in the path list, or NULL if it is empty.
+ */
+const char *
+PathFirst(const PATH_CONTEXT * context)
+{
+	if (context->count == 0)
+		return NULL;
+
+	return context->head.next->name;
+}
+
+
+/*
+ * Return the last path in the path list, or NULL if it is empty.
+ */
+const char *
+PathLast(const PATH_CONTEXT * context)
+{
+	if (context->count == 0)
+		return NULL;
+
+	return context->head.prev->name;
+}
+
+
+/*
+ * Store the names of the paths into a table in their list order.
+ * The table must have room for PathCount entries, and is NOT terminated
+ * with a null pointer.  The names are valid until the path list changes.
+ * Returns the number of paths.
+ */
+int
+PathTable(const PATH_CONTEXT * context, const char ** table)
+{
+	const PATH_ENTRY *	entry;
+	int			index;
+
+	index = 0;
+
+	for (entry = context->head.next; entry != &context->head;
+		entry = entry->next)
+	{
+		table[index++] = entry->name;
+	}
+
+	return index;
+}
+
+
+/*
+ * Store the path list as a path string into a buffer of the specified
+ * size, including a terminating null character.  The length of the
+ * string without the null character is stored if the pointer is not NULL.
+ * Returns PATH_ERR_SPACE if the buffer is too small, in which case the
+ * length is still stored so that a large enough buffer can be used.
+ */
+int
+PathSerialize(const PATH_CONTEXT * context, char * buf, size_t size,
+	size_t * lengthPtr)
+{
+	const PATH_ENTRY *	entry;
+	size_t			length;
+	size_t			nameLength;
+
+	length = 0;
+
+	for (entry = context->head.next; entry != &context->head;
+		entry = entry->next)
+	{
+		nameLength = strlen(entry->name);
+
+		if (entry != context->head.next)
+		{
+			if (length < size)
+				buf[length] = PATH_DIVIDER;
+
+			length++;
+		}
+
+		if (length + nameLength < size)
+			memcpy(buf + length, entry->name, nameLength);
+
+		length += nameLength;
+	}
+
+	if (lengthPtr != NULL)
+		*lengthPtr = length;
+
+	if (length >= size)
+		return PATH_ERR_SPACE;
+
+	buf[length] = '\0';
+
+	return PATH_OK;
+}
+
+
+/*
+ * Return the counts of the work done by a context since it was created.
+ */
+void
+PathGetStats(const PATH_CONTEXT * context, PATH_STATS * stats)
+{
+	*stats = context->stats;
+}
+
+
+/*
+ * Check the paths in the path list for validity.  Depending on the flags,
+ * remove invalid paths from the list or report them.  Reported paths
+ * are also removed.  Paths on slow or network filesystems can also be
+ * moved to the end of the list, keeping their order, and paths which are
+ * the same directory as an earlier path can be removed.
+ * Returns PATH_ERR_INVALID if any paths were reported as invalid.
+ */
+int
+PathCheck(PATH_CONTEXT * context, const PATH_CHECK * check)
+{
+	PATH_ENTRY *	entry;
+	PATH_ENTRY *	next;
+	PATH_ENTRY *	end;
+	PATH_ENTRY **	demoteTable;
+	PATH_STAT *	infoTable;
+	PATH_STAT *	info;
+	PATH_STAT	relative;
+	const PATH_STAT **	aliasTable;
+	unsigned int	aliasSize;
+	size_t		infoSize;
+	size_t		demoteSize;
+	int		infoCount;
+	int		demoteCount;
+	int		index;
+	int		result;
+	STATUS		status;
+
+	if ((context == NULL) || (check == NULL))
+		return PATH_ERR_ARGUMENT;
+
+	/*
+	 * If the absolute paths are to be checked for validity or their
+	 * filesystems are needed, then find the status of all of them at
+	 * once, so that the waits for slow filesystems overlap instead of
+	 * happening one at a time.  The results are used below in the
+	 * same order as the paths.
+	 */
+	infoTable = NULL;
+	infoCount = 0;
+	infoSize = sizeof(PATH_STAT) * (context->count + 1);
+	demoteTable = NULL;
+	demoteCount = 0;
+	demoteSize = sizeof(PATH_ENTRY *) * (context->count + 1);
+	aliasTable = NULL;
+	aliasSize = 0;
+
+	if (check->flags & (PATH_CHECK_INVALID | PATH_REMOVE_INVALID |
+		PATH_DEMOTE_NETWORK | PATH_FS_TYPES | PATH_REMOVE_ALIASES |
+		PATH_REPORT_ALIASES))
+	{
+		infoTable = (PATH_STAT *) Allocate(context, infoSize);
+		demoteTable = (PATH_ENTRY **) Allocate(context, demoteSize);
+
+		if ((infoTable == NULL) || (demoteTable == NULL))
+		{
+			if (infoTable != NULL)
+				Release(context, infoTable, infoSize);
+
+			if (demoteTable != NULL)
+				Release(context, demoteTable, demoteSize);
+
+			return PATH_ERR_MEMORY;
+		}
+
+		for (entry = context->head.next; entry != &context->head;
+			entry = entry->next)
+		{
+			if (*entry->name == ROOT_CHARACTER)
+			{
+				infoTable[infoCount].aliasOf = NULL;
+				infoTable[infoCount++].path = entry->name;
+			}
+		}
+
+		if (check->statFunc != NULL)
+		{
+			result = check->statFunc(check->statData, infoTable,
+				infoCount, check);
+		}
+		else
+			result = PathStat(infoTable, infoCount, check);
+
+		if (result != PATH_OK)
+		{
+			Release(context, infoTable, infoSize);
+			Release(context, demoteTable, demoteSize);
+
+			return result;
+		}
+
+		/*
+		 * If paths to the same directory are to be removed, then
+		 * make an empty hash table for the identities of the paths
+		 * being kept, which is at most half full.
+		 */
+		if (check->flags & (PATH_REMOVE_ALIASES | PATH_REPORT_ALIASES))
+		{
+			aliasSize = HASH_INITIAL_SIZE;
+
+			while (aliasSize < (unsigned int) infoCount * 2)
+				aliasSize *= 2;
+
+			aliasTable = (const PATH_STAT **) Allocate(context,
+				sizeof(const PATH_STAT *) * aliasSize);
+
+			if (aliasTable == NULL)
+			{
+				Release(context, infoTable, infoSize);
+				Release(context, demoteTable, demoteSize);
+
+				return PATH_ERR_MEMORY;
+			}
+
+			memset(aliasTable, 0,
+				sizeof(const PATH_STAT *) * aliasSize);
+		}
+	}
+
+	result = PATH_OK;
+	info = infoTable;
+
+	for (entry = context->head.next; entry != &context->head; entry = next)
+	{
+		/*
+		 * Get the next path and check it for validity.
+		 * Relative paths have no status.
+		 */
+		next = entry->next;
+
+		if ((info == NULL) || (*entry->name != ROOT_CHARACTER))
+		{
+			memset(&relative, 0, sizeof(relative));
+			relative.path = entry->name;
+
+			status = CheckPath(&relative, check);
+		}
+		else
+		{
+			if ((check->flags & PATH_FS_TYPES) && !info->slow &&
+				!info->error)
+			{
+				Report(info, PATH_PROBLEM_FS_TYPE, check);
+			}
+
+			status = CheckPath(info, check);
+
+			/*
+			 * A valid path which is the same directory as one
+			 * kept earlier is removed.
+			 */
+			if ((aliasTable != NULL) && (status == STATUS_KEEP) &&
+				!info->slow && !info->error)
+			{
+				status = CheckAlias(info, aliasTable, aliasSize,
+					check);
+			}
+
+			/*
+			 * Remember the paths to be moved to the end of the
+			 * list because they are on a slow or network
+			 * filesystem.
+			 */
+			if ((check->flags & PATH_DEMOTE_NETWORK) &&
+				(status == STATUS_KEEP) && (info->slow ||
+				(info->fsType && info->fsType->remote)))
+			{
+				demoteTable[demoteCount++] = entry;
+			}
+
+			info++;
+		}
+
+		/*
+		 * Act on the result of checking the path.
+		 * This is either to keep the path, silently remove the path
+		 * from the list, or set an error because of the path.
+		 */
+		switch (status)
+		{
+			case STATUS_KEEP:
+				break;
+
+			case STATUS_REMOVE:
+				RemoveEntry(context, entry);
+				break;
+
+			case STATUS_ERROR:
+				RemoveEntry(context, entry);
+				result = PATH_ERR_INVALID;
+				break;
+		}
+	}
+
+	/*
+	 * Move the demoted paths to the end of the list keeping their order.
+	 * If the DOT path is handled specially and is last, it stays last.
+	 */
+	end = &context->head;
+
+	if (!(check->flags & PATH_PLAIN_DOT) && (context->count > 0) &&
+		(strcmp(context->head.prev->name, DOT_PATH) == 0))
+	{
+		end = context->head.prev;
+	}
+
+	for (index = 0; index < demoteCount; index++)
+		MoveEntry(demoteTable[index], end);
+
+	if (infoTable != NULL)
+	{
+		Release(context, infoTable, infoSize);
+		Release(context, demoteTable, demoteSize);
+	}
+
+	if (aliasTable != NULL)
+		Release(context, aliasTable, sizeof(const PATH_STAT *) * aliasSize);
+
+	return result;
+}
+
+
+/*
+ * See whether a valid path has the same device and inode as one which is
+ * being kept earlier in the list, such as through a symbolic link or a
+ * bind mount.  If so, it is removed and reported if that is wanted,
+ * and otherwise it is added to the hash table of identities.
+ * Returns STATUS_REMOVE for such a path, or else STATUS_KEEP.
+ */
+static STATUS
+CheckAlias(PATH_STAT * info, const PATH_STAT ** aliasTable,
+	unsigned int aliasSize, const PATH_CHECK * check)
+{
+	uint64_t	key;
+	unsigned int	index;
+
+	key = ((uint64_t) info->ino * 0x9E3779B97F4A7C15ULL) ^
+		(uint64_t) info->dev;
+
+	index = (unsigned int) (key ^ (key >> 32)) & (aliasSize - 1);
+
+	while (aliasTable[index] != NULL)
+	{
+		if ((aliasTable[index]->ino == info->ino) &&
+			(aliasTable[index]->dev == info->dev))
+		{
+			info->aliasOf = aliasTable[index]->path;
+
+			if (check->flags & PATH_REPORT_ALIASES)
+				Report(info, PATH_PROBLEM_ALIAS, check);
+
+			return STATUS_REMOVE;
+		}
+
+		index = (index + 1) & (aliasSize - 1);
+	}
+
+	aliasTable[index] = info;
+
+	return STATUS_KEEP;
+}
+
+
+/*
+ * Check a path for validity according to the flags, given its status
+ * if it is an absolute path.  Depending on the flags, a problem is
+ * reported for invalid paths.
+ * Returns one of the following status values:
+ *	STATUS_KEEP		Path is valid and should be kept
+ *	STATUS_REMOVE		Path is invalid and must be removed
+ *	STATUS_ERROR		Path is invalid and was reported
+ */
+static STATUS
+CheckPath(const PATH_STAT * info, const PATH_CHECK * check)
+{
+	const char *	path;
+	int		flags;
+
+	path = info->path;
+	flags = check->flags;
+
+	/*
+	 * See if the path is relative.
+	 * If so, then check whether that is allowed.
+	 */
+	if (*path != ROOT_CHARACTER)
+	{
+		/*
+		 * If we can treat DOT as special, then keep it even when
+		 * all other relative paths are disallowed.
+		 */
+		if (!(flags & PATH_PLAIN_DOT) && (strcmp(path, DOT_PATH) == 0))
+			return STATUS_KEEP;
+
+		/*
+		 * If we want to remove relative paths, then return that.
+		 */
+		if (flags & PATH_REMOVE_RELATIVE)
+			return STATUS_REMOVE;
+
+		/*
+		 * If we are checking relative paths, then report it
+		 * and return that.
+		 */
+		if (flags & PATH_CHECK_RELATIVE)
+		{
+			Report(info, PATH_PROBLEM_RELATIVE, check);
+
+			return STATUS_ERROR;
+		}
+
+		/*
+		 * The relative path is allowed and should be kept.
+		 */
+		return STATUS_KEEP;
+	}
+
+	/*
+	 * The path is an absolute one.
+	 * If checking of the validity of paths is not enabled,
+	 * then we want to keep all the absolute paths.
+	 */
+	if (!(flags & (PATH_CHECK_INVALID | PATH_REMOVE_INVALID)))
+		return STATUS_KEEP;
+
+	/*
+	 * The absolute path has to be checked for validity using the
+	 * status which was found for it.  If the path did not respond
+	 * in time then it is invalid unless it is to be moved to the end.
+	 */
+	if (info->slow)
+	{
+		if (flags & PATH_REMOVE_INVALID)
+		{
+			return ((flags & PATH_DEMOTE_NETWORK) ?
+				STATUS_KEEP : STATUS_REMOVE);
+		}
+
+		Report(info, PATH_PROBLEM_SLOW, check);
+
+		return STATUS_ERROR;
+	}
+
+	/*
+	 * Make sure the path is accessible, and report it if required.
+	 */
+	if (info->error)
+	{
+		if (flags & PATH_REMOVE_INVALID)
+			return STATUS_REMOVE;
+
+		Report(info, PATH_PROBLEM_ERROR, check);
+
+		return STATUS_ERROR;
+	}
+
+	/*
+	 * If files are not allowed then make sure the path is a directory.
+	 * If not, then report it if required.
+	 */
+	if (!(flags & PATH_ALLOW_FILES) && !S_ISDIR(info->mode))
+	{
+		if (flags & PATH_REMOVE_INVALID)
+			return STATUS_REMOVE;
+
+		Report(info, PATH_PROBLEM_NOT_DIR, check);
+
+		return STATUS_ERROR;
+	}
+
+	/*
+	 * The absolute path is valid and should be kept.
+	 */
+	return STATUS_KEEP;
+}
+
+
+/*
+ * Report a problem with a path if there is a routine to do that.
+ */
+static void
+Report(const PATH_STAT * info, int problem, const PATH_CHECK * check)
+{
+	if (check->reportFunc != NULL)
+		check->reportFunc(check->reportData, info, problem, check);
+}
+
+
+/*
+ * Find the status of a table of paths.  When there are enough paths,
+ * they are all submitted at once to the kernel using io_uring if that
+ * is supported, and otherwise they are divided between several threads.
+ * Either way the results are stored into the table in the same order.
+ * Filesystem types are found if the check flags need them, and paths
+ * which do not respond within the time limit of the check are slow.
+ * The time taken for each path is also stored if the flags ask for it.
+ * The PATH_SERIAL flag finds them one at a time in the calling thread
+ * instead, such as inside another program, and cannot have a time limit.
+ */
+int
+PathStat(PATH_STAT * table, int count, const PATH_CHECK * check)
+{
+	STAT_PLACE *	places;
+	int		prefixFds[STAT_MAX_PREFIXES];
+	int		prefixCount;
+	BOOL		fsTypes;
+	BOOL		timeStat;
+	int		rootFd;
+	int		index;
+
+	if ((count < 0) || (check == NULL))
+		return PATH_ERR_ARGUMENT;
+
+	fsTypes = ((check->flags & (PATH_DEMOTE_NETWORK | PATH_FS_TYPES)) != 0);
+	timeStat = ((check->flags & PATH_TIME_STAT) != 0);
+	rootFd = -1;
+
+	if (check->flags & PATH_IN_ROOT)
+	{
+		if (check->rootFd < 0)
+			return PATH_ERR_ARGUMENT;
+
+		rootFd = check->rootFd;
+	}
+
+	/*
+	 * If there is a time limit, then threads are needed so that the
+	 * paths which do not respond can be abandoned.
+	 */
+	if ((check->flags & PATH_SERIAL) && (check->timeoutMs > 0))
+		return PATH_ERR_ARGUMENT;
+
+	if (check->timeoutMs > 0)
+	{
+		StatPathsTimed(table, count, fsTypes, timeStat, rootFd,
+			check->timeoutMs);
+
+		return PATH_OK;
+	}
+
+	if ((count < STAT_BATCH_MIN) || (check->flags & PATH_SERIAL))
+	{
+		for (index = 0; index < count; index++)
+			StatPath(&table[index], NULL, fsTypes, timeStat, rootFd);
+
+		return PATH_OK;
+	}
+
+	/*
+	 * Open the directories shared by the paths, unless the types of
+	 * their filesystems are wanted which looks up the whole paths
+	 * anyway, or the paths are within another root.
+	 */
+	places = NULL;
+	prefixCount = 0;
+
+	if (!fsTypes && (rootFd < 0))
+		places = SharePrefixes(table, count, prefixFds, &prefixCount);
+
+	/*
+	 * The io_uring method cannot find filesystem types or find paths
+	 * within another root, so only use it if those are not wanted.
+	 */
+#if defined(HAVE_IO_URING)
+	if (fsTypes || (rootFd >= 0) ||
+		!StatPathsUring(table, places, count, timeStat))
+	{
+		StatPathsThreaded(table, places, count, fsTypes, timeStat,
+			rootFd);
+	}
+#else
+	StatPathsThreaded(table, places, count, fsTypes, timeStat, rootFd);
+#endif
+
+	while (prefixCount > 0)
+		close(prefixFds[--prefixCount]);
+
+	free(places);
+
+	return PATH_OK;
+}
+
+
+/*
+ * Open the directories which are shared by more than one of a table of
+ * paths, and find where the status of each path is to be found from.
+ * The paths are sorted so that those beneath each directory are together,
+ * and the longest directory which each path shares with the next one is
+ * opened relative to the deepest one already open for it, together with
+ * the directory it shares with the paths after those if that is deeper.
+ * A directory which cannot be opened gives its error to all of the paths
+ * beneath it without looking them up.  The opened directories are stored
+ * in the table of descriptors, which the caller closes when done.
+ * Returns the table of places in the order of the paths, or NULL if no
+ * directories are shared or there is not enough memory.
+ */
+static STAT_PLACE *
+SharePrefixes(PATH_STAT * table, int count, int * prefixFds,
+	int * prefixCountPtr)
+{
+	STAT_PREFIX	stack[STAT_MAX_PREFIXES + 1];
+	STAT_PLACE *	places;
+	STAT_PLACE *	place;
+	PATH_STAT **	sorted;
+	size_t *	shared;
+	const char *	path;
+	size_t		outer;
+	int		depth;
+	int		index;
+	int		next;
+	BOOL		found;
+
+	*prefixCountPtr = 0;
+
+	sorted = (PATH_STAT **) malloc(sizeof(PATH_STAT *) * count);
+	shared = (size_t *) malloc(sizeof(size_t) * count);
+
+	if ((sorted == NULL) || (shared == NULL))
+	{
+		free(sorted);
+		free(shared);
+
+		return NULL;
+	}
+
+	for (index = 0; index < count; index++)
+		sorted[index] = &table[index];
+
+	qsort(sorted, count, sizeof(PATH_STAT *), PathSortCallback);
+
+	/*
+	 * Find the length of the directory each path shares with the next.
+	 */
+	found = FALSE;
+
+	for (index = 0; index < count; index++)
+	{
+		shared[index] = 0;
+
+		if (index + 1 < count)
+		{
+			shared[index] = SharedDirLength(sorted[index]->path,
+				sorted[index + 1]->path);
+		}
+
+		if (shared[index] > 0)
+			found = TRUE;
+	}
+
+	places = NULL;
+
+	if (found)
+		places = (STAT_PLACE *) malloc(sizeof(STAT_PLACE) * count);
+
+	if (places == NULL)
+	{
+		free(sorted);
+		free(shared);
+
+		return NULL;
+	}
+
+	/*
+	 * Walk the sorted paths keeping a stack of the open directories
+	 * which are prefixes of the current path.
+	 */
+	stack[0].path = "";
+	stack[0].length = 0;
+	stack[0].fd = AT_FDCWD;
+	stack[0].error = 0;
+	depth = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		path = sorted[index]->path;
+
+		while ((depth > 0) && (strncmp(path, stack[depth].path,
+			stack[depth].length) != 0))
+		{
+			depth--;
+		}
+
+		if (shared[index] > stack[depth].length)
+		{
+			/*
+			 * Find the directory shared with the paths following
+			 * those which share the deeper one.
+			 */
+			outer = 0;
+
+			for (next = index + 1; next < count; next++)
+			{
+				if (shared[next] < shared[index])
+				{
+					outer = shared[next];
+
+					break;
+				}
+			}
+
+			if (outer > stack[depth].length)
+			{
+				OpenPrefix(stack, &depth, path, outer, prefixFds,
+					prefixCountPtr);
+			}
+
+			OpenPrefix(stack, &depth, path, shared[index], prefixFds,
+				prefixCountPtr);
+		}
+
+		place = &places[sorted[index] - table];
+		place->fd = stack[depth].fd;
+		place->name = path + stack[depth].length;
+		place->error = stack[depth].error;
+	}
+
+	free(sorted);
+	free(shared);
+
+	return places;
+}
+
+
+/*
+ * Return the length of the longest directory which is a prefix of both
+ * paths, including its final slash, if both paths have more components
+ * after it.  The root directory itself is not counted as shared.
+ */
+static size_t
+SharedDirLength(const char * path1, const char * path2)
+{
+	size_t	length;
+	size_t	last;
+
+	last = 0;
+
+	for (length = 0; path1[length] && (path1[length] == path2[length]);
+		length++)
+	{
+		if ((path1[length] == ROOT_CHARACTER) && (length > 0) &&
+			(path1[length - 1] != ROOT_CHARACTER) &&
+			path1[length + 1] && path2[length + 1] &&
+			(path1[length + 1] != ROOT_CHARACTER) &&
+			(path2[length + 1] != ROOT_CHARACTER))
+		{
+			last = length + 1;
+		}
+	}
+
+	return last;
+}
+
+
+/*
+ * Open a directory which is a prefix of a path relative to the deepest
+ * directory on the stack, and push it onto the stack.  If that directory
+ * could not be opened then the new one gets the same error.  Nothing is
+ * done if too many directories are already open.
+ */
+static void
+OpenPrefix(STAT_PREFIX * stack, int * depthPtr, const char * path,
+	size_t length, int * prefixFds, int * prefixCountPtr)
+{
+	STAT_PREFIX *	parent;
+	STAT_PREFIX *	prefix;
+	char		name[PATH_MAX];
+	size_t		nameLength;
+
+	parent = &stack[*depthPtr];
+	nameLength = length - parent->length;
+
+	if ((*prefixCountPtr >= STAT_MAX_PREFIXES) ||
+		(*depthPtr >= STAT_MAX_PREFIXES) || (nameLength >= PATH_MAX))
+	{
+		return;
+	}
+
+	prefix = &stack[++*depthPtr];
+	prefix->path = path;
+	prefix->length = length;
+	prefix->fd = -1;
+	prefix->error = parent->error;
+
+	if (prefix->error)
+		return;
+
+	memcpy(name, path + parent->length, nameLength);
+	name[nameLength] = '\0';
+
+	prefix->fd = openat(parent->fd, name, ROOT_OPEN_FLAGS | O_DIRECTORY);
+
+	if (prefix->fd < 0)
+	{
+		prefix->error = errno;
+
+		return;
+	}
+
+	prefixFds[(*prefixCountPtr)++] = prefix->fd;
+}
+
+
+/*
+ * Function called by qsort to compare the path names of two results.
+ */
+static int
+PathSortCallback(const void * addr1, const void * addr2)
+{
+	return strcmp((*(const PATH_STAT **) addr1)->path,
+		(*(const PATH_STAT **) addr2)->path);
+}
+
+
+/*
+ * Find the status of a single path and store the result.
+ * The type of its filesystem is also found if that is needed,
+ * and the time taken if that is wanted.  If the path is beneath a shared
+ * directory, then it is found relative to that.  If there is a root
+ * directory, then the path is found within it as if it was the root.
+ */
+static void
+StatPath(PATH_STAT * info, const STAT_PLACE * place, BOOL fsTypes,
+	BOOL timeStat, int rootFd)
+{
+	struct	stat	statbuf;
+	struct	timespec	start;
+	int		fd;
+	int		result;
+
+	info->slow = FALSE;
+	info->fsType = NULL;
+	info->statNs = 0;
+
+	if (timeStat)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	fd = -1;
+
+	if ((place != NULL) && place->error)
+	{
+		errno = place->error;
+		result = -1;
+	}
+	else if (place != NULL)
+		result = fstatat(place->fd, place->name, &statbuf, 0);
+	else if (rootFd >= 0)
+	{
+		fd = OpenInRoot(rootFd, info->path);
+		result = ((fd < 0) ? -1 : fstat(fd, &statbuf));
+	}
+	else
+		result = stat(info->path, &statbuf);
+
+	if (result < 0)
+	{
+		info->error = errno;
+		info->mode = 0;
+	}
+	else
+	{
+		info->error = 0;
+		info->mode = statbuf.st_mode;
+		info->dev = statbuf.st_dev;
+		info->ino = statbuf.st_ino;
+		info->mtime = statbuf.st_mtim;
+		info->ctime = statbuf.st_ctim;
+
+		if (fsTypes)
+			info->fsType = FindFsType(info->path, fd);
+	}
+
+	if (fd >= 0)
+		close(fd);
+
+	if (timeStat)
+		info->statNs = ElapsedNs(&start);
+}
+
+
+/*
+ * Open a path within a root directory for finding its status, as if the
+ * process had been chrooted to it, so that neither symbolic links nor
+ * ".." can lead outside of it.  The kernel does this itself using openat2
+ * where that is available, and otherwise the path is walked one component
+ * at a time.  Returns the file descriptor, or -1 with errno set.
+ */
+static int
+OpenInRoot(int rootFd, const char * path)
+{
+#if defined(HAVE_OPENAT2) && defined(SYS_openat2)
+	struct	open_how	how;
+	int		fd;
+
+	memset(&how, 0, sizeof(how));
+	how.flags = O_PATH | O_CLOEXEC;
+	how.resolve = RESOLVE_IN_ROOT | RESOLVE_NO_MAGICLINKS;
+
+	fd = syscall(SYS_openat2, rootFd, path, &how, sizeof(how));
+
+	if ((fd >= 0) || ((errno != ENOSYS) && (errno != EPERM)))
+		return fd;
+#endif
+
+	return WalkInRoot(rootFd, path);
+}
+
+
+/*
+ * Open a path within a root directory by walking it one component at a
+ * time without following symbolic links, and instead reading them and
+ * walking their contents, starting again from the root for absolute ones.
+ * A ".." component at the root stays at the root.
+ * Returns the file descriptor, or -1 with errno set.
+ */
+static int
+WalkInRoot(int rootFd, const char * path)
+{
+	struct	stat	rootbuf;
+	struct	stat	statbuf;
+	char		rest[PATH_MAX];
+	char		link[PATH_MAX];
+	char		name[PATH_MAX];
+	const char *	cp;
+	int		fd;
+	int		next;
+	int		length;
+	int		linkCount;
+	int		error;
+
+	if (strlen(path) >= sizeof(rest))
+	{
+		errno = ENAMETOOLONG;
+
+		return -1;
+	}
+
+	strcpy(rest, path);
+
+	if ((fstat(rootFd, &rootbuf) < 0) ||
+		((fd = openat(rootFd, ".", ROOT_OPEN_FLAGS)) < 0))
+	{
+		return -1;
+	}
+
+	cp = rest;
+	linkCount = 0;
+
+	for (;;)
+	{
+		while (*cp == ROOT_CHARACTER)
+			cp++;
+
+		if (*cp == '\0')
+			return fd;
+
+		length = 0;
+
+		while (*cp && (*cp != ROOT_CHARACTER))
+			name[length++] = *cp++;
+
+		name[length] = '\0';
+
+		if (strcmp(name, ".") == 0)
+			continue;
+
+		/*
+		 * Going up from the root stays at the root.
+		 */
+		if (strcmp(name, "..") == 0)
+		{
+			if ((fstat(fd, &statbuf) == 0) &&
+				(statbuf.st_dev == rootbuf.st_dev) &&
+				(statbuf.st_ino == rootbuf.st_ino))
+			{
+				continue;
+			}
+		}
+		else if (fstatat(fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) < 0)
+			break;
+		else if (S_ISLNK(statbuf.st_mode))
+		{
+			/*
+			 * Replace the link by its contents followed by the
+			 * rest of the path, and start again from the root
+			 * if the contents are absolute.
+			 */
+			length = readlinkat(fd, name, link, sizeof(link));
+
+			if (++linkCount > ROOT_MAX_LINKS)
+			{
+				errno = ELOOP;
+
+				break;
+			}
+
+			if ((length < 0) ||
+				(length + strlen(cp) + 2 > sizeof(rest)))
+			{
+				if (length >= 0)
+					errno = ENAMETOOLONG;
+
+				break;
+			}
+
+			link[length] = ROOT_CHARACTER;
+			strcpy(link + length + 1, cp);
+			strcpy(rest, link);
+			cp = rest;
+
+			if (*cp == ROOT_CHARACTER)
+			{
+				next = openat(rootFd, ".", ROOT_OPEN_FLAGS);
+
+				if (next < 0)
+					break;
+
+				close(fd);
+				fd = next;
+			}
+
+			continue;
+		}
+
+		next = openat(fd, name, ROOT_OPEN_FLAGS | O_NOFOLLOW);
+
+		if (next < 0)
+			break;
+
+		close(fd);
+		fd = next;
+	}
+
+	error = errno;
+	close(fd);
+	errno = error;
+
+	return -1;
+}
+
+
+/*
+ * Return the number of nanoseconds since the specified time.
+ */
+static long
+ElapsedNs(const struct timespec * start)
+{
+	struct	timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000000000L +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+
+/*
+ * Find the type of the filesystem containing a path, using the file
+ * descriptor for it instead if that is not negative.
+ * Returns NULL if the type is not known.
+ */
+static const PATH_FS_TYPE *
+FindFsType(const char * path, int fd)
+{
+#if defined(__linux__)
+	struct	statfs	statfsbuf;
+	const PATH_FS_TYPE *	fsType;
+
+	if (((fd >= 0) ? fstatfs(fd, &statfsbuf) : statfs(path, &statfsbuf)) < 0)
+		return NULL;
+
+	for (fsType = fsTypeTable; fsType->name; fsType++)
+	{
+		if ((unsigned int) fsType->type ==
+			(unsigned int) statfsbuf.f_type)
+		{
+			return fsType;
+		}
+	}
+#endif
+
+	return NULL;
+}
+
+/*
+ * Return the table of filesystem types which can be reported.
+ * The table ends with an entry whose name is NULL.
+ */
+const PATH_FS_TYPE *
+PathFsTypes(void)
+{
+	return fsTypeTable;
+}
+
+
+/*
+ * Find the status of a table of paths using a small pool of threads.
+ * The calling thread also does its share of the work, so that all of
+ * the paths still get done if no threads can be created.
+ */
+static void
+StatPathsThreaded(PATH_STAT * table, const STAT_PLACE * places, int count,
+	BOOL fsTypes, BOOL timeStat, int rootFd)
+{
+	STAT_BATCH	batch;
+	pthread_t	threads[STAT_MAX_WORKERS];
+	int		threadCount;
+
+	batch.table = table;
+	batch.places = places;
+	batch.count = count;
+	batch.next = 0;
+	batch.doneCount = 0;
+	batch.users = 0;
+	batch.fsTypes = fsTypes;
+	batch.timeStat = timeStat;
+	batch.rootFd = rootFd;
+	batch.timed = FALSE;
+	batch.expired = FALSE;
+
+	for (threadCount = 0; (threadCount < STAT_MAX_WORKERS) &&
+		(threadCount < count - 1); threadCount++)
+	{
+		if (pthread_create(&threads[threadCount], NULL,
+			StatWorker, &batch) != 0)
+		{
+			break;
+		}
+	}
+
+	StatWorker(&batch);
+
+	while (threadCount-- > 0)
+		pthread_join(threads[threadCount], NULL);
+}
+
+
+/*
+ * Find the status of a table of paths using one thread for each path
+ * (up to a limit), waiting at most the time limit for all of them.
+ * Paths which have not responded by then are marked as being slow.
+ * The threads work on a copy of the paths and of the root directory,
+ * and those which are still waiting for them are left running and free
+ * the copies when they finish.
+ */
+static void
+StatPathsTimed(PATH_STAT * table, int count, BOOL fsTypes, BOOL timeStat,
+	int rootFd, int timeoutMs)
+{
+	STAT_BATCH *		batch;
+	pthread_attr_t		attr;
+	pthread_condattr_t	condAttr;
+	pthread_t		thread;
+	struct	timespec	deadline;
+	char *			names;
+	size_t			namesSize;
+	size_t			length;
+	int			threadCount;
+	int			index;
+
+	/*
+	 * Allocate the batch together with its copy of the table and
+	 * of the path names.
+	 */
+	namesSize = 0;
+
+	for (index = 0; index < count; index++)
+		namesSize += strlen(table[index].path) + 1;
+
+	batch = (STAT_BATCH *) malloc(sizeof(STAT_BATCH) +
+		sizeof(PATH_STAT) * count + namesSize);
+
+	if (batch == NULL)
+	{
+		StatPathsThreaded(table, NULL, count, fsTypes, timeStat,
+			rootFd);
+
+		return;
+	}
+
+	batch->table = (PATH_STAT *) (batch + 1);
+	batch->places = NULL;
+	batch->count = count;
+	batch->next = 0;
+	batch->doneCount = 0;
+	batch->users = 1;
+	batch->fsTypes = fsTypes;
+	batch->timeStat = timeStat;
+	batch->rootFd = -1;
+	batch->timed = TRUE;
+	batch->expired = FALSE;
+
+	if (rootFd >= 0)
+	{
+		batch->rootFd = fcntl(rootFd, F_DUPFD_CLOEXEC, 0);
+
+		if (batch->rootFd < 0)
+		{
+			free(batch);
+			StatPathsThreaded(table, NULL, count, fsTypes,
+				timeStat, rootFd);
+
+			return;
+		}
+	}
+
+	names = (char *) (batch->table + count);
+
+	for (index = 0; index < count; index++)
+	{
+		length = strlen(table[index].path) + 1;
+		memcpy(names, table[index].path, length);
+
+		memset(&batch->table[index], 0, sizeof(PATH_STAT));
+		batch->table[index].path = names;
+		batch->table[index].slow = TRUE;
+		names += length;
+	}
+
+	pthread_mutex_init(&batch->lock, NULL);
+	pthread_condattr_init(&condAttr);
+	pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+	pthread_cond_init(&batch->doneCond, &condAttr);
+	pthread_condattr_destroy(&condAttr);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (threadCount = 0; (threadCount < STAT_MAX_TIMED_WORKERS) &&
+		(threadCount < count); threadCount++)
+	{
+		pthread_mutex_lock(&batch->lock);
+		batch->users++;
+		pthread_mutex_unlock(&batch->lock);
+
+		if (pthread_create(&thread, &attr, StatWorker, batch) != 0)
+		{
+			pthread_mutex_lock(&batch->lock);
+			batch->users--;
+			pthread_mutex_unlock(&batch->lock);
+
+			break;
+		}
+	}
+
+	pthread_attr_destroy(&attr);
+
+	/*
+	 * If no threads could be created at all, then there is nothing
+	 * which can be timed, so just do the paths here.
+	 */
+	if (threadCount == 0)
+	{
+		ReleaseBatch(batch);
+		StatPathsThreaded(table, NULL, count, fsTypes, timeStat,
+			rootFd);
+
+		return;
+	}
+
+	/*
+	 * Wait for all of the paths to be done or for the time limit.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+	deadline.tv_sec += timeoutMs / 1000;
+	deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000;
+
+	if (deadline.tv_nsec >= 1000000000)
+	{
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&batch->lock);
+
+	while (batch->doneCount < count)
+	{
+		if (pthread_cond_timedwait(&batch->doneCond, &batch->lock,
+			&deadline) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+
+	/*
+	 * Copy the results which were found back into the caller's table,
+	 * keeping the caller's path names.  The paths which did not respond
+	 * took at least the time limit.
+	 */
+	batch->expired = TRUE;
+
+	for (index = 0; index < count; index++)
+	{
+		table[index].slow = batch->table[index].slow;
+		table[index].statNs = batch->table[index].statNs;
+
+		if (table[index].slow)
+		{
+			if (timeStat)
+				table[index].statNs = timeoutMs * 1000000L;
+
+			continue;
+		}
+
+		table[index].error = batch->table[index].error;
+		table[index].mode = batch->table[index].mode;
+		table[index].dev = batch->table[index].dev;
+		table[index].ino = batch->table[index].ino;
+		table[index].mtime = batch->table[index].mtime;
+		table[index].ctime = batch->table[index].ctime;
+		table[index].fsType = batch->table[index].fsType;
+	}
+
+	pthread_mutex_unlock(&batch->lock);
+
+	ReleaseBatch(batch);
+}
+
+
+/*
+ * Let go of a timed batch, freeing it if nothing else is using it.
+ */
+static void
+ReleaseBatch(STAT_BATCH * batch)
+{
+	int	users;
+
+	pthread_mutex_lock(&batch->lock);
+	users = --batch->users;
+	pthread_mutex_unlock(&batch->lock);
+
+	if (users > 0)
+		return;
+
+	if (batch->rootFd >= 0)
+		close(batch->rootFd);
+
+	pthread_cond_destroy(&batch->doneCond);
+	pthread_mutex_destroy(&batch->lock);
+	free(batch);
+}
+
+
+/*
+ * Thread routine which finds the status of paths from a batch
+ * until there are none left.  When the batch is timed, the result is
+ * found into a local copy and only stored if the batch has not expired,
+ * and no more paths are taken once it has, so that threads which are
+ * left behind do not go on to wait for other paths which do not respond.
+ */
+static void *
+StatWorker(void * arg)
+{
+	STAT_BATCH *	batch;
+	PATH_STAT	info;
+	BOOL		expired;
+	int		index;
+
+	batch = (STAT_BATCH *) arg;
+
+	for (;;)
+	{
+		if (batch->timed)
+		{
+			pthread_mutex_lock(&batch->lock);
+			expired = batch->expired;
+			pthread_mutex_unlock(&batch->lock);
+
+			if (expired)
+				break;
+		}
+
+		index = __sync_fetch_and_add(&batch->next, 1);
+
+		if (index >= batch->count)
+			break;
+
+		if (!batch->timed)
+		{
+			StatPath(&batch->table[index], batch->places ?
+				&batch->places[index] : NULL, batch->fsTypes,
+				batch->timeStat, batch->rootFd);
+
+			continue;
+		}
+
+		info.path = batch->table[index].path;
+
+		StatPath(&info, NULL, batch->fsTypes, batch->timeStat,
+			batch->rootFd);
+
+		pthread_mutex_lock(&batch->lock);
+
+		if (!batch->expired)
+		{
+			batch->table[index] = info;
+			batch->doneCount++;
+
+			if (batch->doneCount == batch->count)
+				pthread_cond_signal(&batch->doneCond);
+		}
+
+		pthread_mutex_unlock(&batch->lock);
+	}
+
+	if (batch->timed)
+		ReleaseBatch(batch);
+
+	return NULL;
+}
+
+
+#if defined(HAVE_IO_URING)
+
+/*
+ * Find the status of a table of paths by submitting statx requests for
+ * all of them to an io_uring, which lets the kernel work on them in
+ * parallel.  The time taken for a path is from when its request is
+ * queued until its completion is seen, if that is wanted.  Paths beneath
+ * shared directories are found relative to them.
+ * Returns FALSE without any results if io_uring or its statx
+ * operation is not available, so that another method can be used.
+ */
+static BOOL
+StatPathsUring(PATH_STAT * table, const STAT_PLACE * places, int count,
+	BOOL timeStat)
+{
+	struct	io_uring_params	params;
+	struct	io_uring_probe *	probe;
+	struct	io_uring_sqe *	sqes;
+	struct	io_uring_sqe *	sqe;
+	struct	io_uring_cqe *	cqes;
+	struct	io_uring_cqe *	cqe;
+	struct	statx *		statxTable;
+	struct	timespec *	startTable;
+	char *		sqRing;
+	char *		cqRing;
+	size_t		sqRingSize;
+	size_t		cqRingSize;
+	size_t		sqesSize;
+	unsigned int	sqMask;
+	unsigned int	cqMask;
+	unsigned int	tail;
+	unsigned int	head;
+	long		result;
+	int		ringFd;
+	int		next;
+	int		done;
+	int		toSubmit;
+	int		inFlight;
+	int		index;
+	BOOL		supported;
+
+	memset(&params, 0, sizeof(params));
+
+	ringFd = syscall(__NR_io_uring_setup,
+		(count < STAT_RING_SIZE) ? count : STAT_RING_SIZE, &params);
+
+	if (ringFd < 0)
+		return FALSE;
+
+	/*
+	 * Make sure that the kernel supports the statx operation.
+	 */
+	probe = (struct io_uring_probe *) calloc(1, sizeof(*probe) +
+		256 * sizeof(struct io_uring_probe_op));
+
+	supported = (probe != NULL) &&
+		(syscall(__NR_io_uring_register, ringFd,
+			IORING_REGISTER_PROBE, probe, 256) >= 0) &&
+		(probe->last_op >= IORING_OP_STATX) &&
+		(probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+
+	free(probe);
+
+	statxTable = (struct statx *) malloc(sizeof(struct statx) * count);
+	startTable = NULL;
+
+	if (timeStat)
+	{
+		startTable = (struct timespec *)
+			malloc(sizeof(struct timespec) * count);
+	}
+
+	if (!supported || (statxTable == NULL) ||
+		(timeStat && (startTable == NULL)))
+	{
+		free(statxTable);
+		free(startTable);
+		close(ringFd);
+
+		return FALSE;
+	}
+
+	/*
+	 * Map the submission and completion rings and the submission entries.
+	 */
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+
+	cqRing = mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+
+	sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+	if ((sqRing == MAP_FAILED) || (cqRing == MAP_FAILED) ||
+		(sqes == MAP_FAILED))
+	{
+		if (sqRing != MAP_FAILED)
+			munmap(sqRing, sqRingSize);
+
+		if (cqRing != MAP_FAILED)
+			munmap(cqRing, cqRingSize);
+
+		if (sqes != MAP_FAILED)
+			munmap(sqes, sqesSize);
+
+		free(statxTable);
+		free(startTable);
+		close(ringFd);
+
+		return FALSE;
+	}
+
+	sqMask = *(unsigned int *) (sqRing + params.sq_off.ring_mask);
+	cqMask = *(unsigned int *) (cqRing + params.cq_off.ring_mask);
+	cqes = (struct io_uring_cqe *) (cqRing + params.cq_off.cqes);
+
+	/*
+	 * Keep the submission ring as full as possible until all of the
+	 * paths have been submitted, and collect the completions as they
+	 * arrive.  The index of each path is carried in its request.
+	 */
+	next = 0;
+	done = 0;
+	inFlight = 0;
+	toSubmit = 0;
+
+	while (done < count)
+	{
+		tail = *(unsigned int *) (sqRing + params.sq_off.tail);
+
+		while ((next < count) && (inFlight < (int) params.sq_entries))
+		{
+			/*
+			 * Paths beneath a shared directory which could not
+			 * be opened already have their result.
+			 */
+			if (places && places[next].error)
+			{
+				table[next].error = places[next].error;
+				table[next].mode = 0;
+				table[next].slow = FALSE;
+				table[next].fsType = NULL;
+				table[next].statNs = 0;
+				next++;
+				done++;
+
+				continue;
+			}
+
+			index = tail & sqMask;
+			sqe = &sqes[index];
+
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = AT_FDCWD;
+			sqe->addr = (uintptr_t) table[next].path;
+
+			if (places)
+			{
+				sqe->fd = places[next].fd;
+				sqe->addr = (uintptr_t) places[next].name;
+			}
+
+			sqe->len = STATX_TYPE | STATX_MODE | STATX_INO |
+				STATX_MTIME | STATX_CTIME;
+			sqe->off = (uintptr_t) &statxTable[next];
+			sqe->user_data = next;
+
+			((unsigned int *) (sqRing + params.sq_off.array))[index] = index;
+
+			if (timeStat)
+				clock_gettime(CLOCK_MONOTONIC, &startTable[next]);
+
+			tail++;
+			next++;
+			toSubmit++;
+			inFlight++;
+		}
+
+		__atomic_store_n((unsigned int *) (sqRing + params.sq_off.tail),
+			tail, __ATOMIC_RELEASE);
+
+		if (inFlight == 0)
+			continue;
+
+		result = syscall(__NR_io_uring_enter, ringFd, toSubmit, 1,
+			IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if (result < 0)
+		{
+			if ((errno == EINTR) || (errno == EAGAIN) ||
+				(errno == EBUSY))
+			{
+				continue;
+			}
+
+			/*
+			 * Requests may still be in progress which refer
+			 * to the statx buffers, so they are not freed.
+			 * The ring is closed and all of the paths are
+			 * done again by another method.
+			 */
+			munmap(sqRing, sqRingSize);
+			munmap(cqRing, cqRingSize);
+			munmap(sqes, sqesSize);
+			close(ringFd);
+
+			return FALSE;
+		}
+
+		toSubmit -= result;
+
+		head = *(unsigned int *) (cqRing + params.cq_off.head);
+		tail = __atomic_load_n((unsigned int *) (cqRing + params.cq_off.tail),
+			__ATOMIC_ACQUIRE);
+
+		while (head != tail)
+		{
+			cqe = &cqes[head & cqMask];
+			index = (int) cqe->user_data;
+
+			if (cqe->res < 0)
+			{
+				table[index].error = -cqe->res;
+				table[index].mode = 0;
+			}
+			else
+			{
+				table[index].error = 0;
+				table[index].mode = statxTable[index].stx_mode;
+				table[index].dev = makedev(
+					statxTable[index].stx_dev_major,
+					statxTable[index].stx_dev_minor);
+				table[index].ino = statxTable[index].stx_ino;
+				table[index].mtime.tv_sec =
+					statxTable[index].stx_mtime.tv_sec;
+				table[index].mtime.tv_nsec =
+					statxTable[index].stx_mtime.tv_nsec;
+				table[index].ctime.tv_sec =
+					statxTable[index].stx_ctime.tv_sec;
+				table[index].ctime.tv_nsec =
+					statxTable[index].stx_ctime.tv_nsec;
+			}
+
+			table[index].slow = FALSE;
+			table[index].fsType = NULL;
+			table[index].statNs = 0;
+
+			if (timeStat)
+				table[index].statNs = ElapsedNs(&startTable[index]);
+
+			head++;
+			done++;
+			inFlight--;
+		}
+
+		__atomic_store_n((unsigned int *) (cqRing + params.cq_off.head),
+			head, __ATOMIC_RELEASE);
+	}
+
+	munmap(sqRing, sqRingSize);
+	munmap(cqRing, cqRingSize);
+	munmap(sqes, sqesSize);
+	close(ringFd);
+	free(statxTable);
+	free(startTable);
+
+	return TRUE;
+}
+#endif
+
+
+/*
+ * Return a description of a status code.
+ */
+const char *
+PathErrorString(int status)
+{
+	switch (status)
+	{
+		case PATH_OK:
+			return "Success";
+
+		case PATH_ERR_MEMORY:
+			return "Cannot allocate memory";
+
+		case PATH_ERR_ARGUMENT:
+			return "Invalid argument";
+
+		case PATH_ERR_INVALID:
+			return "Invalid paths were found";
+
+		case PATH_ERR_SPACE:
+			return "Buffer is too small";
+
+		default:
+			return "Unknown error";
+	}
+}
+
+
+/*
+ * Find the entry in the set of paths for the specified path name,
+ * given the hash value of the path.  Returns NULL if it is not present.
+ */
+static PATH_ENTRY *
+FindPath(PATH_CONTEXT * context, const char * path, unsigned int hash)
+{
+	PATH_ENTRY *	entry;
+
+	context->stats.lookups++;
+
+	entry = context->hashTable[hash & (context->hashSize - 1)];
+
+	while (entry != NULL)
+	{
+		if (entry->hash == hash)
+		{
+			context->stats.compares++;
+
+			if (strcmp(entry->name, path) == 0)
+				return entry;
+		}
+
+		entry = entry->hashNext;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Add a copy of the specified path to the end or the front of the set of
+ * paths if it is not already present.
+ */
+static int
+AddPath(PATH_CONTEXT * context, const char * path, BOOL atFront)
+{
+	return AddHashedPath(context, path, HashPath(path), atFront, TRUE);
+}
+
+
+/*
+ * Add the specified path whose hash value is already known to the end
+ * or the front of the set of paths if it is not already present.
+ * The path is copied if required, otherwise it must stay valid.
+ */
+static int
+AddHashedPath(PATH_CONTEXT * context, const char * path, unsigned int hash,
+	BOOL atFront, BOOL copy)
+{
+	PATH_ENTRY *	entry;
+	PATH_ENTRY **	chain;
+	PATH_ENTRY *	head;
+	size_t		length;
+	int		status;
+
+	if (FindPath(context, path, hash) != NULL)
+		return PATH_OK;
+
+	/*
+	 * Keep the hash chains short by growing the hash table
+	 * whenever it would become more than fully loaded.
+	 */
+	if ((unsigned int) context->count >= context->hashSize)
+	{
+		status = GrowHashTable(context);
+
+		if (status != PATH_OK)
+			return status;
+	}
+
+	/*
+	 * Get a new entry, reusing a removed one if possible.
+	 */
+	entry = context->freeEntries;
+
+	if (entry != NULL)
+		context->freeEntries = entry->hashNext;
+	else
+		entry = (PATH_ENTRY *) Allocate(context, sizeof(PATH_ENTRY));
+
+	if (entry == NULL)
+		return PATH_ERR_MEMORY;
+
+	entry->name = path;
+	entry->copy = NULL;
+	entry->hash = hash;
+
+	if (copy)
+	{
+		length = strlen(path) + 1;
+		entry->copy = (char *) Allocate(context, length);
+
+		if (entry->copy == NULL)
+		{
+			entry->hashNext = context->freeEntries;
+			context->freeEntries = entry;
+
+			return PATH_ERR_MEMORY;
+		}
+
+		memcpy(entry->copy, path, length);
+		entry->name = entry->copy;
+		context->stats.bytesCopied += length;
+	}
+
+	/*
+	 * Link the entry into its hash chain and into the list.
+	 */
+	chain = &context->hashTable[hash & (context->hashSize - 1)];
+	entry->hashNext = *chain;
+	*chain = entry;
+
+	head = &context->head;
+
+	if (atFront)
+	{
+		entry->prev = head;
+		entry->next = head->next;
+	}
+	else
+	{
+		entry->prev = head->prev;
+		entry->next = head;
+	}
+
+	entry->prev->next = entry;
+	entry->next->prev = entry;
+	context->count++;
+
+	return PATH_OK;
+}
+
+
+/*
+ * Unlink an entry from the list and its hash chain and free it.
+ */
+static void
+RemoveEntry(PATH_CONTEXT * context, PATH_ENTRY * entry)
+{
+	PATH_ENTRY **	chain;
+
+	chain = &context->hashTable[entry->hash & (context->hashSize - 1)];
+
+	while (*chain != entry)
+		chain = &(*chain)->hashNext;
+
+	*chain = entry->hashNext;
+
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	context->count--;
+
+	if (entry->copy != NULL)
+	{
+		Release(context, entry->copy, strlen(entry->copy) + 1);
+		entry->copy = NULL;
+	}
+
+	entry->hashNext = context->freeEntries;
+	context->freeEntries = entry;
+}
+
+
+/*
+ * Move an entry within the list so that it is just before another entry.
+ * Giving the head of the list as the other entry moves it to the end.
+ */
+static void
+MoveEntry(PATH_ENTRY * entry, PATH_ENTRY * before)
+{
+	if (entry == before)
+		return;
+
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+
+	entry->prev = before->prev;
+	entry->next = before;
+
+	entry->prev->next = entry;
+	entry->next->prev = entry;
+}
+
+
+/*
+ * Double the size of the hash table and rechain all of the entries.
+ */
+static int
+GrowHashTable(PATH_CONTEXT * context)
+{
+	PATH_ENTRY **	newTable;
+	PATH_ENTRY **	chain;
+	PATH_ENTRY *	entry;
+	unsigned int	newSize;
+
+	newSize = context->hashSize * 2;
+	newTable = (PATH_ENTRY **) Allocate(context,
+		sizeof(PATH_ENTRY *) * newSize);
+
+	if (newTable == NULL)
+		return PATH_ERR_MEMORY;
+
+	memset(newTable, 0, sizeof(PATH_ENTRY *) * newSize);
+
+	for (entry = context->head.next; entry != &context->head;
+		entry = entry->next)
+	{
+		chain = &newTable[entry->hash & (newSize - 1)];
+		entry->hashNext = *chain;
+		*chain = entry;
+	}
+
+	Release(context, context->hashTable,
+		sizeof(PATH_ENTRY *) * context->hashSize);
+
+	context->hashTable = newTable;
+	context->hashSize = newSize;
+	context->stats.hashGrowths++;
+
+	return PATH_OK;
+}
+
+
+/*
+ * Compute the hash value of a path name.
+ * This is the FNV-1a hash of the characters of the path.
+ */
+static unsigned int
+HashPath(const char * path)
+{
+	unsigned int	hash;
+
+	hash = HASH_BASIS;
+
+	while (*path)
+	{
+		hash ^= (unsigned char) *path++;
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+
+/*
+ * Allocate memory for a context using its allocator.
+ */
+static void *
+Allocate(PATH_CONTEXT * context, size_t size)
+{
+	return context->allocator.allocate(context->allocator.data, size);
+}
+
+
+/*
+ * Free memory for a context using its allocator.
+ */
+static void
+Release(PATH_CONTEXT * context, void * ptr, size_t size)
+{
+	context->allocator.release(context->allocator.data, ptr, size);
+}
+
+
+/*
+ * The default allocator routines, which use malloc and free.
+ */
+static void *
+DefaultAllocate(void * data, size_t size)
+{
+	return malloc(size);
+}
+
+
+static void
+DefaultRelease(void * data, void * ptr, size_t size)
+{
+	free(ptr);
+}
@@ -0,0 +1,228 @@
+/*
+ * Library to manipulate colon-separated path lists, as used by the
+ * path program.  A path list is held in a context, which is an ordered
+ * set of path names which never contains duplicates.  There is no global
+ * state, so that different threads can each use their own contexts at
+ * the same time.  Errors are returned as status codes and never exit.
+ *
+ * Copyright (c) 2000 David I. Bell
+ * Permission is granted to use, distribute, or modify this source,
+ * provided that this copyright notice remains intact.
+ */
+
+#ifndef	LIBPATH_H
+#define	LIBPATH_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Status codes returned by the library routines.
+ */
+#define	PATH_OK			0	/* success */
+#define	PATH_ERR_MEMORY		1	/* memory could not be allocated */
+#define	PATH_ERR_ARGUMENT	2	/* invalid argument */
+#define	PATH_ERR_INVALID	3	/* checked paths were invalid */
+#define	PATH_ERR_SPACE		4	/* buffer is too small */
+
+
+/*
+ * Actions which can be applied to a path.
+ */
+#define	PATH_ADD_AFTER		1	/* add after others if not present */
+#define	PATH_ADD_BEFORE		2	/* add before others if not present */
+#define	PATH_REMOVE		3	/* remove if present */
+#define	PATH_REMOVE_AFTER	4	/* remove and then add after others */
+#define	PATH_REMOVE_BEFORE	5	/* remove and then add before others */
+#define	PATH_MOVE_AFTER		6	/* move after others if present */
+#define	PATH_MOVE_BEFORE	7	/* move before others if present */
+
+
+/*
+ * Flags for how a context handles the paths given to it.
+ */
+#define	PATH_NORMALIZE		0x0001	/* normalize path names lexically */
+
+
+/*
+ * Flags for checking the paths in a path list.
+ */
+#define	PATH_CHECK_INVALID	0x0001	/* report invalid absolute paths */
+#define	PATH_REMOVE_INVALID	0x0002	/* remove invalid absolute paths */
+#define	PATH_CHECK_RELATIVE	0x0004	/* report relative paths */
+#define	PATH_REMOVE_RELATIVE	0x0008	/* remove relative paths */
+#define	PATH_ALLOW_FILES	0x0010	/* files are valid as well as dirs */
+#define	PATH_PLAIN_DOT		0x0020	/* DOT is like other relative paths */
+#define	PATH_DEMOTE_NETWORK	0x0040	/* move network paths to the end */
+#define	PATH_FS_TYPES		0x0080	/* report filesystem types */
+#define	PATH_TIME_STAT		0x0100	/* time finding each status */
+#define	PATH_REMOVE_ALIASES	0x0200	/* remove later paths to same dir */
+#define	PATH_REPORT_ALIASES	0x0400	/* report the paths removed as such */
+#define	PATH_IN_ROOT		0x0800	/* find paths within rootFd */
+#define	PATH_SERIAL		0x1000	/* stat only in calling thread */
+
+
+/*
+ * Problems with paths which are reported when checking them.
+ */
+#define	PATH_PROBLEM_RELATIVE	1	/* path is relative */
+#define	PATH_PROBLEM_SLOW	2	/* path did not respond in time */
+#define	PATH_PROBLEM_ERROR	3	/* path could not be found */
+#define	PATH_PROBLEM_NOT_DIR	4	/* path is not a directory */
+#define	PATH_PROBLEM_FS_TYPE	5	/* filesystem type of a valid path */
+#define	PATH_PROBLEM_ALIAS	6	/* path is same as an earlier one */
+
+
+/*
+ * A context holding a path list.
+ */
+typedef	struct	PATH_CONTEXT	PATH_CONTEXT;
+
+
+/*
+ * Routines used to allocate and free the memory owned by a context.
+ * The size of the memory is also given when it is freed.
+ * Memory used while checking paths which may still be in use by threads
+ * waiting for paths which did not respond in time comes from malloc.
+ */
+typedef	struct
+{
+	void *	(*allocate)(void * data, size_t size);
+	void	(*release)(void * data, void * ptr, size_t size);
+	void *	data;		/* data passed to the routines */
+} PATH_ALLOCATOR;
+
+
+/*
+ * A type of filesystem which can be reported.
+ */
+typedef	struct
+{
+	long		type;		/* magic number of filesystem type */
+	const char *	name;		/* name of filesystem type */
+	int		remote;		/* nonzero if network or user space */
+} PATH_FS_TYPE;
+
+
+/*
+ * The result of finding the status of a path being checked.
+ */
+typedef	struct
+{
+	const char *		path;	/* path name */
+	int			error;	/* error number, or zero if found */
+	mode_t			mode;	/* mode of the path if it was found */
+	int			slow;	/* path did not respond in time */
+	const PATH_FS_TYPE *	fsType;	/* filesystem type if it was found */
+	long			statNs;	/* nanoseconds taken if timed */
+	dev_t			dev;	/* device of the path if it was found */
+	ino_t			ino;	/* inode of the path if it was found */
+	const char *		aliasOf; /* earlier path with same identity */
+	struct timespec		mtime;	/* modification time if it was found */
+	struct timespec		ctime;	/* status change time if it was found */
+} PATH_STAT;
+
+
+typedef	struct	PATH_CHECK	PATH_CHECK;
+
+
+/*
+ * Routine to find the status of a table of paths, for use instead of
+ * PathStat, such as one which remembers the results.
+ */
+typedef	int	(*PATH_STAT_FUNC)(void * data, PATH_STAT * table, int count,
+			const PATH_CHECK * check);
+
+
+/*
+ * Routine called for each problem found when checking paths.
+ */
+typedef	void	(*PATH_REPORT_FUNC)(void * data, const PATH_STAT * stat,
+			int problem, const PATH_CHECK * check);
+
+
+/*
+ * How the paths in a path list are checked.
+ */
+struct	PATH_CHECK
+{
+	int			flags;		/* PATH_CHECK flags */
+	int			timeoutMs;	/* time limit or zero */
+	PATH_STAT_FUNC		statFunc;	/* stat routine or NULL */
+	void *			statData;	/* data for stat routine */
+	PATH_REPORT_FUNC	reportFunc;	/* report routine or NULL */
+	void *			reportData;	/* data for report routine */
+	int			rootFd;		/* root directory for PATH_IN_ROOT */
+};
+
+
+/*
+ * Counts of the work done by a context since it was created.
+ */
+typedef	struct
+{
+	long	lookups;	/* paths looked up in the hash table */
+	long	compares;	/* path names compared during lookups */
+	long	bytesCopied;	/* bytes of path names copied */
+	long	hashGrowths;	/* times the hash table was grown */
+} PATH_STATS;
+
+
+/*
+ * Creating and destroying contexts.
+ * A NULL allocator uses malloc and free.
+ */
+extern	int	PathCreate(const PATH_ALLOCATOR * allocator,
+			PATH_CONTEXT ** contextPtr);
+extern	void	PathDestroy(PATH_CONTEXT * context);
+extern	int	PathSetFlags(PATH_CONTEXT * context, int flags);
+
+
+/*
+ * Changing the path list.
+ */
+extern	int	PathLoad(PATH_CONTEXT * context, const char * str);
+extern	int	PathLoadBuffer(PATH_CONTEXT * context, const char * str,
+			size_t length);
+extern	void	PathClear(PATH_CONTEXT * context);
+extern	int	PathApply(PATH_CONTEXT * context, int action,
+			const char * path);
+extern	int	PathCheck(PATH_CONTEXT * context, const PATH_CHECK * check);
+extern	int	PathReorder(PATH_CONTEXT * context, const char ** table,
+			int count);
+
+
+/*
+ * Examining the path list.
+ */
+extern	int	PathCount(const PATH_CONTEXT * context);
+extern	int	PathContains(const PATH_CONTEXT * context, const char * path);
+extern	const char *	PathFirst(const PATH_CONTEXT * context);
+extern	const char *	PathLast(const PATH_CONTEXT * context);
+extern	int	PathTable(const PATH_CONTEXT * context, const char ** table);
+extern	int	PathSerialize(const PATH_CONTEXT * context, char * buf,
+			size_t size, size_t * lengthPtr);
+extern	void	PathGetStats(const PATH_CONTEXT * context,
+			PATH_STATS * stats);
+
+
+/*
+ * Utility routines.
+ */
+extern	int	PathStat(PATH_STAT * table, int count,
+			const PATH_CHECK * check);
+extern	const PATH_FS_TYPE *	PathFsTypes(void);
+extern	const char *	PathErrorString(int status);
+
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif
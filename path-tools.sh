@@ -20,6 +20,42 @@
 # 
 # source code for the "path" tool can be found here:
 # http://members.canb.auug.org.au/~dbell/
+#
+# if the "path" bash builtin (path.so) can be loaded then it is used
+# instead, which sets the variables without starting a new process.
+# it is searched for in $PATH_BUILTIN, next to this file, and in the
+# usual bash loadable builtin directories.
+
+_path_builtin=
+
+for _path_so in "$PATH_BUILTIN" "$(dirname "${BASH_SOURCE[0]}")/path.so" \
+  /usr/local/lib/bash/path.so /usr/lib/bash/path.so
+do
+  if [ -n "$_path_so" ] && [ -f "$_path_so" ] && \
+    enable -f "$_path_so" path 2>/dev/null
+  then
+    _path_builtin=1
+    break
+  fi
+done
+unset _path_so
+
+# set and export a variable to the result of running path with the
+# remaining arguments, using the builtin directly if it is loaded
+# "pathset MY_PATH -b dir" -> prepend to $MY_PATH
+function pathset()
+{
+  local _path_var=$1 _path_value
+  shift
+
+  if [ -n "$_path_builtin" ]
+  then
+    path -var "$_path_var" "$@"
+  else
+    _path_value=`path -var "$_path_var" "$@"` &&
+      export "$_path_var=$_path_value"
+  fi
+}
 
 # append directory to path if not already present
 # "pathadd dir" -> append to $PATH
@@ -28,9 +64,9 @@ function pathadd()
 { 
   if [ $# = 2 ] 
   then 
-    export $1=`path -var $1 $2`;
+    pathset $1 $2;
   else
-    export PATH=`path -var PATH $1`; 
+    pathset PATH $1; 
   fi
 }
 
@@ -41,9 +77,9 @@ function pathfront()
 { 
   if [ $# = 2 ] 
   then 
-    export $1=`path -var $1 -rb $2`;
+    pathset $1 -rb $2;
   else
-    export PATH=`path -var PATH -rb $1`; 
+    pathset PATH -rb $1; 
   fi
 }
 
@@ -54,9 +90,9 @@ function pathback()
 { 
   if [ $# = 2 ] 
   then 
-    export $1=`path -var $1 -ra $2`;
+    pathset $1 -ra $2;
   else
-    export PATH=`path -var PATH -ra $1`; 
+    pathset PATH -ra $1; 
   fi
 }
 
@@ -67,9 +103,9 @@ function pathdel()
 { 
   if [ $# = 2 ] 
   then 
-    export $1=`path -var $1 -r $2`;
+    pathset $1 -r $2;
   else
-    export PATH=`path -var PATH -r $1`; 
+    pathset PATH -r $1; 
   fi
 }
 
@@ -80,9 +116,9 @@ function pathclean()
 { 
   if [ $# = 1 ] 
   then 
-    export $1=`path -var $1 -ri -rr`;
+    pathset $1 -ri -rr;
   else
-    export PATH=`path -ri -rr`; 
+    pathset PATH -ri -rr; 
   fi
 }
 
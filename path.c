@@ -4,22 +4,106 @@
  * It just prints out the resulting path string. which can be used to set
  * a new path string as in:
  * 	PATH=`path [args]`
+ * The path list itself is kept and changed by the library in libpath.c.
  *
  * Copyright (c) 2000 David I. Bell
  * Permission is granted to use, distribute, or modify this source,
  * provided that this copyright notice remains intact.
  */
 
+#if defined(__linux__)
+#define	_GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <ctype.h>
 #include <memory.h>
 #include <malloc.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
 
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <time.h>
 #include <errno.h>
 
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <elf.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <signal.h>
+#define	HAVE_ELF
+#define	HAVE_INOTIFY
+#endif
+
+#include "libpath.h"
+
+
+/*
+ * When built as a bash loadable builtin, the variables are read and set
+ * in the shell itself by the routines in path_builtin.c, and fatal errors
+ * return to the shell instead of exiting it.  The memory allocated here
+ * is kept in a list so that whatever is still held when that happens
+ * can be freed, which is safe since the builtin starts no threads.
+ */
+#ifdef BASH_BUILTIN
+#include <setjmp.h>
+
+extern	const char *	BuiltinGetVariable(const char * name);
+extern	int	BuiltinSetVariable(const char * name, const char * value);
+extern	int	RunPath(int argc, const char ** argv);
+
+static	jmp_buf	exitJump;
+
+#undef	strdup
+
+#define	getenv(name)		BuiltinGetVariable(name)
+#define	exit(status)		longjmp(exitJump, (status) + 1)
+#define	main			PathMain
+#define	malloc(size)		HeldMalloc(size)
+#define	calloc(count, size)	HeldCalloc(count, size)
+#define	realloc(ptr, size)	HeldRealloc(ptr, size)
+#define	strdup(str)		HeldStrdup(str)
+#define	free(ptr)		HeldFree(ptr)
+
+static	int	PathMain(int argc, const char ** argv);
+static	void *	HeldMalloc(size_t size);
+static	void *	HeldCalloc(size_t count, size_t size);
+static	void *	HeldRealloc(void * ptr, size_t size);
+static	char *	HeldStrdup(const char * str);
+static	void	HeldFree(void * ptr);
+static	void	FreeAllHeld(void);
+#endif
+
+
+/*
+ * The daemon of -watch needs inotify, and is not run inside the shell.
+ */
+#if defined(HAVE_INOTIFY) && !defined(BASH_BUILTIN)
+#define	HAVE_WATCH
+#endif
+
+
+/*
+ * The builtin starts no threads inside the shell, so the calling thread
+ * does all of the work of each group of workers.
+ */
+#ifdef BASH_BUILTIN
+#define	START_WORKERS	0
+#else
+#define	START_WORKERS	1
+#endif
+
 
 #define	VERSION	"3.3"
 
@@ -45,24 +129,166 @@ typedef	int	BOOL;
  * Specially handled options.
  */
 #define	OPTION_VAR	"-var"
+#define	OPTION_TIMEOUT	"-timeout"
+#define	OPTION_INDEX	"-index"
+#define	OPTION_INPUT	"-input"
+#define	OPTION_OPTIMIZE	"-optimize"
+#define	OPTION_ROOT	"-root"
+#define	OPTION_METRICS	"-metrics"
+#define	OPTION_WATCH	"-watch"
+#define	OPTION_EXEC	"-exec"
+#define	OPTION_EXEC_WHICH	"-execw"
 #define	OPTION_HELP1	"-h"
 #define	OPTION_HELP2	"-help"
 #define	OPTION_HELP3	"-?"
 
 
+/*
+ * The longest time limit in milliseconds for each path to respond.
+ */
+#define	TIMEOUT_MAX_MS	3600000
+
+
+/*
+ * The value returned when handling a variable if the resulting path
+ * list is to be printed, rather than an exit status.
+ */
+#define	RESULT_PRINT	(-1)
+
+
+/*
+ * Types of shells for which commands setting the variables can be output.
+ */
+typedef	int	SHELL;
+
+#define	SHELL_NONE	((SHELL) 0)
+#define	SHELL_SH	((SHELL) 1)
+#define	SHELL_CSH	((SHELL) 2)
+#define	SHELL_FISH	((SHELL) 3)
+
+
+/*
+ * Output which is collected before being printed.
+ */
+typedef	struct
+{
+	char *	data;		/* collected output */
+	size_t	used;		/* bytes of output */
+	size_t	size;		/* bytes allocated */
+} OUTPUT;
+
+
+/*
+ * Definitions for reading path lists from the input in batch mode.
+ * The input is read in chunks of this size, which is also the size of
+ * the output buffer.
+ */
+#define	BATCH_BUFFER_SIZE	65536
+
+
+/*
+ * The status of the paths checked in batch mode is remembered so that
+ * paths shared by many path lists are only examined once.  At most this
+ * many results are kept, after which they are all forgotten.
+ */
+#define	MEMO_MAX_ENTRIES	16384
+#define	MEMO_SLOTS		(MEMO_MAX_ENTRIES * 2)
+
+
+/*
+ * A slot of the hash table of remembered results.
+ * An unused slot has a NULL path name.
+ */
+typedef	struct
+{
+	char *		path;		/* copy of path name */
+	unsigned int	hash;		/* hash value of path name */
+	PATH_STAT	info;		/* result for the path */
+} MEMO_SLOT;
+
+
+/*
+ * Definitions for auditing the path lists in the environments of all of
+ * the processes.  The environments are read in parallel by up to this
+ * many threads, in chunks of this size.
+ */
+#define	PROC_DIR_NAME		"/proc"
+#define	AUDIT_MAX_WORKERS	16
+#define	ENVIRON_BUFFER_SIZE	8192
+#define	AUDIT_NAME_SIZE		32
+
+
+/*
+ * A process whose environment is audited, and what was found in the
+ * path list of the variable in its environment.  Processes with the same
+ * root directory and value share the results found for the first of them.
+ */
+typedef	struct
+{
+	pid_t		pid;		/* process id */
+	char		name[AUDIT_NAME_SIZE];	/* command name */
+	char *		value;		/* value of variable, or NULL if unset */
+	size_t		length;		/* length of value */
+	int		error;		/* error reading environment, or zero */
+	BOOL		empty;		/* environment was empty */
+	BOOL		ownRoot;	/* root directory is the same as ours */
+	dev_t		rootDev;	/* device of root directory */
+	ino_t		rootIno;	/* inode of root directory */
+	int		paths;		/* number of paths in the value */
+	int		duplicates;	/* paths which were duplicates */
+	int		invalid;	/* paths which were invalid */
+	int		relative;	/* paths which were relative */
+} AUDIT_PROCESS;
+
+
+/*
+ * A batch of processes whose environments are being read by a group of
+ * threads, in the same way as directories are scanned.
+ */
+typedef	struct
+{
+	AUDIT_PROCESS *	table;		/* table of processes */
+	int		count;		/* number of processes in table */
+	int		next;		/* index of next process to be done */
+	const char *	varName;	/* variable being audited */
+	struct	stat	rootStat;	/* status of our root directory */
+} AUDIT_BATCH;
+
+
+/*
+ * The totals for all of the processes which were audited.
+ */
+typedef	struct
+{
+	int	setCount;		/* processes with the variable */
+	int	unsetCount;		/* processes without the variable */
+	int	unreadableCount;	/* processes which could not be read */
+	int	distinctCount;		/* distinct values of the variable */
+	int	duplicateCount;		/* processes with duplicate paths */
+	int	invalidCount;		/* processes with invalid paths */
+	int	relativeCount;		/* processes with relative paths */
+	long	duplicatePaths;		/* duplicate paths in all values */
+	long	invalidPaths;		/* invalid paths in all values */
+	long	relativePaths;		/* relative paths in all values */
+	int	maxPaths;		/* most paths in one value */
+	size_t	maxBytes;		/* longest value */
+} AUDIT_TOTALS;
+
+
 /*
  * Actions that can be applied to paths specified on the command line.
+ * The ones which change the path list are those of the library.
  */
 typedef	int	ACTION;
 
 #define	ACTION_NONE		((ACTION) 0)
-#define	ACTION_AFTER		((ACTION) 1)
-#define	ACTION_BEFORE		((ACTION) 2)
-#define	ACTION_REMOVE		((ACTION) 3)
-#define	ACTION_REMOVE_AFTER	((ACTION) 4)
-#define	ACTION_REMOVE_BEFORE	((ACTION) 5)
-#define	ACTION_MOVE_AFTER	((ACTION) 6)
-#define	ACTION_MOVE_BEFORE	((ACTION) 7)
+#define	ACTION_AFTER		((ACTION) PATH_ADD_AFTER)
+#define	ACTION_BEFORE		((ACTION) PATH_ADD_BEFORE)
+#define	ACTION_REMOVE		((ACTION) PATH_REMOVE)
+#define	ACTION_REMOVE_AFTER	((ACTION) PATH_REMOVE_AFTER)
+#define	ACTION_REMOVE_BEFORE	((ACTION) PATH_REMOVE_BEFORE)
+#define	ACTION_MOVE_AFTER	((ACTION) PATH_MOVE_AFTER)
+#define	ACTION_MOVE_BEFORE	((ACTION) PATH_MOVE_BEFORE)
 #define	ACTION_SET		((ACTION) 8)
 #define	ACTION_LIST		((ACTION) 9)
 #define	ACTION_LIST_SORTED	((ACTION) 10)
@@ -73,879 +299,9942 @@ typedef	int	ACTION;
 #define	ACTION_CHECK_RELATIVE	((ACTION) 15)
 #define	ACTION_REMOVE_RELATIVE	((ACTION) 16)
 #define	ACTION_TEST_PRESENCE	((ACTION) 17)
+#define	ACTION_DEMOTE_NETWORK	((ACTION) 18)
+#define	ACTION_REPORT_FS	((ACTION) 19)
+#define	ACTION_USE_CACHE	((ACTION) 20)
+#define	ACTION_REFRESH_CACHE	((ACTION) 21)
+#define	ACTION_NO_CACHE		((ACTION) 22)
+#define	ACTION_WHICH		((ACTION) 23)
+#define	ACTION_WHICH_ALL	((ACTION) 24)
+#define	ACTION_SHADOW		((ACTION) 25)
+#define	ACTION_SHELL_SH		((ACTION) 26)
+#define	ACTION_SHELL_CSH	((ACTION) 27)
+#define	ACTION_SHELL_FISH	((ACTION) 28)
+#define	ACTION_BATCH		((ACTION) 29)
+#define	ACTION_BATCH_NUL	((ACTION) 30)
+#define	ACTION_STATS		((ACTION) 31)
+#define	ACTION_STATS_JSON	((ACTION) 32)
+#define	ACTION_NORMALIZE	((ACTION) 33)
+#define	ACTION_REMOVE_ALIASES	((ACTION) 34)
+#define	ACTION_REPORT_ALIASES	((ACTION) 35)
+#define	ACTION_ELF		((ACTION) 36)
+#define	ACTION_ELF_REMOVE	((ACTION) 37)
+#define	ACTION_CLASS_PATH	((ACTION) 38)
+#define	ACTION_CLASS_REMOVE	((ACTION) 39)
+#define	ACTION_AUDIT		((ACTION) 40)
+#define	ACTION_MEMO		((ACTION) 41)
+#define	ACTION_FINGERPRINT	((ACTION) 42)
+#define	ACTION_GLOB		((ACTION) 43)
 
 
 /*
- * The results of checking the validity of a path.
+ * The phases of the work whose times are reported by -stats.
  */
-typedef	int	STATUS;
-
-#define	STATUS_KEEP	((STATUS) 0)
-#define	STATUS_REMOVE	((STATUS) 1)
-#define	STATUS_ERROR	((STATUS) 2)
+#define	PHASE_PARSE	0
+#define	PHASE_LOAD	1
+#define	PHASE_ARGUMENTS	2
+#define	PHASE_DOT	3
+#define	PHASE_CHECK	4
+#define	PHASE_OUTPUT	5
+#define	PHASE_COUNT	6
 
 
 /*
- * Local data which holds the paths we are working on.
- * This is an array of path names, and the number of paths in the array.
- * The array is NOT terminated with a null pointer.
+ * The most groups of paths whose times are reported separately by -stats,
+ * and the size of the buffer for the name of the slowest path.
  */
-static	const char **	pathTable;
-static	int		pathCount;
+#define	STATS_MAX_GROUPS	32
+#define	STATS_PATH_SIZE		1024
 
 
 /*
- * Option table
+ * The time spent on a group of paths given on the command line.
+ * Groups are identified by the index of their first path in the arguments,
+ * so that the times for a group are added up when it is used for several
+ * path lists.
  */
 typedef	struct
 {
-	const char *	name;		/* name of option */
-	ACTION		action;		/* action code */
-	const char *	help;		/* help description */
-} OPTION;
+	int		argIndex;	/* index of first path of group */
+	int		pathCount;	/* number of paths in group */
+	ACTION		action;		/* action applied to the paths */
+	long		runCount;	/* times the group was handled */
+	long long	ns;		/* total time spent */
+} STATS_GROUP;
 
 
-static	const OPTION	optionTable[] =
-{
-	{
-		"-var", ACTION_NONE,
-		"use the specified environment variable instead of PATH"
-	},
-	{
-		"-a",	ACTION_AFTER,
-		"add following paths after current paths if not present"
-	},
-	{
-		"-b",	ACTION_BEFORE,
-		"add following paths before current paths if not present"
-	},
-	{
-		"-r",	ACTION_REMOVE,
-		"remove following paths from current paths if present"
-	},
-	{
-		"-ra",	ACTION_REMOVE_AFTER,
-		"remove and then add following paths after current paths"
-	},
-	{
-		"-rb",	ACTION_REMOVE_BEFORE,
-		"remove and then add following paths before current paths"
-	},
-	{
-		"-ma",	ACTION_MOVE_AFTER,
-		"move following paths after other current paths if present"
-	},
-	{
-		"-mb",	ACTION_MOVE_BEFORE,
-		"move following paths before other current paths if present"
-	},
-	{
-		"-s",	ACTION_SET,
-		"set following paths as the current path"
-	},
-	{
-		"-dd",	ACTION_DISABLE_DOT,
-		"disable any special treatment of the DOT path"
-	},
-	{
-		"-ci",	ACTION_CHECK_INVALID,
-		"check absolute paths in the path list to see if they are invalid"
-	},
-	{
-		"-ri",	ACTION_REMOVE_INVALID,
-		"remove absolute paths from the path list which are invalid"
-	},
-	{
-		"-cr",	ACTION_CHECK_RELATIVE,
-		"check whether any paths in the path list are relative"
-	},
-	{
-		"-rr",	ACTION_REMOVE_RELATIVE,
-		"remove relative paths from the path list"
-	},	
-	{
-		"-tp",	ACTION_TEST_PRESENCE,
-		"test whether specified paths are present in the path list"
-	},
-	{
-		"-l",	ACTION_LIST,
-		"list current paths one per line instead of in one string"
-	},
-	{
-		"-ls",	ACTION_LIST_SORTED,
-		"list sorted current paths one per line instead of in one string"
-	},
-	{
-		"-af",	ACTION_ALLOW_FILES,
-		"allow files in addition to directories in paths"
-	},
-	{
-		NULL,	ACTION_NONE,
-		NULL
-	}
-};
+/*
+ * Constants for the FNV-1a hash of path names.
+ */
+#define	HASH_BASIS	2166136261U
+#define	HASH_PRIME	16777619U
 
 
 /*
- * Option variables.
+ * Definitions for the cache of the results of checking paths.
+ * The cache file is kept in the user's runtime directory, and holds
+ * an open addressed hash table of slots followed by the path names.
+ * Each result is stamped with the identity and change time of the
+ * parent directory of the path, since the path cannot have been created,
+ * removed, or replaced without changing its parent directory.  That is
+ * not true of the target of a symbolic link, so links are never saved.
  */
-static	ACTION	action;
-static	BOOL	disableDotFlag;
-static	BOOL	checkInvalidFlag;
-static	BOOL	removeInvalidFlag;
-static	BOOL	checkRelativeFlag;
-static	BOOL	removeRelativeFlag;
-static	BOOL	testPresenceFlag;
-static	BOOL	listFlag;
-static	BOOL	listSortedFlag;
-static	BOOL	allowFilesFlag;
-static	BOOL	testFailedFlag;
+#define	CACHE_FILE_NAME		"path-check.cache"
+#define	CACHE_MAGIC		0x34484350
+#define	CACHE_MAX_ENTRIES	4096
+#define	CACHE_FS_TYPE		0
+#define	CACHE_NO_FS_TYPE	-1
+#define	CACHE_UNKNOWN_FS_TYPE	-2
 
 
 /*
- * Local procedures.
+ * The identity and change time of the parent directory of a path.
  */
-static	void	RemoveDuplicatePaths(void);
-static	void	HandlePathList(int listCount, const char ** listTable);
-static	void	HandlePath(const char * path, ACTION action);
-static	BOOL	RemovePathFromList(const char * path);
-static	BOOL	CheckPathList(void);
-static	BOOL	HandleOption(const char * name);
-static	STATUS	CheckPath(const char * path);
-static	char *	CopyString(const char * oldStr);
-static	int	SortCallback(const void * addr1, const void * addr2);
-static	void	Usage(void);
+typedef	struct
+{
+	uint64_t	dev;		/* device of directory */
+	uint64_t	ino;		/* inode of directory */
+	int64_t		ctimeSec;	/* change time of directory */
+	int64_t		ctimeNsec;	/* nanoseconds of change time */
+} CACHE_STAMP;
 
 
-int
-main(int argc, const char ** argv)
+/*
+ * A parent directory whose stamp has been found during this run.
+ * Its name is the first part of the name of a path being checked.
+ */
+typedef	struct
 {
-	const char *	varName;
-	char *		path;
-	char *		str;
-	const char *	argument;
-	const char **	listTable;
-	int		listCount;
-	int		maxPaths;
-	int		index;
-	BOOL		dotFirst;
-	BOOL		dotLast;
+	const char *	name;		/* name, NOT null terminated */
+	int		length;		/* length of name, zero if unused */
+	unsigned int	hash;		/* hash value of name */
+	BOOL		valid;		/* stamp was found */
+	CACHE_STAMP	stamp;		/* stamp of directory */
+} CACHE_PARENT;
 
-	action = ACTION_AFTER;
-	disableDotFlag = FALSE;
-	listFlag = FALSE;
-	listSortedFlag = FALSE;
-	allowFilesFlag = FALSE;
-	checkInvalidFlag = FALSE;
-	removeRelativeFlag = FALSE;
-	checkRelativeFlag = FALSE;
-	removeInvalidFlag = FALSE;
-	testPresenceFlag = FALSE;
-	testFailedFlag = FALSE;
-	dotFirst = FALSE;
-	dotLast = FALSE;
 
-	/*
-	 * Discard the program name.
-	 */
-	argc--;
-	argv++;
+/*
+ * The header at the start of the cache file.
+ */
+typedef	struct
+{
+	uint32_t	magic;		/* magic number for cache files */
+	uint32_t	slotCount;	/* number of slots (power of two) */
+	uint32_t	entryCount;	/* number of slots in use */
+	uint32_t	namesSize;	/* size of the path name area */
+} CACHE_HEADER;
 
-	/*
-	 * First check for explicit requests for help.
-	 * This can be specified for any argument, in which case all
-	 * of the other arguments are ignored.
-	 */
-	for (index = 0; index < argc; index++)
-	{
-		argument = argv[index];
 
-		if ((strcmp(argument, OPTION_HELP1) == 0) ||
-			(strcmp(argument, OPTION_HELP2) == 0) ||
-			(strcmp(argument, OPTION_HELP3) == 0))
-		{
-			Usage();
+/*
+ * A slot of the hash table in the cache file.
+ * An unused slot has a name length of zero.
+ */
+typedef	struct
+{
+	uint32_t	hash;		/* hash value of path name */
+	uint32_t	nameOffset;	/* offset of name in the name area */
+	uint32_t	nameLength;	/* length of path name */
+	int32_t		error;		/* error number, or zero if found */
+	uint32_t	mode;		/* mode of the path if found */
+	int32_t		fsState;	/* whether filesystem type was found */
+	uint32_t	fsMagic;	/* magic number of filesystem type */
+	uint32_t	unused;		/* padding */
+	uint64_t	dev;		/* device of the path if found */
+	uint64_t	ino;		/* inode of the path if found */
+	CACHE_STAMP	stamp;		/* stamp of parent directory */
+} CACHE_SLOT;
 
-			return 1;
-		}
-	}
 
-	/*
-	 * See if any argument is the one for the environment variable to
-	 * be manipulated.  If not, then use the normal PATH environment
-	 * variable name.  This check has to be done first so that the
-	 * current path is initialized before it is acted on.  The last
-	 * variable name specified is used.
-	 */
-	varName = "PATH";
+/*
+ * Definitions for the file of saved results for -memo, which is kept
+ * in the runtime directory next to the cache.  It holds the header and
+ * then the entries, most recently saved first, each followed by the
+ * output it saved padded to a multiple of eight bytes.  Larger outputs
+ * are not saved.
+ */
+#define	SAVED_FILE_NAME		"path-memo.cache"
+#define	SAVED_MAGIC		0x314d4550
+#define	SAVED_MAX_ENTRIES	32
+#define	SAVED_MAX_OUTPUT	65536
 
-	for (index = 0; index < argc; index++)
-	{
-		if (strcmp(argv[index], OPTION_VAR) != 0)
-			continue;
 
-		if ((++index >= argc) || (argv[index][0] == '-'))
-		{
-			fprintf(stderr, "Missing environment variable name\n");
+/*
+ * Constants for the 64 bit FNV-1a hash used for the fingerprint of the
+ * inputs of a run.
+ */
+#define	FINGERPRINT_BASIS	14695981039346656037ULL
+#define	FINGERPRINT_PRIME	1099511628211ULL
+
+
+/*
+ * The header at the start of the file of saved results.
+ */
+typedef	struct
+{
+	uint32_t	magic;		/* magic number for saved results */
+	uint32_t	unused;		/* padding */
+} SAVED_HEADER;
+
+
+/*
+ * An entry of the file of saved results.
+ */
+typedef	struct
+{
+	uint64_t	fingerprint;	/* fingerprint of the inputs */
+	uint32_t	outputSize;	/* bytes of output which follow */
+	uint32_t	unused;		/* padding */
+} SAVED_ENTRY;
+
+
+/*
+ * The paths whose status is part of the fingerprint of a run.
+ * Their status is found all at once after they are collected.
+ */
+typedef	struct
+{
+	PATH_STAT *	table;		/* table of paths */
+	int		count;		/* number of paths */
+	int		size;		/* allocated size of table */
+} STAMP_TABLE;
+
+
+/*
+ * Definitions for the index of the commands in the directories of the
+ * final path list.  The index is built in memory in the same form as it
+ * is kept in an index file, which is the header, the table of directories,
+ * an open addressed hash table of slots for the command names, the table
+ * of directory numbers for each command in list order, and then the names.
+ * Directories are read in chunks of the following size.
+ */
+#define	INDEX_MAGIC		0x31584449
+#define	SCAN_BUFFER_SIZE	32768
+
+
+/*
+ * Directories are read in parallel by up to this many threads.
+ */
+#define	SCAN_MAX_WORKERS	64
+
+
+/*
+ * The name of the variable which is a Java class path, in which a trailing
+ * asterisk is a wildcard for jar files rather than a glob pattern.
+ */
+#define	CLASS_PATH_VARIABLE	"CLASSPATH"
+
+
+/*
+ * The paths matched by a path argument which is a glob pattern.
+ * The patterns in one group of arguments are expanded in parallel in the
+ * same way as directories are read.  An argument which is not a pattern,
+ * or which matches nothing, is used literally once any backslashes which
+ * quote the glob characters are removed.
+ */
+typedef	struct
+{
+	const char *	pattern;	/* argument which may be a pattern */
+	char *		glob;		/* pattern to match, or NULL if none */
+	const char *	suffix;		/* added to each match, or NULL */
+	char *		literal;	/* argument used literally, or NULL */
+	char **		matches;	/* copies of the matching paths */
+	int		count;		/* number of matches */
+	int		size;		/* entries allocated for matches */
+	BOOL		failed;		/* memory could not be allocated */
+} GLOB_EXPANSION;
+
+
+/*
+ * A batch of patterns being expanded by a group of threads.
+ */
+typedef	struct
+{
+	GLOB_EXPANSION *	table;	/* table of arguments */
+	int			count;	/* number of arguments in table */
+	int			next;	/* index of next argument to be done */
+} GLOB_BATCH;
+
+
+/*
+ * Which names are kept when reading the paths for an index.
+ * For class path entries these are the names of the classes and other
+ * resources in jar files or in the trees of directories.
+ */
+#define	SCAN_ALL	0	/* all names other than directories */
+#define	SCAN_EXEC	1	/* only executable files */
+#define	SCAN_CLASSES	2	/* contents of class path entries */
+
+
+/*
+ * Definitions for reading the central directory of a jar file, which is
+ * found from the end of central directory record in the last 64K of it.
+ * The deepest directory tree of classes which is read is also limited.
+ */
+#define	ZIP_END_SIGNATURE	0x06054b50
+#define	ZIP_END_SIZE		22
+#define	ZIP64_LOCATOR_SIGNATURE	0x07064b50
+#define	ZIP64_LOCATOR_SIZE	20
+#define	ZIP64_END_SIGNATURE	0x06064b50
+#define	ZIP64_END_SIZE		56
+#define	ZIP_ENTRY_SIGNATURE	0x02014b50
+#define	ZIP_ENTRY_SIZE		46
+#define	ZIP_MAX_COMMENT		65535
+#define	CLASS_MAX_DEPTH		64
+
+
+/*
+ * The most paths which can be reordered by -optimize, and the longest
+ * line which is read from a profile of commands.
+ */
+#define	OPTIMIZE_MAX_PATHS	1024
+#define	PROFILE_LINE_SIZE	4096
+
+
+/*
+ * The dependencies of an ELF file as read from its dynamic section.
+ * The strings point into a copy of its dynamic string table.
+ */
+typedef	struct
+{
+	int		elfClass;	/* ELFCLASS32 or ELFCLASS64 */
+	int		machine;	/* machine type */
+	char *		strings;	/* copy of dynamic string table */
+	const char **	needed;		/* names of needed libraries */
+	int		neededCount;	/* number of needed libraries */
+	const char *	rpath;		/* DT_RPATH or NULL */
+	const char *	runpath;	/* DT_RUNPATH or NULL */
+} ELF_INFO;
+
+
+/*
+ * The results of reading an ELF file.
+ */
+#define	ELF_OK		0	/* file was read */
+#define	ELF_MISSING	1	/* file could not be opened */
+#define	ELF_INVALID	2	/* file is not a usable ELF file */
+#define	ELF_MEMORY	3	/* memory could not be allocated */
+
+
+/*
+ * The most libraries which are loaded for one ELF file.
+ */
+#define	ELF_MAX_OBJECTS	1024
+
+
+/*
+ * Directories searched for libraries after the path list, in place of
+ * the cache of the dynamic loader.
+ */
+#define	SYSTEM_LIBRARY_DIRS	"/lib64:/usr/lib64:" \
+	"/lib/x86_64-linux-gnu:/usr/lib/x86_64-linux-gnu:" \
+	"/lib/aarch64-linux-gnu:/usr/lib/aarch64-linux-gnu:" \
+	"/lib:/usr/lib:/usr/local/lib"
+
+
+/*
+ * The byte order of ELF files which can be loaded.
+ */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define	ELF_NATIVE_DATA	ELFDATA2MSB
+#else
+#define	ELF_NATIVE_DATA	ELFDATA2LSB
+#endif
+
+
+/*
+ * An object which has been loaded while simulating the dynamic loader.
+ */
+typedef	struct
+{
+	char *		path;		/* path name it was found at */
+	const char *	name;		/* name it was needed by */
+	ELF_INFO	info;		/* its dependencies */
+	BOOL		read;		/* TRUE if the info was read */
+} ELF_OBJECT;
+
+
+/*
+ * The identity and modification time of a directory which was indexed.
+ * Any command added to or removed from it changes its modification time.
+ */
+typedef	struct
+{
+	uint64_t	dev;		/* device of directory */
+	uint64_t	ino;		/* inode of directory */
+	int64_t		mtimeSec;	/* modification time of directory */
+	int64_t		mtimeNsec;	/* nanoseconds of modification time */
+} DIR_STAMP;
+
+
+/*
+ * The header at the start of an index.
+ */
+typedef	struct
+{
+	uint32_t	magic;		/* magic number for index files */
+	uint32_t	dirCount;	/* number of directories */
+	uint32_t	slotCount;	/* number of slots (power of two) */
+	uint32_t	refCount;	/* number of directory numbers */
+	uint32_t	namesSize;	/* size of the name area */
+	uint32_t	listHash;	/* hash value of the directory names */
+} INDEX_HEADER;
+
+
+/*
+ * A directory in an index.
+ */
+typedef	struct
+{
+	uint32_t	nameOffset;	/* offset of name in the name area */
+	uint32_t	nameLength;	/* length of name */
+	uint32_t	valid;		/* directory could be read */
+	uint32_t	unused;		/* padding */
+	DIR_STAMP	stamp;		/* stamp of directory */
+} INDEX_DIR;
+
+
+/*
+ * A slot of the hash table of command names in an index.
+ * An unused slot has a name length of zero.
+ */
+typedef	struct
+{
+	uint32_t	hash;		/* hash value of command name */
+	uint32_t	nameOffset;	/* offset of name in the name area */
+	uint32_t	nameLength;	/* length of command name */
+	uint32_t	firstRef;	/* first directory number for command */
+	uint32_t	refCount;	/* number of directories with command */
+} INDEX_SLOT;
+
+
+/*
+ * The names of the entries read from one directory, other than the
+ * subdirectories.  The names are stored one after another each with
+ * a terminating null character.
+ */
+typedef	struct
+{
+	const char *	path;		/* name of directory */
+	char *		names;		/* names of the entries */
+	size_t		used;		/* bytes used for names */
+	size_t		size;		/* bytes allocated for names */
+	int		count;		/* number of names */
+	int		mode;		/* SCAN mode for which names to keep */
+	BOOL		valid;		/* directory could be read */
+	DIR_STAMP	stamp;		/* stamp of directory */
+} DIR_SCAN;
+
+
+/*
+ * A batch of directories being read by a group of threads.
+ * Each thread takes the next directory from the table until they are
+ * all done, so the results are in the same order as the directories.
+ */
+typedef	struct
+{
+	DIR_SCAN *	table;		/* table of directories */
+	int		count;		/* number of directories in table */
+	int		next;		/* index of next directory to be done */
+} SCAN_BATCH;
+
+
+/*
+ * Definitions for the daemon of -watch.  Changes to the directories are
+ * collected until there have been none for the settle time before they
+ * are read again.  At most this many clients are connected at once, and
+ * each of their requests is a line of at most this size.
+ */
+#define	WATCH_SETTLE_MS		50
+#define	WATCH_MAX_CLIENTS	64
+#define	WATCH_LINE_SIZE		4096
+#define	WATCH_EVENT_SIZE	16384
+
+
+/*
+ * The events watched for in the directories of the path list, and in
+ * each of the directories above them.
+ */
+#define	WATCH_DIR_EVENTS	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+				IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | \
+				IN_MOVE_SELF | IN_ONLYDIR | IN_MASK_ADD)
+#define	WATCH_PARENT_EVENTS	(IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+				IN_MOVED_TO | IN_ONLYDIR | IN_MASK_ADD)
+
+
+/*
+ * A watch on a directory of the path list or on one of the directories
+ * above it.  For a directory above it, only the events for the entry
+ * leading towards the directory matter.  The same watch can be shared
+ * by many directories.
+ */
+typedef	struct
+{
+	int	wd;		/* watch descriptor */
+	int	dirIndex;	/* index of directory in the path list */
+	int	length;		/* length of the watched part of its name */
+} WATCH_ENTRY;
+
+
+/*
+ * A client connected to the daemon of -watch.
+ */
+typedef	struct
+{
+	int		fd;		/* socket, or -1 if the slot is unused */
+	size_t		used;		/* bytes of the partial request */
+	BOOL		waiting;	/* waiting for a change */
+	char		line[WATCH_LINE_SIZE];	/* partial requests */
+} WATCH_CLIENT;
+
+
+/*
+ * Option table
+ */
+typedef	struct
+{
+	const char *	name;		/* name of option */
+	ACTION		action;		/* action code */
+	const char *	help;		/* help description */
+} OPTION;
+
+
+static	const OPTION	optionTable[] =
+{
+	{
+		"-var", ACTION_NONE,
+		"use the specified environment variable instead of PATH"
+	},
+	{
+		"-a",	ACTION_AFTER,
+		"add following paths after current paths if not present"
+	},
+	{
+		"-b",	ACTION_BEFORE,
+		"add following paths before current paths if not present"
+	},
+	{
+		"-r",	ACTION_REMOVE,
+		"remove following paths from current paths if present"
+	},
+	{
+		"-ra",	ACTION_REMOVE_AFTER,
+		"remove and then add following paths after current paths"
+	},
+	{
+		"-rb",	ACTION_REMOVE_BEFORE,
+		"remove and then add following paths before current paths"
+	},
+	{
+		"-ma",	ACTION_MOVE_AFTER,
+		"move following paths after other current paths if present"
+	},
+	{
+		"-mb",	ACTION_MOVE_BEFORE,
+		"move following paths before other current paths if present"
+	},
+	{
+		"-s",	ACTION_SET,
+		"set following paths as the current path"
+	},
+	{
+		"-n",	ACTION_NORMALIZE,
+		"normalize path names so that equivalent spellings are the same"
+	},
+	{
+		"-glob", ACTION_GLOB,
+		"expand glob patterns in the following paths"
+	},
+	{
+		"-dd",	ACTION_DISABLE_DOT,
+		"disable any special treatment of the DOT path"
+	},
+	{
+		"-ci",	ACTION_CHECK_INVALID,
+		"check absolute paths in the path list to see if they are invalid"
+	},
+	{
+		"-ri",	ACTION_REMOVE_INVALID,
+		"remove absolute paths from the path list which are invalid"
+	},
+	{
+		"-cr",	ACTION_CHECK_RELATIVE,
+		"check whether any paths in the path list are relative"
+	},
+	{
+		"-rr",	ACTION_REMOVE_RELATIVE,
+		"remove relative paths from the path list"
+	},	
+	{
+		"-tp",	ACTION_TEST_PRESENCE,
+		"test whether specified paths are present in the path list"
+	},
+	{
+		"-which", ACTION_WHICH,
+		"show where following command names are found in the path list"
+	},
+	{
+		"-wa",	ACTION_WHICH_ALL,
+		"show all places where commands are found, not just the first"
+	},
+	{
+		"-index", ACTION_NONE,
+		"save and reuse the index of commands for -which in a file"
+	},
+	{
+		OPTION_WATCH, ACTION_NONE,
+		"serve the index of commands on the following socket as it changes"
+	},
+	{
+		OPTION_OPTIMIZE, ACTION_NONE,
+		"reorder paths for fewer searches by the following command profile"
+	},
+	{
+		"-shadow", ACTION_SHADOW,
+		"report commands which are shadowed by ones in earlier paths"
+	},
+	{
+		"-elf",	ACTION_ELF,
+		"report library paths unused by following ELF files"
+	},
+	{
+		"-elfr", ACTION_ELF_REMOVE,
+		"remove library paths unused by following ELF files"
+	},
+	{
+		"-cp",	ACTION_CLASS_PATH,
+		"report duplicate classes and redundant class path entries"
+	},
+	{
+		"-cpr",	ACTION_CLASS_REMOVE,
+		"remove class path entries whose contents are all in earlier ones"
+	},
+	{
+		"-sh",	ACTION_SHELL_SH,
+		"output sh commands to set each variable given by -var"
+	},
+	{
+		"-csh",	ACTION_SHELL_CSH,
+		"output csh commands to set each variable given by -var"
+	},
+	{
+		"-fish", ACTION_SHELL_FISH,
+		"output fish commands to set each variable given by -var"
+	},
+	{
+		"-batch", ACTION_BATCH,
+		"handle each line of the input as a path list"
+	},
+	{
+		"-batch0", ACTION_BATCH_NUL,
+		"handle each null terminated string of the input as a path list"
+	},
+	{
+		OPTION_INPUT, ACTION_NONE,
+		"read path lists for -batch from the following file"
+	},
+	{
+		"-audit", ACTION_AUDIT,
+		"report problems with the path lists of all running processes"
+	},
+	{
+		OPTION_METRICS, ACTION_NONE,
+		"write the totals for -audit as metrics to the following file"
+	},
+	{
+		OPTION_EXEC, ACTION_NONE,
+		"run the following command and arguments with the new path list"
+	},
+	{
+		OPTION_EXEC_WHICH, ACTION_NONE,
+		"same as -exec but find the command in the new path list itself"
+	},
+	{
+		"-memo", ACTION_MEMO,
+		"reuse the saved output of an earlier run with the same inputs"
+	},
+	{
+		"-fingerprint", ACTION_FINGERPRINT,
+		"print the fingerprint of the inputs used by -memo and exit"
+	},
+	{
+		"-stats", ACTION_STATS,
+		"report the time taken by each phase and counts of work done"
+	},
+	{
+		"-jstats", ACTION_STATS_JSON,
+		"report the same as -stats in JSON format"
+	},
+	{
+		"-timeout", ACTION_NONE,
+		"milliseconds to wait for each path to respond when checked"
+	},
+	{
+		"-dn",	ACTION_DEMOTE_NETWORK,
+		"move paths on network or slow filesystems to the end"
+	},
+	{
+		OPTION_ROOT, ACTION_NONE,
+		"check paths within the following directory as the root"
+	},
+	{
+		"-fs",	ACTION_REPORT_FS,
+		"report the filesystem type of absolute paths"
+	},
+	{
+		"-di",	ACTION_REMOVE_ALIASES,
+		"remove paths which are the same directory as an earlier path"
+	},
+	{
+		"-da",	ACTION_REPORT_ALIASES,
+		"remove and report paths which are the same as an earlier path"
+	},
+	{
+		"-cache", ACTION_USE_CACHE,
+		"reuse results of checking paths which are saved in a cache"
+	},
+	{
+		"-recache", ACTION_REFRESH_CACHE,
+		"check all paths again and save the results in the cache"
+	},
+	{
+		"-nocache", ACTION_NO_CACHE,
+		"do not use the cache of results of checking paths"
+	},
+	{
+		"-l",	ACTION_LIST,
+		"list current paths one per line instead of in one string"
+	},
+	{
+		"-ls",	ACTION_LIST_SORTED,
+		"list sorted current paths one per line instead of in one string"
+	},
+	{
+		"-af",	ACTION_ALLOW_FILES,
+		"allow files in addition to directories in paths"
+	},
+	{
+		NULL,	ACTION_NONE,
+		NULL
+	}
+};
+
+
+/*
+ * Option variables.
+ */
+static	ACTION	action;
+static	BOOL	disableDotFlag;
+static	BOOL	checkInvalidFlag;
+static	BOOL	removeInvalidFlag;
+static	BOOL	checkRelativeFlag;
+static	BOOL	removeRelativeFlag;
+static	BOOL	testPresenceFlag;
+static	BOOL	listFlag;
+static	BOOL	listSortedFlag;
+static	BOOL	allowFilesFlag;
+static	BOOL	testFailedFlag;
+static	BOOL	demoteNetworkFlag;
+static	BOOL	reportFsFlag;
+static	BOOL	removeAliasesFlag;
+static	BOOL	reportAliasesFlag;
+static	BOOL	useCacheFlag;
+static	BOOL	refreshCacheFlag;
+static	BOOL	noCacheFlag;
+static	int	timeoutMs;
+static	BOOL	whichFlag;
+static	BOOL	whichAllFlag;
+static	const char **	whichTable;
+static	int	whichCount;
+static	const char *	indexName;
+static	const char *	optimizeName;
+static	const char *	rootName;
+static	int	rootFd = -1;
+static	char *	rootFdName;
+static	BOOL	shadowFlag;
+static	const char *	shadowNames;
+static	const char **	elfTable;
+static	int	elfCount;
+static	BOOL	elfRemoveFlag;
+static	int *	elfLookups;
+static	int	elfLookupCount;
+static	int	elfLookupSize;
+static	BOOL	classPathFlag;
+static	BOOL	classRemoveFlag;
+static	SHELL	shellType;
+static	BOOL	batchFlag;
+static	char	batchDelimiter;
+static	const char *	inputName;
+static	long	recordNumber;
+static	MEMO_SLOT *	memoTable;
+static	int	memoCount;
+static	BOOL	auditFlag;
+static	const char *	metricsName;
+static	AUDIT_PROCESS *	auditProcess;
+static	const char *	auditRootName;
+static	int	loadCount;
+static	BOOL	memoFlag;
+static	OUTPUT	savedOutput;
+static	BOOL	statsFlag;
+static	BOOL	statsJsonFlag;
+static	BOOL	normalizeFlag;
+static	BOOL	globFlag;
+static	BOOL	classVarFlag;
+static	BOOL	classListFlag;
+static	const char *	watchName;
+static	const char **	execArgv;
+static	BOOL	execWhichFlag;
+#if defined(HAVE_WATCH)
+static	volatile sig_atomic_t	watchStopped;
+#endif
+
+
+/*
+ * The times and counts which are reported by -stats.
+ */
+static	const char **	statsArgv;
+static	long long	phaseTimes[PHASE_COUNT];
+static	STATS_GROUP	statsGroups[STATS_MAX_GROUPS];
+static	int		statsGroupCount;
+static	long long	statsOtherGroupNs;
+static	long		statCalls;
+static	long long	statTotalNs;
+static	long long	statSlowestNs;
+static	char		statSlowestPath[STATS_PATH_SIZE];
+
+
+/*
+ * The names of the phases as they are reported.
+ */
+static	const char *	phaseNames[PHASE_COUNT] =
+{
+	"parse", "load", "arguments", "dot", "check", "output"
+};
+
+
+/*
+ * The context of the library which holds the paths we are working on.
+ */
+static	PATH_CONTEXT *	pathContext;
+
+
+/*
+ * Local procedures.
+ */
+static	int	HandleVariable(const char * varName, int argc,
+			const char ** argv);
+static	int	HandleValue(const char * value, size_t length, int argc,
+			const char ** argv);
+static	int	HandleBatch(int argc, const char ** argv);
+static	int	HandleRecord(const char * record, size_t length, int argc,
+			const char ** argv);
+static	int	HandleAudit(const char * varName, int argc,
+			const char ** argv);
+static	int	AuditValue(AUDIT_PROCESS * proc, int argc,
+			const char ** argv);
+static	void	ReadProcesses(AUDIT_PROCESS * table, int count,
+			const char * varName);
+static	void *	AuditWorker(void * arg);
+static	void	ReadProcess(AUDIT_PROCESS * proc, const char * varName,
+			const struct stat * rootStat);
+static	char *	ReadProcFile(pid_t pid, const char * fileName,
+			size_t * sizePtr);
+static	void	AddAuditTotals(AUDIT_TOTALS * totals,
+			const AUDIT_PROCESS * proc);
+static	BOOL	WriteMetrics(const char * varName,
+			const AUDIT_TOTALS * totals);
+static	void	AppendMetricHelp(OUTPUT * output, const char * name,
+			const char * help);
+static	void	AppendMetric(OUTPUT * output, const char * name,
+			const char * labels, const char * extraLabel, long value);
+static	int	ProcessSortCallback(const void * addr1, const void * addr2);
+static	int	ValueSortCallback(const void * addr1, const void * addr2);
+static	uint64_t	MakeFingerprint(int argc, const char ** argv,
+			BOOL * slowPtr);
+static	uint64_t	HashVariable(uint64_t hash, const char * varName,
+			STAMP_TABLE * stamps, BOOL * relativePtr);
+static	uint64_t	HashStamps(uint64_t hash, STAMP_TABLE * stamps,
+			int argc, const char ** argv, BOOL * slowPtr);
+static	uint64_t	HashStamp(uint64_t hash, const PATH_STAT * info,
+			BOOL * slowPtr);
+static	void	AddStamp(STAMP_TABLE * stamps, const char * path);
+static	BOOL	ParseTimeout(const char * text, int * timeoutPtr);
+static	uint64_t	HashBytes(uint64_t hash, const void * data,
+			size_t size);
+static	BOOL	CheckMemoOptions(int argc, const char ** argv);
+static	BOOL	CheckExecOptions(int argc, const char ** argv);
+static	int	RunCommand(const char * varName);
+static	BOOL	PrintSavedOutput(uint64_t fingerprint);
+static	void	SaveOutput(uint64_t fingerprint);
+static	const SAVED_ENTRY *	NextSavedEntry(const char * map,
+			size_t mapSize, size_t * offsetPtr);
+static	int	StatPathsMemo(void * data, PATH_STAT * table, int count,
+			const PATH_CHECK * check);
+static	void	ClearMemo(void);
+static	int	StatPathsCounted(void * data, PATH_STAT * table, int count,
+			const PATH_CHECK * check);
+static	long long	StatsTime(void);
+static	void	EndPhase(int phase, long long * startPtr);
+static	void	AddGroupTime(int argIndex, int pathCount, long long ns);
+static	int	ReportStats(int status);
+static	void	PrintJsonString(const char * str);
+static	const char *	ActionName(ACTION action);
+static	void	PrintPaths(void);
+static	int	HandleShellGroups(int argc, const char ** argv);
+static	SHELL	FindShell(const char * name);
+static	ACTION	FindAction(const char * name);
+static	void	AppendAssignment(OUTPUT * output, const char * varName);
+static	void	AppendQuoted(OUTPUT * output, const char * str);
+static	void	AppendOutput(OUTPUT * output, const char * str);
+static	void	AppendBytes(OUTPUT * output, const char * str, size_t len);
+static	BOOL	IsVariableName(const char * name);
+static	void	AppendPaths(OUTPUT * output);
+#ifdef BASH_BUILTIN
+static	BOOL	SetVariable(const char * varName);
+static	BOOL	SetVariables(const char * buffer);
+#endif
+static	void	InitPaths(void);
+static	unsigned int	HashPath(const char * path);
+static	void	HandlePathList(int listCount, const char ** listTable);
+static	void	ApplyPathList(int listCount, const char ** listTable);
+static	void	HandlePatterns(int listCount, const char ** listTable);
+static	void	SetGlob(GLOB_EXPANSION * expansion, BOOL expand);
+static	BOOL	IsPattern(const char * str);
+static	void	Unescape(char * str);
+static	void	ExpandPatterns(GLOB_EXPANSION * table, int count);
+static	void *	GlobWorker(void * arg);
+static	void	GlobDirectory(GLOB_EXPANSION * expansion, char * path,
+			size_t pathLength, const char * pattern);
+static	void	MatchListPaths(GLOB_EXPANSION * expansion);
+static	void	AddMatch(GLOB_EXPANSION * expansion, const char * path);
+static	void	HandlePath(const char * path, ACTION action);
+static	BOOL	CheckPathList(void);
+static	BOOL	OpenRoot(void);
+static	void	ReportProblem(void * data, const PATH_STAT * info,
+			int problem, const PATH_CHECK * check);
+static	BOOL	HandleOption(const char * name);
+static	int	StatPathsCached(void * data, PATH_STAT * table, int count,
+			const PATH_CHECK * check);
+static	BOOL	GetCacheStamp(const char * path, CACHE_STAMP * stamp,
+			CACHE_PARENT * parents, int parentCount);
+static	BOOL	GetCacheName(const char * fileName, char * buf,
+			int bufSize);
+static	const CACHE_HEADER *	CheckCacheHeader(const char * map,
+			size_t mapSize);
+static	const CACHE_SLOT *	FindCacheSlot(const char * map,
+			size_t mapSize, const char * path);
+static	const PATH_FS_TYPE *	FindCacheFsType(const CACHE_SLOT * slot);
+static	BOOL	WriteCache(const char * map, size_t mapSize,
+			const PATH_STAT * table, const CACHE_STAMP * stamps,
+			const BOOL * validStamps, int count);
+static	const char **	MakePathTable(void);
+static	BOOL	FindCommands(void);
+static	BOOL	FindCommand(const char * image, const char * name,
+			BOOL all, OUTPUT * output);
+static	BOOL	WatchPaths(void);
+#if defined(HAVE_WATCH)
+static	int	OpenWatchSocket(const char * name);
+static	BOOL	AddWatches(int notifyFd, const char ** dirTable,
+			int dirCount, WATCH_ENTRY ** tablePtr, int * countPtr);
+static	BOOL	ReadChanges(int notifyFd, const char ** dirTable,
+			int dirCount, const WATCH_ENTRY * table, int count,
+			BOOL * changed);
+static	BOOL	ReadDirectories(DIR_SCAN * scans, const char ** dirTable,
+			int dirCount, BOOL * changed, char ** imagePtr);
+static	BOOL	ReadRequests(WATCH_CLIENT * client, const char * image,
+			unsigned long generation);
+static	BOOL	HandleRequest(WATCH_CLIENT * client, char * line,
+			const char * image, unsigned long generation);
+static	BOOL	SendGeneration(WATCH_CLIENT * client,
+			unsigned long generation);
+static	BOOL	SendReply(WATCH_CLIENT * client, const char * data,
+			size_t size);
+static	void	StopWatching(int sig);
+#endif
+static	BOOL	ReportShadows(void);
+static	BOOL	CheckClassPath(void);
+static	void	PrintClassName(const char * name, int length);
+static	BOOL	OptimizePaths(void);
+static	BOOL	ReadProfile(const char * image, double * weights,
+			double * totalPtr, double * missingPtr);
+static	void	OrderPaths(int * order, int start, int end,
+			const double * weights, const char * before, int count);
+static	double	LookupCost(const int * order, int count,
+			const double * weights, double missing, double total);
+static	int	CheckLibraryPaths(void);
+#if defined(HAVE_ELF)
+static	BOOL	SimulateLoader(const char * fileName, const char ** dirTable,
+			int dirCount, BOOL * usedTable);
+static	char *	FindLibrary(const ELF_OBJECT * objects, int owner,
+			const char * name, const char ** dirTable, int dirCount,
+			BOOL * usedTable);
+static	char *	SearchLibraryDirs(const char * dirs, const char * owner,
+			const char * name, const ELF_INFO * match);
+static	char *	TryLibrary(const char * dir, int dirLength,
+			const char * name, const ELF_INFO * match);
+static	void	AddLibraryLookup(int found);
+static	int	ReadElf(const char * fileName, ELF_INFO * info);
+static	int	ParseElf(const unsigned char * image, size_t size,
+			ELF_INFO * info);
+static	BOOL	GetElfSegment(const unsigned char * image, size_t size,
+			int elfClass, size_t offset, Elf64_Phdr * segment);
+static	BOOL	GetElfDynamic(const unsigned char * image, size_t size,
+			int elfClass, size_t offset, Elf64_Dyn * entry);
+static	void	FreeElf(ELF_INFO * info);
+#endif
+static	int	SlotSortCallback(const void * addr1, const void * addr2);
+static	char *	BuildIndex(const char ** dirTable, int dirCount,
+			int mode, size_t * sizePtr);
+static	char *	MakeIndex(const DIR_SCAN * scans, const char ** dirTable,
+			int dirCount, size_t * sizePtr);
+static	const char *	CheckIndex(const char * image, size_t size,
+			const char ** dirTable, int dirCount);
+static	const INDEX_SLOT *	FindIndexSlot(const char * image,
+			const char * name);
+static	void	ScanDirectories(DIR_SCAN * table, int count);
+static	void *	ScanWorker(void * arg);
+static	void	ScanDirectory(DIR_SCAN * scan);
+static	BOOL	IsExecutableAt(int dirFd, const char * name);
+static	BOOL	AddScanName(DIR_SCAN * scan, const char * name);
+static	void	ScanClassPath(DIR_SCAN * scan);
+static	void	ScanJarDir(DIR_SCAN * scan, const char * dirName,
+			int dirLength);
+static	void	ScanClassDir(DIR_SCAN * scan, char * path, int rootLength,
+			int length, int depth);
+static	BOOL	ScanJar(DIR_SCAN * scan, const char * path);
+static	BOOL	FindZipDirectory(const unsigned char * image, size_t size,
+			uint64_t * offsetPtr, uint64_t * sizePtr);
+static	unsigned int	GetZip16(const unsigned char * data);
+static	uint32_t	GetZip32(const unsigned char * data);
+static	uint64_t	GetZip64(const unsigned char * data);
+static	BOOL	AddClassName(DIR_SCAN * scan, const char * name,
+			size_t length);
+static	BOOL	GetDirStamp(const char * path, DIR_STAMP * stamp);
+static	unsigned int	HashDirNames(const char ** dirTable, int dirCount);
+static	BOOL	IsExecutable(const char * path);
+static	BOOL	WriteFileSafely(const char * name, const char * buf,
+			size_t size);
+static	int	SortCallback(const void * addr1, const void * addr2);
+static	void	Usage(void);
+
+
+int
+main(int argc, const char ** argv)
+{
+	const char *	varName;
+	const char *	argument;
+	const OPTION *	option;
+	SHELL		shell;
+	ACTION		found;
+	BOOL		fingerprintFlag;
+	BOOL		slow;
+	uint64_t	fingerprint;
+	long long	startTime;
+	int		index;
+	int		result;
+
+	shellType = SHELL_NONE;
+	auditFlag = FALSE;
+	metricsName = NULL;
+
+	/*
+	 * Discard the program name.
+	 */
+	argc--;
+	argv++;
+
+	/*
+	 * If a command is to be run with the new path list, then it and its
+	 * arguments are everything after the option, so they are separated
+	 * from the other arguments before anything else is looked at.
+	 */
+	execArgv = NULL;
+	execWhichFlag = FALSE;
+
+	for (index = 0; index < argc; index++)
+	{
+		if ((strcmp(argv[index], OPTION_EXEC) != 0) &&
+			(strcmp(argv[index], OPTION_EXEC_WHICH) != 0))
+		{
+			continue;
+		}
+
+		if (index + 1 >= argc)
+		{
+			fprintf(stderr, "Missing command for %s\n", argv[index]);
+
+			return 1;
+		}
+
+		execWhichFlag = (strcmp(argv[index], OPTION_EXEC_WHICH) == 0);
+		execArgv = argv + index + 1;
+		argc = index;
+
+		break;
+	}
+
+	/*
+	 * See if the times and counts of the work are to be reported,
+	 * since they are collected from the start.
+	 */
+	statsFlag = FALSE;
+	statsJsonFlag = FALSE;
+	statsArgv = argv;
+	statsGroupCount = 0;
+	statsOtherGroupNs = 0;
+	statCalls = 0;
+	statTotalNs = 0;
+	statSlowestNs = 0;
+	statSlowestPath[0] = '\0';
+
+	for (index = 0; index < PHASE_COUNT; index++)
+		phaseTimes[index] = 0;
+
+	for (index = 0; index < argc; index++)
+	{
+		for (option = optionTable; option->name; option++)
+		{
+			if (strcmp(argv[index], option->name) == 0)
+				break;
+		}
+
+		if (option->action == ACTION_STATS)
+			statsFlag = TRUE;
+
+		if (option->action == ACTION_STATS_JSON)
+		{
+			statsFlag = TRUE;
+			statsJsonFlag = TRUE;
+		}
+	}
+
+	startTime = StatsTime();
+
+	/*
+	 * Allocate a table which can hold all of the command names
+	 * which are to be looked up.
+	 */
+	whichTable = (const char **) malloc(sizeof(const char *) * (argc + 1));
+
+	if (whichTable == NULL)
+	{
+		fprintf(stderr, "Cannot allocate command name table\n");
+
+		return 1;
+	}
+
+	elfTable = (const char **) malloc(sizeof(const char *) * (argc + 1));
+
+	if (elfTable == NULL)
+	{
+		fprintf(stderr, "Cannot allocate ELF file name table\n");
+
+		return 1;
+	}
+
+	/*
+	 * First check for explicit requests for help.
+	 * This can be specified for any argument, in which case all
+	 * of the other arguments are ignored.
+	 */
+	for (index = 0; index < argc; index++)
+	{
+		argument = argv[index];
+
+		if ((strcmp(argument, OPTION_HELP1) == 0) ||
+			(strcmp(argument, OPTION_HELP2) == 0) ||
+			(strcmp(argument, OPTION_HELP3) == 0))
+		{
+			Usage();
+
+			return 1;
+		}
+	}
+
+	if (execArgv && !CheckExecOptions(argc, argv))
+		return 1;
+
+	/*
+	 * See if the output is to be reused from an earlier run with the
+	 * same inputs, or if the fingerprint of the inputs is to be printed
+	 * instead of doing anything else.
+	 */
+	memoFlag = FALSE;
+	fingerprintFlag = FALSE;
+	fingerprint = 0;
+
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if (found == ACTION_MEMO)
+			memoFlag = TRUE;
+		else if (found == ACTION_FINGERPRINT)
+			fingerprintFlag = TRUE;
+	}
+
+	if (fingerprintFlag)
+	{
+		printf("%016llx\n",
+			(unsigned long long) MakeFingerprint(argc, argv,
+				&slow));
+
+		return 0;
+	}
+
+	if (memoFlag)
+	{
+		if (!CheckMemoOptions(argc, argv))
+			return 1;
+
+		fingerprint = MakeFingerprint(argc, argv, &slow);
+
+		/*
+		 * When some of the paths did not respond in time their
+		 * status is not known, so output is neither reused nor saved.
+		 */
+		if (slow)
+			memoFlag = FALSE;
+		else if (PrintSavedOutput(fingerprint))
+			return 0;
+
+		savedOutput.data = NULL;
+		savedOutput.used = 0;
+		savedOutput.size = 0;
+	}
+
+	/*
+	 * See if the output is to be commands for a shell, since that
+	 * changes the meaning of the variable name option.  The last
+	 * shell specified is used.
+	 */
+	for (index = 0; index < argc; index++)
+	{
+		shell = FindShell(argv[index]);
+
+		if (shell != SHELL_NONE)
+			shellType = shell;
+	}
+
+	if (shellType != SHELL_NONE)
+	{
+		EndPhase(PHASE_PARSE, &startTime);
+
+		result = HandleShellGroups(argc, argv);
+
+		if (memoFlag && (result == 0))
+			SaveOutput(fingerprint);
+
+		return ReportStats(result);
+	}
+
+	/*
+	 * See if the path lists are to be read from the input or from a file,
+	 * and the character which ends each of them.
+	 */
+	batchFlag = FALSE;
+	batchDelimiter = '\n';
+	inputName = NULL;
+
+	for (index = 0; index < argc; index++)
+	{
+		for (option = optionTable; option->name; option++)
+		{
+			if (strcmp(argv[index], option->name) == 0)
+				break;
+		}
+
+		if (option->action == ACTION_BATCH)
+		{
+			batchFlag = TRUE;
+			batchDelimiter = '\n';
+		}
+		else if (option->action == ACTION_BATCH_NUL)
+		{
+			batchFlag = TRUE;
+			batchDelimiter = '\0';
+		}
+		else if (strcmp(argv[index], OPTION_INPUT) == 0)
+		{
+			if ((++index >= argc) || (argv[index][0] == '\0'))
+			{
+				fprintf(stderr, "Missing input file name\n");
+
+				return 1;
+			}
+
+			batchFlag = TRUE;
+			inputName = argv[index];
+		}
+	}
+
+	if (batchFlag)
+	{
+#ifdef BASH_BUILTIN
+		fprintf(stderr, "Batches cannot be read in the builtin\n");
+
+		return 1;
+#endif
+		EndPhase(PHASE_PARSE, &startTime);
+
+		return ReportStats(HandleBatch(argc, argv));
+	}
+
+	/*
+	 * See if any argument is the one for the environment variable to
+	 * be manipulated.  If not, then use the normal PATH environment
+	 * variable name.  This check has to be done first so that the
+	 * current path is initialized before it is acted on.  The last
+	 * variable name specified is used.
+	 */
+	varName = "PATH";
+
+	for (index = 0; index < argc; index++)
+	{
+		if (strcmp(argv[index], OPTION_VAR) != 0)
+			continue;
+
+		if ((++index >= argc) || (argv[index][0] == '-'))
+		{
+			fprintf(stderr, "Missing environment variable name\n");
+
+			return 1;
+		}
+
+		varName = argv[index];
+	}
+
+	/*
+	 * See if the path lists in the environments of all of the processes
+	 * are to be audited instead, and where metrics are to be written.
+	 */
+	for (index = 0; index < argc; index++)
+	{
+		if (FindAction(argv[index]) == ACTION_AUDIT)
+			auditFlag = TRUE;
+		else if (strcmp(argv[index], OPTION_METRICS) == 0)
+		{
+			if ((++index >= argc) || (argv[index][0] == '\0'))
+			{
+				fprintf(stderr, "Missing metrics file name\n");
+
+				return 1;
+			}
+
+			metricsName = argv[index];
+		}
+	}
+
+	if (auditFlag)
+	{
+#ifdef BASH_BUILTIN
+		fprintf(stderr, "Processes cannot be audited in the builtin\n");
+
+		return 1;
+#endif
+		EndPhase(PHASE_PARSE, &startTime);
+
+		return ReportStats(HandleAudit(varName, argc, argv));
+	}
+
+	/*
+	 * Work out the new path list and print it if required.
+	 */
+	EndPhase(PHASE_PARSE, &startTime);
+
+	result = HandleVariable(varName, argc, argv);
+
+	/*
+	 * If a command is to be run, then run it now instead of printing
+	 * the path list, unless the paths failed their checks.
+	 */
+	if (execArgv && ((result == RESULT_PRINT) || (result == 0)))
+		return RunCommand(varName);
+
+	if (result != RESULT_PRINT)
+	{
+		if (memoFlag && (result == 0))
+			SaveOutput(fingerprint);
+
+		return ReportStats(result);
+	}
+
+	startTime = StatsTime();
+
+#ifdef BASH_BUILTIN
+	/*
+	 * The builtin sets the variable itself unless a listing is wanted.
+	 */
+	if (!listFlag && !listSortedFlag)
+	{
+		result = (SetVariable(varName) ? 0 : 1);
+		EndPhase(PHASE_OUTPUT, &startTime);
+
+		return ReportStats(result);
+	}
+#endif
+
+	PrintPaths();
+	EndPhase(PHASE_OUTPUT, &startTime);
+
+	if (memoFlag)
+		SaveOutput(fingerprint);
+
+	return ReportStats(0);
+}
+
+
+#ifdef BASH_BUILTIN
+/*
+ * Run the path program as a builtin command of the shell.
+ * The arguments include the command name as for main.
+ * The global state is reset so that this can be called repeatedly.
+ * Returns the exit status for the command.
+ */
+int
+RunPath(int argc, const char ** argv)
+{
+	volatile int	status;
+
+	whichTable = NULL;
+	elfTable = NULL;
+
+	status = setjmp(exitJump);
+
+	if (status == 0)
+		status = PathMain(argc, argv);
+	else
+		status--;
+
+	/*
+	 * Free all of the memory which is still held, and forget the
+	 * globals which pointed to it.
+	 */
+	FreeAllHeld();
+
+	whichTable = NULL;
+	elfTable = NULL;
+	elfLookups = NULL;
+	elfLookupCount = 0;
+	elfLookupSize = 0;
+	memoTable = NULL;
+	memoCount = 0;
+	savedOutput.data = NULL;
+	auditProcess = NULL;
+
+	if (rootFd >= 0)
+		close(rootFd);
+
+	rootFd = -1;
+	rootFdName = NULL;
+
+	fflush(stdout);
+
+	return status;
+}
+
+
+/*
+ * The memory allocated by the builtin, which is in a circular list of
+ * blocks each of which starts with this header.
+ */
+typedef	union	HELD	HELD;
+
+union	HELD
+{
+	struct
+	{
+		HELD *	prev;		/* previous block in list */
+		HELD *	next;		/* next block in list */
+	} link;
+	long double	align;		/* keeps the memory aligned */
+};
+
+static	HELD	heldList = {{&heldList, &heldList}};
+
+
+/*
+ * Allocate memory which is added to the held list.
+ * Returns NULL if it cannot be allocated.
+ */
+static void *
+HeldMalloc(size_t size)
+{
+	HELD *	held;
+
+	if (size > SIZE_MAX - sizeof(HELD))
+		return NULL;
+
+	held = (HELD *) (malloc)(sizeof(HELD) + size);
+
+	if (held == NULL)
+		return NULL;
+
+	held->link.prev = &heldList;
+	held->link.next = heldList.link.next;
+	held->link.next->link.prev = held;
+	heldList.link.next = held;
+
+	return held + 1;
+}
+
+
+/*
+ * Allocate cleared memory for a table which is added to the held list.
+ * Returns NULL if it cannot be allocated.
+ */
+static void *
+HeldCalloc(size_t count, size_t size)
+{
+	void *	ptr;
+
+	if ((size > 0) && (count > SIZE_MAX / size))
+		return NULL;
+
+	ptr = HeldMalloc(count * size);
+
+	if (ptr)
+		memset(ptr, 0, count * size);
+
+	return ptr;
+}
+
+
+/*
+ * Change the size of held memory, which stays in the held list.
+ * Returns NULL if it cannot be reallocated, leaving the old memory.
+ */
+static void *
+HeldRealloc(void * ptr, size_t size)
+{
+	HELD *	held;
+	HELD *	newHeld;
+
+	if (ptr == NULL)
+		return HeldMalloc(size);
+
+	if (size > SIZE_MAX - sizeof(HELD))
+		return NULL;
+
+	held = (HELD *) ptr - 1;
+	newHeld = (HELD *) (realloc)(held, sizeof(HELD) + size);
+
+	if (newHeld == NULL)
+		return NULL;
+
+	newHeld->link.prev->link.next = newHeld;
+	newHeld->link.next->link.prev = newHeld;
+
+	return newHeld + 1;
+}
+
+
+/*
+ * Copy a string into held memory.
+ * Returns NULL if it cannot be allocated.
+ */
+static char *
+HeldStrdup(const char * str)
+{
+	char *	copy;
+	size_t	len;
+
+	len = strlen(str) + 1;
+	copy = (char *) HeldMalloc(len);
+
+	if (copy)
+		memcpy(copy, str, len);
+
+	return copy;
+}
+
+
+/*
+ * Free held memory, removing it from the held list.
+ */
+static void
+HeldFree(void * ptr)
+{
+	HELD *	held;
+
+	if (ptr == NULL)
+		return;
+
+	held = (HELD *) ptr - 1;
+	held->link.prev->link.next = held->link.next;
+	held->link.next->link.prev = held->link.prev;
+
+	(free)(held);
+}
+
+
+/*
+ * Free all of the memory in the held list.
+ */
+static void
+FreeAllHeld(void)
+{
+	while (heldList.link.next != &heldList)
+		HeldFree(heldList.link.next + 1);
+}
+
+
+/*
+ * Set a shell variable to the current path list.
+ * Returns TRUE if the variable was set.
+ */
+static BOOL
+SetVariable(const char * varName)
+{
+	OUTPUT	output;
+	BOOL	status;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	AppendPaths(&output);
+	AppendBytes(&output, "", 1);
+
+	status = BuiltinSetVariable(varName, output.data);
+
+	free(output.data);
+
+	return status;
+}
+
+
+/*
+ * Set shell variables from a buffer holding pairs of variable names and
+ * values, each ending with a null character, with an empty name at the end.
+ * Returns TRUE if all of the variables were set.
+ */
+static BOOL
+SetVariables(const char * buffer)
+{
+	const char *	value;
+	BOOL		status;
+
+	status = TRUE;
+
+	while (*buffer)
+	{
+		value = buffer + strlen(buffer) + 1;
+
+		if (!BuiltinSetVariable(buffer, value))
+			status = FALSE;
+
+		buffer = value + strlen(value) + 1;
+	}
+
+	return status;
+}
+#endif
+
+
+/*
+ * Work out the new path list for an environment variable according to
+ * the command line arguments, leaving it in the set of paths.
+ * Any variable name options in the arguments are skipped.
+ * Returns RESULT_PRINT if the new path list is to be output,
+ * or else the exit status for the program.
+ */
+static int
+HandleVariable(const char * varName, int argc, const char ** argv)
+{
+	const char *	value;
+
+	/*
+	 * Get the value of the environment variable.  Don't complain about
+	 * an undefined environment variable, but treat it as an empty list
+	 * to help shell programmers create a path list from scratch.
+	 */
+	value = getenv(varName);
+
+	if (value == NULL)
+		value = "";
+
+	classVarFlag = (strcmp(varName, CLASS_PATH_VARIABLE) == 0);
+
+	return HandleValue(value, strlen(value), argc, argv);
+}
+
+
+/*
+ * Work out the new path list from a path string of the specified length
+ * according to the command line arguments, leaving it in the set of paths.
+ * Returns RESULT_PRINT if the new path list is to be output,
+ * or else the exit status for the program.
+ */
+static int
+HandleValue(const char * value, size_t length, int argc, const char ** argv)
+{
+	const char **	listTable;
+	const char *	first;
+	const char *	last;
+	ACTION		found;
+	long long	startTime;
+	long long	groupTime;
+	int		listCount;
+	int		index;
+	int		status;
+	BOOL		dotFirst;
+	BOOL		dotLast;
+
+	startTime = StatsTime();
+	action = ACTION_AFTER;
+	disableDotFlag = FALSE;
+	listFlag = FALSE;
+	listSortedFlag = FALSE;
+	allowFilesFlag = FALSE;
+	checkInvalidFlag = FALSE;
+	removeRelativeFlag = FALSE;
+	checkRelativeFlag = FALSE;
+	removeInvalidFlag = FALSE;
+	testPresenceFlag = FALSE;
+	testFailedFlag = FALSE;
+	demoteNetworkFlag = FALSE;
+	reportFsFlag = FALSE;
+	removeAliasesFlag = FALSE;
+	reportAliasesFlag = FALSE;
+	useCacheFlag = FALSE;
+	refreshCacheFlag = FALSE;
+	noCacheFlag = FALSE;
+	timeoutMs = 0;
+	whichFlag = FALSE;
+	whichAllFlag = FALSE;
+	whichCount = 0;
+	indexName = NULL;
+	watchName = NULL;
+	optimizeName = NULL;
+	rootName = NULL;
+	shadowFlag = FALSE;
+	elfCount = 0;
+	elfRemoveFlag = FALSE;
+	classPathFlag = FALSE;
+	classRemoveFlag = FALSE;
+	globFlag = FALSE;
+	dotFirst = FALSE;
+	dotLast = FALSE;
+
+	/*
+	 * Initialize the set of paths with the current path values.
+	 * This also removes all duplicate paths while keeping the first
+	 * occurrence of each one.
+	 */
+	InitPaths();
+
+	/*
+	 * See if the path names are to be normalized, since that has to be
+	 * known before the current paths are loaded.
+	 */
+	normalizeFlag = FALSE;
+	classListFlag = classVarFlag;
+
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if (found == ACTION_NORMALIZE)
+			normalizeFlag = TRUE;
+
+		if ((found == ACTION_CLASS_PATH) ||
+			(found == ACTION_CLASS_REMOVE))
+		{
+			classListFlag = TRUE;
+		}
+	}
+
+	PathSetFlags(pathContext, (normalizeFlag ? PATH_NORMALIZE : 0));
+
+	status = PathLoadBuffer(pathContext, value, length);
+
+	if (status != PATH_OK)
+	{
+		fprintf(stderr, "Cannot load paths: %s\n",
+			PathErrorString(status));
+
+		return 1;
+	}
+
+	loadCount = PathCount(pathContext);
+
+	EndPhase(PHASE_LOAD, &startTime);
+
+	/*
+	 * Remember if the special DOT path is first or last in the list.
+	 */
+	first = PathFirst(pathContext);
+	last = PathLast(pathContext);
+
+	if (first != NULL)
+	{
+		dotFirst = (strcmp(first, DOT_PATH) == 0);
+		dotLast = (strcmp(last, DOT_PATH) == 0);
+	}
+
+	/*
+	 * Now parse the command line options and associated paths.
+	 */
+	while (argc > 0)
+	{
+		/*
+		 * If this is the special variable name option, then
+		 * just skip over it and its argument since it was
+		 * parsed earlier.
+		 */
+		if (strcmp(*argv, OPTION_VAR) == 0)
+		{
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the time limit option, then get the number
+		 * of milliseconds from the following argument, which must
+		 * be a whole number in range.
+		 */
+		if (strcmp(*argv, OPTION_TIMEOUT) == 0)
+		{
+#ifdef BASH_BUILTIN
+			/*
+			 * Paths which do not respond in time are left to
+			 * threads which would stay blocked in the shell.
+			 */
+			fprintf(stderr,
+				"Option \"%s\" cannot be used in the builtin\n",
+				OPTION_TIMEOUT);
+
+			return 1;
+#endif
+			if ((argc < 2) || !ParseTimeout(argv[1], &timeoutMs))
+			{
+				fprintf(stderr, "Missing or invalid timeout\n");
+
+				return 1;
+			}
+
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the input file option, then skip over it
+		 * and its argument since it was parsed earlier.
+		 */
+		if (strcmp(*argv, OPTION_INPUT) == 0)
+		{
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the metrics file option, then check that the
+		 * processes are being audited and skip over it and its
+		 * argument since it was parsed earlier.
+		 */
+		if (strcmp(*argv, OPTION_METRICS) == 0)
+		{
+			if (!auditFlag)
+			{
+				fprintf(stderr, "Option \"%s\" can only be used with -audit\n",
+					*argv);
+
+				return 1;
+			}
+
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the index file option, then get the name
+		 * of the file from the following argument.
+		 */
+		if (strcmp(*argv, OPTION_INDEX) == 0)
+		{
+			if ((argc < 2) || (argv[1][0] == '\0'))
+			{
+				fprintf(stderr, "Missing index file name\n");
+
+				return 1;
+			}
+
+			indexName = argv[1];
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the option to watch the directories, then get
+		 * the name of the socket from the following argument.
+		 * The daemon cannot be run when commands for a shell are
+		 * being output.
+		 */
+		if (strcmp(*argv, OPTION_WATCH) == 0)
+		{
+			if ((argc < 2) || (argv[1][0] == '\0'))
+			{
+				fprintf(stderr, "Missing socket name\n");
+
+				return 1;
+			}
+
+			if (shellType != SHELL_NONE)
+			{
+				fprintf(stderr, "Option \"%s\" cannot be used with shell output\n",
+					*argv);
+
+				return 1;
+			}
+
+			watchName = argv[1];
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the option to reorder the paths, then get the
+		 * name of the profile of commands from the following argument.
+		 */
+		if (strcmp(*argv, OPTION_OPTIMIZE) == 0)
+		{
+			if ((argc < 2) || (argv[1][0] == '\0'))
+			{
+				fprintf(stderr, "Missing profile file name\n");
+
+				return 1;
+			}
+
+			optimizeName = argv[1];
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If this is the option to check the paths within another
+		 * root directory, then get the directory from the following
+		 * argument.
+		 */
+		if (strcmp(*argv, OPTION_ROOT) == 0)
+		{
+			if ((argc < 2) || (argv[1][0] == '\0'))
+			{
+				fprintf(stderr, "Missing root directory name\n");
+
+				return 1;
+			}
+
+			rootName = argv[1];
+			argc -= 2;
+			argv += 2;
+
+			continue;
+		}
+
+		/*
+		 * If the argument is an option then handle that.
+		 */
+		if (**argv == '-')
+		{
+			argc--;
+
+			if (!HandleOption(*argv++))
+				return 1;
+
+			continue;
+		}
+
+		/*
+		 * The argument is not an option so it is a path name.
+		 * Count how many path names are in the argument list before
+		 * the next action (if any) so that we can handle them all
+		 * as a group.
+		 */
+		listTable = argv;
+		listCount = 0;
+
+		while ((argc > 0) && (**argv != '-'))
+		{
+			argc--;
+			argv++;
+			listCount++;
+		}
+
+		/*
+		 * Handle the list of paths which were found.
+		 */
+		groupTime = StatsTime();
+
+		HandlePathList(listCount, listTable);
+
+		if (statsFlag)
+		{
+			AddGroupTime(listTable - statsArgv, listCount,
+				StatsTime() - groupTime);
+		}
+	}
+
+	EndPhase(PHASE_ARGUMENTS, &startTime);
+
+	/*
+	 * If the DOT path is handled specially, then possibly move it
+	 * back to its original position in the list.
+	 */
+	first = PathFirst(pathContext);
+	last = PathLast(pathContext);
+
+	if (!disableDotFlag && (first != NULL) &&
+		(strcmp(first, DOT_PATH) != 0) &&
+		(strcmp(last, DOT_PATH) != 0))
+	{
+		if (dotFirst)
+			HandlePath(DOT_PATH, ACTION_MOVE_BEFORE);
+		else if (dotLast)
+			HandlePath(DOT_PATH, ACTION_MOVE_AFTER);
+	}
+
+	EndPhase(PHASE_DOT, &startTime);
+
+	/*
+	 * Check the paths in the list for validity.
+	 * If an error is returned, then exit with a special status
+	 * without printing the path list.
+	 */
+	if (testFailedFlag)
+		return 2;
+
+	if ((rootName == NULL) && auditFlag)
+		rootName = auditRootName;
+
+	if (rootName && !OpenRoot())
+		return 1;
+
+	status = CheckPathList();
+
+	EndPhase(PHASE_CHECK, &startTime);
+
+	if (!status)
+		return 2;
+
+	/*
+	 * If library paths are to be checked against ELF files, then do
+	 * that now.  When they are only being reported this replaces
+	 * printing the path list, and fails if any were unused.
+	 */
+	if (elfCount > 0)
+	{
+		status = CheckLibraryPaths();
+
+		if (status < 0)
+			return 1;
+
+		if (!elfRemoveFlag)
+		{
+			EndPhase(PHASE_OUTPUT, &startTime);
+
+			return (status ? 2 : 0);
+		}
+	}
+
+	/*
+	 * If the paths are a class path to be checked, then do that now.
+	 * When they are only being reported this replaces printing the
+	 * path list, and fails if there were any problems.
+	 */
+	if (classPathFlag)
+	{
+		status = CheckClassPath();
+
+		if (!classRemoveFlag)
+		{
+			EndPhase(PHASE_OUTPUT, &startTime);
+
+			return (status ? 2 : 0);
+		}
+	}
+
+	/*
+	 * If the paths are to be reordered for a profile of commands,
+	 * then do that now that the final set of paths is known.
+	 */
+	if (optimizeName && !OptimizePaths())
+		return 1;
+
+	/*
+	 * If the directories are to be watched, then serve the index of
+	 * their commands until stopped instead of printing the path list.
+	 */
+	if (watchName)
+		return (WatchPaths() ? 0 : 1);
+
+	/*
+	 * If commands are to be looked up, then do that instead of
+	 * printing the path list, and fail if any were not found.
+	 */
+	if (whichFlag)
+	{
+		status = (FindCommands() ? 0 : 2);
+		EndPhase(PHASE_OUTPUT, &startTime);
+
+		return status;
+	}
+
+	/*
+	 * If shadowed commands are to be reported, then do that instead
+	 * of printing the path list, and fail if there were any.
+	 */
+	if (shadowFlag)
+	{
+		status = (ReportShadows() ? 2 : 0);
+		EndPhase(PHASE_OUTPUT, &startTime);
+
+		return status;
+	}
+
+	/*
+	 * If we were just checking paths, then exit anyway with success.
+	 */
+	if (testPresenceFlag || checkInvalidFlag || checkRelativeFlag)
+		return 0;
+
+	return RESULT_PRINT;
+}
+
+
+/*
+ * Print the final path list, either one path per line (possibly sorted),
+ * or as a string ready to be assigned into a new environment variable.
+ * The output is also kept if it is to be saved for -memo.
+ */
+static void
+PrintPaths(void)
+{
+	const char **	listTable;
+	OUTPUT		output;
+	int		listCount;
+	int		index;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	/*
+	 * If we want a listing of the paths one per line, then do that.
+	 * If the path list is to be sorted, then sort the table first.
+	 * Otherwise make a new path string in the form ready to be assigned
+	 * into a new environment variable.
+	 */
+	if (listFlag || listSortedFlag)
+	{
+		listTable = MakePathTable();
+		listCount = PathCount(pathContext);
+
+		if (listSortedFlag)
+		{
+			qsort(listTable, listCount, sizeof(const char *),
+				SortCallback);
+		}
+
+		for (index = 0; index < listCount; index++)
+		{
+			AppendOutput(&output, listTable[index]);
+			AppendBytes(&output, "\n", 1);
+		}
+
+		free(listTable);
+	}
+	else
+	{
+		AppendPaths(&output);
+		AppendBytes(&output, "\n", 1);
+	}
+
+	if (output.used > 0)
+		fwrite(output.data, 1, output.used, stdout);
+
+	if (memoFlag)
+		AppendBytes(&savedOutput, output.data, output.used);
+
+	free(output.data);
+}
+
+
+/*
+ * Handle each path list read from the input, or from the input file if
+ * one was given, applying the command line arguments to each of them in
+ * turn.  The results are written in the same order with one result for
+ * each path list, ending with the same character as the path lists do.
+ * Only one path list is held in memory at a time, apart from the pages
+ * of the input file which are mapped in.
+ * Returns the exit status for the program.
+ */
+static int
+HandleBatch(int argc, const char ** argv)
+{
+	struct	stat	statbuf;
+	const OPTION *	option;
+	const char *	end;
+	char *		buffer;
+	char *		map;
+	size_t		size;
+	size_t		used;
+	size_t		start;
+	ssize_t		count;
+	int		index;
+	int		result;
+	int		status;
+	int		fd;
+
+	/*
+	 * The path lists do not come from a variable, so they are never
+	 * taken to be class paths because of its name.
+	 */
+	classVarFlag = FALSE;
+
+	/*
+	 * Reject the options which do not produce a path list, before any
+	 * of the input is read.
+	 */
+	for (index = 0; index < argc; index++)
+	{
+		for (option = optionTable; option->name; option++)
+		{
+			if (strcmp(argv[index], option->name) == 0)
+				break;
+		}
+
+		if ((strcmp(argv[index], OPTION_VAR) == 0) ||
+			(strcmp(argv[index], OPTION_WATCH) == 0) ||
+			(option->action == ACTION_LIST) ||
+			(option->action == ACTION_LIST_SORTED) ||
+			(option->action == ACTION_WHICH) ||
+			(option->action == ACTION_SHADOW) ||
+			(option->action == ACTION_ELF) ||
+			(option->action == ACTION_CLASS_PATH) ||
+			(option->action == ACTION_AUDIT))
+		{
+			fprintf(stderr, "Option \"%s\" cannot be used with batch input\n",
+				argv[index]);
+
+			return 1;
+		}
+	}
+
+	setvbuf(stdout, NULL, _IOFBF, BATCH_BUFFER_SIZE);
+
+	recordNumber = 0;
+	status = 0;
+
+	/*
+	 * If there is an input file, then map it and handle the path lists
+	 * directly from the mapped pages.
+	 */
+	if (inputName != NULL)
+	{
+		fd = open(inputName, O_RDONLY);
+
+		if ((fd < 0) || (fstat(fd, &statbuf) < 0))
+		{
+			fprintf(stderr, "Cannot open \"%s\": %s\n", inputName,
+				strerror(errno));
+
+			return 1;
+		}
+
+		size = statbuf.st_size;
+		map = NULL;
+
+		if (size > 0)
+		{
+			map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (map == MAP_FAILED)
+			{
+				fprintf(stderr, "Cannot map \"%s\": %s\n",
+					inputName, strerror(errno));
+
+				close(fd);
+
+				return 1;
+			}
+
+			madvise(map, size, MADV_SEQUENTIAL);
+		}
+
+		close(fd);
+
+		start = 0;
+		result = 0;
+
+		while (start < size)
+		{
+			end = memchr(map + start, batchDelimiter, size - start);
+			used = (end ? (size_t) (end - map) : size) - start;
+
+			result = HandleRecord(map + start, used, argc, argv);
+
+			if (result == 1)
+				break;
+
+			if (result != 0)
+				status = result;
+
+			start += used + 1;
+		}
+
+		if (map != NULL)
+			munmap(map, size);
+
+		fflush(stdout);
+		ClearMemo();
+
+		return ((result == 1) ? 1 : status);
+	}
+
+	/*
+	 * Read the input in chunks, handling each complete path list as it
+	 * is seen, and keeping the incomplete one at the end for the next
+	 * chunk.  The buffer only grows if a single path list is larger.
+	 */
+	size = BATCH_BUFFER_SIZE;
+	used = 0;
+	result = 0;
+	buffer = (char *) malloc(size);
+
+	if (buffer == NULL)
+	{
+		fprintf(stderr, "Cannot allocate input buffer\n");
+
+		return 1;
+	}
+
+	for (;;)
+	{
+		count = read(STDIN_FILENO, buffer + used, size - used);
+
+		if ((count < 0) && (errno == EINTR))
+			continue;
+
+		if (count < 0)
+		{
+			fprintf(stderr, "Cannot read input: %s\n",
+				strerror(errno));
+
+			result = 1;
+
+			break;
+		}
+
+		/*
+		 * At the end of the input, handle the last path list if it
+		 * did not end with the delimiter.
+		 */
+		if (count == 0)
+		{
+			if (used > 0)
+				result = HandleRecord(buffer, used, argc, argv);
+
+			if ((result != 0) && (result != 1))
+				status = result;
+
+			break;
+		}
+
+		used += count;
+		start = 0;
+
+		while ((end = memchr(buffer + start, batchDelimiter,
+			used - start)) != NULL)
+		{
+			result = HandleRecord(buffer + start,
+				(end - buffer) - start, argc, argv);
+
+			if (result == 1)
+				break;
+
+			if (result != 0)
+				status = result;
+
+			start = (end - buffer) + 1;
+		}
+
+		if (result == 1)
+			break;
+
+		memmove(buffer, buffer + start, used - start);
+		used -= start;
+
+		if (used == size)
+		{
+			size *= 2;
+			map = (char *) realloc(buffer, size);
+
+			if (map == NULL)
+			{
+				fprintf(stderr, "Cannot allocate input buffer\n");
+
+				result = 1;
+
+				break;
+			}
+
+			buffer = map;
+		}
+	}
+
+	free(buffer);
+	fflush(stdout);
+	ClearMemo();
+
+	return ((result == 1) ? 1 : status);
+}
+
+
+/*
+ * Handle one path list read in batch mode, and write its result.
+ * This is the new path list, or an empty one if it failed, or if the
+ * paths were just being checked then the exit status as a digit.
+ * Returns the exit status for the path list.
+ */
+static int
+HandleRecord(const char * record, size_t length, int argc,
+	const char ** argv)
+{
+	static	char *	buf;
+	static	size_t	bufSize;
+	size_t		pathLength;
+	long long	startTime;
+	int		result;
+
+	recordNumber++;
+
+	result = HandleValue(record, length, argc, argv);
+
+	if (result == 1)
+		return 1;
+
+	startTime = StatsTime();
+
+	if (testPresenceFlag || checkInvalidFlag || checkRelativeFlag)
+	{
+		putchar('0' + result);
+		putchar(batchDelimiter);
+
+		return result;
+	}
+
+	/*
+	 * A path list which failed gets a lone divider as its result,
+	 * which a path list never is since it has no empty paths.
+	 */
+	if (result != RESULT_PRINT)
+	{
+		putchar(PATH_DIVIDER);
+		putchar(batchDelimiter);
+
+		return result;
+	}
+
+	/*
+	 * Build the path string in a buffer which is kept for the next
+	 * path list, growing it when it is too small.
+	 */
+	while (PathSerialize(pathContext, buf, bufSize, &pathLength) ==
+		PATH_ERR_SPACE)
+	{
+		free(buf);
+
+		bufSize = pathLength + BATCH_BUFFER_SIZE;
+		buf = (char *) malloc(bufSize);
+
+		if (buf == NULL)
+		{
+			fprintf(stderr, "Cannot allocate output buffer\n");
+
+			bufSize = 0;
+
+			return 1;
+		}
+	}
+
+	fwrite(buf, 1, pathLength, stdout);
+	putchar(batchDelimiter);
+
+	EndPhase(PHASE_OUTPUT, &startTime);
+
+	return 0;
+}
+
+
+/*
+ * Audit the path lists in an environment variable of all of the running
+ * processes, applying the command line arguments to each of them as in
+ * batch mode but counting the problems found instead of reporting them.
+ * The environments are read in parallel, each distinct value is only
+ * checked once, and the status of the paths is shared between values.
+ * A line is printed for each process which has the variable, followed by
+ * the totals, which are also written as metrics if a file was given.
+ * Returns the exit status for the program.
+ */
+static int
+HandleAudit(const char * varName, int argc, const char ** argv)
+{
+	AUDIT_PROCESS *		table;
+	AUDIT_PROCESS *		proc;
+	AUDIT_PROCESS **	sorted;
+	AUDIT_TOTALS		totals;
+	struct	dirent *	dirent;
+	DIR *			dir;
+	ACTION			found;
+	char *			end;
+	long			pid;
+	int			sortedCount;
+	int			count;
+	int			size;
+	int			first;
+	int			index;
+	int			result;
+
+	classVarFlag = (strcmp(varName, CLASS_PATH_VARIABLE) == 0);
+
+	/*
+	 * Reject the options which do not produce a path list, or whose
+	 * reports would not be seen.
+	 */
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if ((found == ACTION_LIST) || (found == ACTION_LIST_SORTED) ||
+			(found == ACTION_WHICH) || (found == ACTION_SHADOW) ||
+			(found == ACTION_ELF) || (found == ACTION_CLASS_PATH) ||
+			(found == ACTION_REPORT_FS) ||
+			(strcmp(argv[index], OPTION_WATCH) == 0))
+		{
+			fprintf(stderr, "Option \"%s\" cannot be used with -audit\n",
+				argv[index]);
+
+			return 1;
+		}
+	}
+
+	/*
+	 * Make a table of the processes in the order of their ids.
+	 */
+	dir = opendir(PROC_DIR_NAME);
+
+	if (dir == NULL)
+	{
+		fprintf(stderr, "Cannot open \"%s\": %s\n", PROC_DIR_NAME,
+			strerror(errno));
+
+		return 1;
+	}
+
+	table = NULL;
+	count = 0;
+	size = 0;
+
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		pid = strtol(dirent->d_name, &end, 10);
+
+		if ((pid <= 0) || (*end != '\0'))
+			continue;
+
+		if (count >= size)
+		{
+			size = (size ? size * 2 : 256);
+			proc = (AUDIT_PROCESS *) realloc(table,
+				sizeof(AUDIT_PROCESS) * size);
+
+			if (proc == NULL)
+			{
+				fprintf(stderr, "Cannot allocate process table\n");
+
+				closedir(dir);
+				free(table);
+
+				return 1;
+			}
+
+			table = proc;
+		}
+
+		memset(&table[count], 0, sizeof(AUDIT_PROCESS));
+		table[count++].pid = (pid_t) pid;
+	}
+
+	closedir(dir);
+
+	qsort(table, count, sizeof(AUDIT_PROCESS), ProcessSortCallback);
+
+	ReadProcesses(table, count, varName);
+
+	/*
+	 * Sort the processes with the variable so that the ones with the
+	 * same root directory and value are together, and check the value
+	 * for the first of each of them.
+	 */
+	sorted = (AUDIT_PROCESS **) malloc(sizeof(AUDIT_PROCESS *) *
+		(count + 1));
+
+	if (sorted == NULL)
+	{
+		fprintf(stderr, "Cannot allocate process table\n");
+
+		exit(1);
+	}
+
+	sortedCount = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		if (table[index].value != NULL)
+			sorted[sortedCount++] = &table[index];
+	}
+
+	qsort(sorted, sortedCount, sizeof(AUDIT_PROCESS *), ValueSortCallback);
+
+	memset(&totals, 0, sizeof(totals));
+
+	first = 0;
+	result = 0;
+
+	for (index = 0; index < sortedCount; index++)
+	{
+		proc = sorted[index];
+
+		if ((index > 0) && (ValueSortCallback(&sorted[first],
+			&sorted[index]) == 0))
+		{
+			proc->paths = sorted[first]->paths;
+			proc->duplicates = sorted[first]->duplicates;
+			proc->invalid = sorted[first]->invalid;
+			proc->relative = sorted[first]->relative;
+
+			continue;
+		}
+
+		first = index;
+		totals.distinctCount++;
+
+		result = AuditValue(proc, argc, argv);
+
+		if (result == 1)
+			break;
+	}
+
+	ClearMemo();
+
+	/*
+	 * Print the results for each process and then the totals.
+	 */
+	if (result != 1)
+	{
+		for (proc = table; proc < &table[count]; proc++)
+		{
+			AddAuditTotals(&totals, proc);
+
+			if (proc->value == NULL)
+				continue;
+
+			printf("%ld %s: %d paths, %ld bytes, %d duplicate, "
+				"%d invalid, %d relative\n", (long) proc->pid,
+				proc->name, proc->paths, (long) proc->length,
+				proc->duplicates, proc->invalid, proc->relative);
+		}
+
+		printf("%d processes with %s, %d distinct values, "
+			"%d without it, %d unreadable\n", totals.setCount,
+			varName, totals.distinctCount, totals.unsetCount,
+			totals.unreadableCount);
+
+		printf("%d with duplicate, %d with invalid, "
+			"%d with relative paths\n", totals.duplicateCount,
+			totals.invalidCount, totals.relativeCount);
+
+		result = ((totals.duplicateCount || totals.invalidCount ||
+			totals.relativeCount) ? 2 : 0);
+	}
+
+	if ((result != 1) && metricsName && !WriteMetrics(varName, &totals))
+	{
+		fprintf(stderr, "Cannot write metrics file \"%s\": %s\n",
+			metricsName, strerror(errno));
+
+		result = 1;
+	}
+
+	for (index = 0; index < count; index++)
+		free(table[index].value);
+
+	free(sorted);
+	free(table);
+
+	return result;
+}
+
+
+/*
+ * Check the path list of a process which has not been seen before,
+ * counting its problems.  A process whose root directory is not the
+ * same as ours has its paths checked within its root directory unless
+ * another one was given, and then the status of its paths is not shared.
+ * Returns the exit status for the path list, which is 1 for a fatal error.
+ */
+static int
+AuditValue(AUDIT_PROCESS * proc, int argc, const char ** argv)
+{
+	char	rootPath[64];
+	size_t	index;
+	int	result;
+
+	auditProcess = proc;
+	auditRootName = NULL;
+	recordNumber++;
+
+	if (!proc->ownRoot)
+	{
+		snprintf(rootPath, sizeof(rootPath), "%s/%ld/root",
+			PROC_DIR_NAME, (long) proc->pid);
+
+		auditRootName = rootPath;
+	}
+
+	result = HandleValue(proc->value, proc->length, argc, argv);
+
+	auditRootName = NULL;
+
+	if (result == 1)
+		return 1;
+
+	/*
+	 * Duplicates were removed when the value was loaded, so they are
+	 * the paths in the value which did not become a separate path.
+	 */
+	proc->paths = (proc->length > 0);
+
+	for (index = 0; index < proc->length; index++)
+	{
+		if (proc->value[index] == PATH_DIVIDER)
+			proc->paths++;
+	}
+
+	proc->duplicates += proc->paths - loadCount;
+
+	return result;
+}
+
+
+/*
+ * Read the environments of a table of processes using a group of threads
+ * which each take the next process from the table until they are all done.
+ */
+static void
+ReadProcesses(AUDIT_PROCESS * table, int count, const char * varName)
+{
+	AUDIT_BATCH	batch;
+	pthread_t	threads[AUDIT_MAX_WORKERS];
+	int		threadCount;
+
+	batch.table = table;
+	batch.count = count;
+	batch.next = 0;
+	batch.varName = varName;
+
+	if (stat("/", &batch.rootStat) < 0)
+		memset(&batch.rootStat, 0, sizeof(batch.rootStat));
+
+	for (threadCount = 0; START_WORKERS &&
+		(threadCount < AUDIT_MAX_WORKERS) &&
+		(threadCount < count - 1); threadCount++)
+	{
+		if (pthread_create(&threads[threadCount], NULL,
+			AuditWorker, &batch) != 0)
+		{
+			break;
+		}
+	}
+
+	AuditWorker(&batch);
+
+	while (threadCount-- > 0)
+		pthread_join(threads[threadCount], NULL);
+}
+
+
+/*
+ * Thread routine which reads the environments of processes from a batch
+ * until there are none left.
+ */
+static void *
+AuditWorker(void * arg)
+{
+	AUDIT_BATCH *	batch;
+	int		index;
+
+	batch = (AUDIT_BATCH *) arg;
+
+	while ((index = __sync_fetch_and_add(&batch->next, 1)) < batch->count)
+	{
+		ReadProcess(&batch->table[index], batch->varName,
+			&batch->rootStat);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Read the value of a variable from the environment of a process, along
+ * with its command name and the identity of its root directory.  This is
+ * the environment the process was started with, since any changes it has
+ * made to it since are not visible.
+ */
+static void
+ReadProcess(AUDIT_PROCESS * proc, const char * varName,
+	const struct stat * rootStat)
+{
+	struct	stat	statbuf;
+	char		rootPath[64];
+	char *		env;
+	char *		str;
+	char *		name;
+	size_t		nameLength;
+	size_t		size;
+
+	env = ReadProcFile(proc->pid, "environ", &size);
+
+	if (env == NULL)
+	{
+		proc->error = errno;
+
+		return;
+	}
+
+	proc->empty = (size == 0);
+	nameLength = strlen(varName);
+
+	for (str = env; str < env + size; str += strlen(str) + 1)
+	{
+		if ((strncmp(str, varName, nameLength) != 0) ||
+			(str[nameLength] != '='))
+		{
+			continue;
+		}
+
+		str += nameLength + 1;
+		proc->length = strlen(str);
+		proc->value = strdup(str);
+
+		if (proc->value == NULL)
+			proc->error = ENOMEM;
+
+		break;
+	}
+
+	free(env);
+
+	name = ReadProcFile(proc->pid, "comm", &size);
+
+	if (name != NULL)
+	{
+		if ((size > 0) && (name[size - 1] == '\n'))
+			name[size - 1] = '\0';
+
+		snprintf(proc->name, sizeof(proc->name), "%s", name);
+		free(name);
+	}
+
+	snprintf(rootPath, sizeof(rootPath), "%s/%ld/root", PROC_DIR_NAME,
+		(long) proc->pid);
+
+	proc->ownRoot = TRUE;
+	proc->rootDev = rootStat->st_dev;
+	proc->rootIno = rootStat->st_ino;
+
+	if (stat(rootPath, &statbuf) == 0)
+	{
+		proc->rootDev = statbuf.st_dev;
+		proc->rootIno = statbuf.st_ino;
+		proc->ownRoot = ((statbuf.st_dev == rootStat->st_dev) &&
+			(statbuf.st_ino == rootStat->st_ino));
+	}
+}
+
+
+/*
+ * Read all of a file of a process from the proc filesystem, whose size
+ * cannot be found beforehand.  The contents are followed by a null
+ * character which is not included in the size.
+ * Returns the allocated contents, or NULL with errno set on an error.
+ */
+static char *
+ReadProcFile(pid_t pid, const char * fileName, size_t * sizePtr)
+{
+	char	name[64];
+	char *	buf;
+	char *	newBuf;
+	size_t	size;
+	size_t	used;
+	ssize_t	count;
+	int	error;
+	int	fd;
+
+	snprintf(name, sizeof(name), "%s/%ld/%s", PROC_DIR_NAME, (long) pid,
+		fileName);
+
+	fd = open(name, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return NULL;
+
+	size = ENVIRON_BUFFER_SIZE;
+	used = 0;
+	buf = (char *) malloc(size);
+	error = ENOMEM;
+
+	while (buf != NULL)
+	{
+		if (used + 1 >= size)
+		{
+			size *= 2;
+			newBuf = (char *) realloc(buf, size);
+
+			if (newBuf == NULL)
+			{
+				free(buf);
+				buf = NULL;
+
+				break;
+			}
+
+			buf = newBuf;
+		}
+
+		count = read(fd, buf + used, size - used - 1);
+
+		if ((count < 0) && (errno == EINTR))
+			continue;
+
+		if (count < 0)
+		{
+			error = errno;
+			free(buf);
+			buf = NULL;
+
+			break;
+		}
+
+		if (count == 0)
+		{
+			buf[used] = '\0';
+			*sizePtr = used;
+
+			break;
+		}
+
+		used += count;
+	}
+
+	close(fd);
+
+	if (buf == NULL)
+		errno = error;
+
+	return buf;
+}
+
+
+/*
+ * Add the results for a process to the totals.  Processes which have
+ * exited since they were seen are ignored, as are kernel threads, which
+ * have empty environments.
+ */
+static void
+AddAuditTotals(AUDIT_TOTALS * totals, const AUDIT_PROCESS * proc)
+{
+	if ((proc->error == ENOENT) || (proc->error == ESRCH))
+		return;
+
+	if (proc->error)
+	{
+		totals->unreadableCount++;
+
+		return;
+	}
+
+	if (proc->empty)
+		return;
+
+	if (proc->value == NULL)
+	{
+		totals->unsetCount++;
+
+		return;
+	}
+
+	totals->setCount++;
+	totals->duplicateCount += (proc->duplicates > 0);
+	totals->invalidCount += (proc->invalid > 0);
+	totals->relativeCount += (proc->relative > 0);
+	totals->duplicatePaths += proc->duplicates;
+	totals->invalidPaths += proc->invalid;
+	totals->relativePaths += proc->relative;
+
+	if (proc->paths > totals->maxPaths)
+		totals->maxPaths = proc->paths;
+
+	if (proc->length > totals->maxBytes)
+		totals->maxBytes = proc->length;
+}
+
+
+/*
+ * Write the totals of an audit to the metrics file in the text format
+ * read by the textfile collector of the Prometheus node exporter.  The
+ * file is replaced in one step so that a partial file is never read,
+ * and is made readable by the exporter.
+ * Returns TRUE if the file was written.
+ */
+static BOOL
+WriteMetrics(const char * varName, const AUDIT_TOTALS * totals)
+{
+	OUTPUT		output;
+	OUTPUT		labels;
+	const char *	str;
+	BOOL		status;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	labels.data = NULL;
+	labels.used = 0;
+	labels.size = 0;
+
+	/*
+	 * Make the label for the variable, escaping characters as needed.
+	 */
+	AppendOutput(&labels, "variable=\"");
+
+	for (str = varName; *str; str++)
+	{
+		if ((*str == '"') || (*str == '\\'))
+			AppendBytes(&labels, "\\", 1);
+
+		if (*str == '\n')
+			AppendOutput(&labels, "\\n");
+		else
+			AppendBytes(&labels, str, 1);
+	}
+
+	AppendBytes(&labels, "\"", 2);
+
+	AppendMetricHelp(&output, "path_audit_processes",
+		"Processes by whether the variable could be read and was set.");
+	AppendMetric(&output, "path_audit_processes", labels.data,
+		"state=\"set\"", totals->setCount);
+	AppendMetric(&output, "path_audit_processes", labels.data,
+		"state=\"unset\"", totals->unsetCount);
+	AppendMetric(&output, "path_audit_processes", labels.data,
+		"state=\"unreadable\"", totals->unreadableCount);
+
+	AppendMetricHelp(&output, "path_audit_distinct_values",
+		"Distinct values of the variable.");
+	AppendMetric(&output, "path_audit_distinct_values", labels.data,
+		NULL, totals->distinctCount);
+
+	AppendMetricHelp(&output, "path_audit_problem_processes",
+		"Processes whose path list has paths with the problem.");
+	AppendMetric(&output, "path_audit_problem_processes", labels.data,
+		"problem=\"duplicate\"", totals->duplicateCount);
+	AppendMetric(&output, "path_audit_problem_processes", labels.data,
+		"problem=\"invalid\"", totals->invalidCount);
+	AppendMetric(&output, "path_audit_problem_processes", labels.data,
+		"problem=\"relative\"", totals->relativeCount);
+
+	AppendMetricHelp(&output, "path_audit_problem_paths",
+		"Paths with the problem in the path lists of all processes.");
+	AppendMetric(&output, "path_audit_problem_paths", labels.data,
+		"problem=\"duplicate\"", totals->duplicatePaths);
+	AppendMetric(&output, "path_audit_problem_paths", labels.data,
+		"problem=\"invalid\"", totals->invalidPaths);
+	AppendMetric(&output, "path_audit_problem_paths", labels.data,
+		"problem=\"relative\"", totals->relativePaths);
+
+	AppendMetricHelp(&output, "path_audit_max_paths",
+		"Most paths in the path list of any process.");
+	AppendMetric(&output, "path_audit_max_paths", labels.data,
+		NULL, totals->maxPaths);
+
+	AppendMetricHelp(&output, "path_audit_max_bytes",
+		"Longest value of the variable of any process.");
+	AppendMetric(&output, "path_audit_max_bytes", labels.data,
+		NULL, (long) totals->maxBytes);
+
+	status = WriteFileSafely(metricsName, output.data, output.used);
+
+	if (status && (chmod(metricsName, 0644) < 0))
+		status = FALSE;
+
+	free(output.data);
+	free(labels.data);
+
+	return status;
+}
+
+
+/*
+ * Append the description and type of a metric to the output.
+ */
+static void
+AppendMetricHelp(OUTPUT * output, const char * name, const char * help)
+{
+	AppendOutput(output, "# HELP ");
+	AppendOutput(output, name);
+	AppendOutput(output, " ");
+	AppendOutput(output, help);
+	AppendOutput(output, "\n# TYPE ");
+	AppendOutput(output, name);
+	AppendOutput(output, " gauge\n");
+}
+
+
+/*
+ * Append the value of a metric to the output, with the specified labels
+ * and another label if that is not NULL.
+ */
+static void
+AppendMetric(OUTPUT * output, const char * name, const char * labels,
+	const char * extraLabel, long value)
+{
+	char	buf[32];
+
+	AppendOutput(output, name);
+	AppendOutput(output, "{");
+	AppendOutput(output, labels);
+
+	if (extraLabel != NULL)
+	{
+		AppendOutput(output, ",");
+		AppendOutput(output, extraLabel);
+	}
+
+	snprintf(buf, sizeof(buf), "} %ld\n", value);
+	AppendOutput(output, buf);
+}
+
+
+/*
+ * Sort routine for the table of processes to order them by their ids.
+ */
+static int
+ProcessSortCallback(const void * addr1, const void * addr2)
+{
+	const AUDIT_PROCESS *	proc1;
+	const AUDIT_PROCESS *	proc2;
+
+	proc1 = (const AUDIT_PROCESS *) addr1;
+	proc2 = (const AUDIT_PROCESS *) addr2;
+
+	if (proc1->pid != proc2->pid)
+		return ((proc1->pid < proc2->pid) ? -1 : 1);
+
+	return 0;
+}
+
+
+/*
+ * Sort routine for a table of pointers to processes to group the ones
+ * with the same root directory and value of the variable together.
+ */
+static int
+ValueSortCallback(const void * addr1, const void * addr2)
+{
+	const AUDIT_PROCESS *	proc1;
+	const AUDIT_PROCESS *	proc2;
+
+	proc1 = *((const AUDIT_PROCESS * const *) addr1);
+	proc2 = *((const AUDIT_PROCESS * const *) addr2);
+
+	if (proc1->rootDev != proc2->rootDev)
+		return ((proc1->rootDev < proc2->rootDev) ? -1 : 1);
+
+	if (proc1->rootIno != proc2->rootIno)
+		return ((proc1->rootIno < proc2->rootIno) ? -1 : 1);
+
+	if (proc1->length != proc2->length)
+		return ((proc1->length < proc2->length) ? -1 : 1);
+
+	return memcmp(proc1->value, proc2->value, proc1->length);
+}
+
+
+/*
+ * Make the fingerprint of the inputs of a run for -memo.  This is a hash
+ * of the arguments, the values of the variables they use, and the status
+ * of the absolute paths in the values and of the other arguments which
+ * are not options, which includes the modification times of directories.
+ * The working directory is included if a value contains relative paths.
+ * The -memo and -fingerprint options themselves are left out so that the
+ * fingerprint printed is that of the same command without it.  The flag
+ * is set if the status of some of the paths was not found in time.
+ */
+static uint64_t
+MakeFingerprint(int argc, const char ** argv, BOOL * slowPtr)
+{
+	ACTION		found;
+	STAMP_TABLE	stamps;
+	uint64_t	hash;
+	char		cwd[PATH_MAX];
+	BOOL		relative;
+	int		index;
+
+	*slowPtr = FALSE;
+
+	hash = HashBytes(FINGERPRINT_BASIS, VERSION, sizeof(VERSION));
+
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if ((found == ACTION_MEMO) || (found == ACTION_FINGERPRINT))
+			continue;
+
+		hash = HashBytes(hash, argv[index], strlen(argv[index]) + 1);
+	}
+
+	stamps.table = NULL;
+	stamps.count = 0;
+	stamps.size = 0;
+
+	relative = FALSE;
+	hash = HashVariable(hash, "PATH", &stamps, &relative);
+
+	for (index = 0; index < argc - 1; index++)
+	{
+		if (strcmp(argv[index], OPTION_VAR) == 0)
+		{
+			hash = HashVariable(hash, argv[++index], &stamps,
+				&relative);
+		}
+	}
+
+	for (index = 0; index < argc; index++)
+	{
+		if (argv[index][0] != '-')
+			AddStamp(&stamps, argv[index]);
+	}
+
+	hash = HashStamps(hash, &stamps, argc, argv, slowPtr);
+
+	for (index = 0; index < stamps.count; index++)
+		free((char *) stamps.table[index].path);
+
+	free(stamps.table);
+
+	if (relative && (getcwd(cwd, sizeof(cwd)) != NULL))
+		hash = HashBytes(hash, cwd, strlen(cwd) + 1);
+
+	return hash;
+}
+
+
+/*
+ * Add the name and value of a variable to a fingerprint, and add each
+ * absolute path in its value to the table of paths whose status is
+ * added later.  The flag is set if there are any relative paths in the
+ * value.
+ * Returns the new hash value.
+ */
+static uint64_t
+HashVariable(uint64_t hash, const char * varName, STAMP_TABLE * stamps,
+	BOOL * relativePtr)
+{
+	const char *	value;
+	const char *	end;
+	char		path[PATH_MAX];
+	size_t		length;
+
+	hash = HashBytes(hash, varName, strlen(varName) + 1);
+
+	value = getenv(varName);
+
+	if (value == NULL)
+		return HashBytes(hash, "", 1);
+
+	hash = HashBytes(hash, "=", 1);
+	hash = HashBytes(hash, value, strlen(value) + 1);
+
+	if (*value == '\0')
+		return hash;
+
+	for (;;)
+	{
+		end = strchr(value, PATH_DIVIDER);
+		length = (end ? (size_t) (end - value) : strlen(value));
+
+		if ((length == 0) || (*value != ROOT_CHARACTER))
+			*relativePtr = TRUE;
+		else if (length < sizeof(path))
+		{
+			memcpy(path, value, length);
+			path[length] = '\0';
+
+			AddStamp(stamps, path);
+		}
+
+		if (end == NULL)
+			return hash;
+
+		value = end + 1;
+	}
+}
+
+
+/*
+ * Add the status of the paths in a table to a fingerprint.  Their status
+ * is found the same way as the run will check them, which is with its
+ * time limit and within its root directory, so those options are found
+ * from the arguments since they have not been handled yet.  The status
+ * of the root directory itself is also added.  The flag is set if some
+ * of the paths did not respond in time.
+ * Returns the new hash value.
+ */
+static uint64_t
+HashStamps(uint64_t hash, STAMP_TABLE * stamps, int argc,
+	const char ** argv, BOOL * slowPtr)
+{
+	PATH_CHECK	check;
+	PATH_STAT	rootInfo;
+	const char *	stampRootName;
+	int		error;
+	int		index;
+
+	memset(&check, 0, sizeof(check));
+	check.rootFd = -1;
+	stampRootName = NULL;
+
+	for (index = 0; index < argc - 1; index++)
+	{
+		if (strcmp(argv[index], OPTION_ROOT) == 0)
+			stampRootName = argv[++index];
+#ifndef BASH_BUILTIN
+		else if (strcmp(argv[index], OPTION_TIMEOUT) == 0)
+			ParseTimeout(argv[++index], &check.timeoutMs);
+#endif
+	}
+
+#ifdef BASH_BUILTIN
+	check.flags |= PATH_SERIAL;
+#endif
+
+	/*
+	 * The root directory is found on its own first, since the others
+	 * cannot be found if it cannot be opened.
+	 */
+	if (stampRootName)
+	{
+		memset(&rootInfo, 0, sizeof(rootInfo));
+		rootInfo.path = stampRootName;
+
+		if (PathStat(&rootInfo, 1, &check) != PATH_OK)
+			rootInfo.slow = TRUE;
+
+		hash = HashStamp(hash, &rootInfo, slowPtr);
+
+		if (rootInfo.slow || rootInfo.error)
+			return hash;
+
+		check.rootFd = open(stampRootName,
+			O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+		if (check.rootFd < 0)
+		{
+			error = errno;
+
+			return HashBytes(hash, &error, sizeof(error));
+		}
+
+		check.flags |= PATH_IN_ROOT;
+	}
+
+	if (PathStat(stamps->table, stamps->count, &check) != PATH_OK)
+	{
+		for (index = 0; index < stamps->count; index++)
+			stamps->table[index].slow = TRUE;
+	}
+
+	for (index = 0; index < stamps->count; index++)
+		hash = HashStamp(hash, &stamps->table[index], slowPtr);
+
+	if (check.rootFd >= 0)
+		close(check.rootFd);
+
+	return hash;
+}
+
+
+/*
+ * Add the status of a path to a fingerprint, which is its identity,
+ * mode, and modification and change times, or the error finding it.
+ * A path which did not respond in time only adds that, and sets the
+ * flag.
+ * Returns the new hash value.
+ */
+static uint64_t
+HashStamp(uint64_t hash, const PATH_STAT * info, BOOL * slowPtr)
+{
+	uint64_t	stamp[7];
+
+	if (info->slow)
+	{
+		*slowPtr = TRUE;
+
+		return HashBytes(hash, "slow", 5);
+	}
+
+	if (info->error)
+		return HashBytes(hash, &info->error, sizeof(info->error));
+
+	stamp[0] = info->dev;
+	stamp[1] = info->ino;
+	stamp[2] = info->mode;
+	stamp[3] = info->mtime.tv_sec;
+	stamp[4] = info->mtime.tv_nsec;
+	stamp[5] = info->ctime.tv_sec;
+	stamp[6] = info->ctime.tv_nsec;
+
+	return HashBytes(hash, stamp, sizeof(stamp));
+}
+
+
+/*
+ * Add a copy of a path to the table of paths whose status is part of
+ * a fingerprint.
+ */
+static void
+AddStamp(STAMP_TABLE * stamps, const char * path)
+{
+	PATH_STAT *	table;
+	char *		copy;
+
+	if (stamps->count >= stamps->size)
+	{
+		stamps->size = (stamps->size ? stamps->size * 2 : 64);
+		table = (PATH_STAT *) realloc(stamps->table,
+			sizeof(PATH_STAT) * stamps->size);
+
+		if (table == NULL)
+		{
+			fprintf(stderr, "Cannot allocate fingerprint table\n");
+			exit(1);
+		}
+
+		stamps->table = table;
+	}
+
+	copy = strdup(path);
+
+	if (copy == NULL)
+	{
+		fprintf(stderr, "Cannot allocate fingerprint table\n");
+		exit(1);
+	}
+
+	memset(&stamps->table[stamps->count], 0, sizeof(PATH_STAT));
+	stamps->table[stamps->count++].path = copy;
+}
+
+
+/*
+ * Parse the number of milliseconds for the -timeout option, which must
+ * be a whole number in range.  The value is only stored if it is valid.
+ * Returns TRUE if it was valid.
+ */
+static BOOL
+ParseTimeout(const char * text, int * timeoutPtr)
+{
+	char *	end;
+	long	number;
+
+	errno = 0;
+	number = strtol(text, &end, 10);
+
+	if ((end == text) || (*end != '\0') || (errno != 0) ||
+		(number <= 0) || (number > TIMEOUT_MAX_MS))
+	{
+		return FALSE;
+	}
+
+	*timeoutPtr = (int) number;
+
+	return TRUE;
+}
+
+
+/*
+ * Add bytes to a fingerprint using the 64 bit FNV-1a hash.
+ * Returns the new hash value.
+ */
+static uint64_t
+HashBytes(uint64_t hash, const void * data, size_t size)
+{
+	const unsigned char *	bytes;
+
+	bytes = (const unsigned char *) data;
+
+	while (size-- > 0)
+	{
+		hash ^= *bytes++;
+		hash *= FINGERPRINT_PRIME;
+	}
+
+	return hash;
+}
+
+
+/*
+ * Check that the options can be used with -memo, which only saves the
+ * path list or the commands for a shell when nothing else is reported.
+ * Options which print anything else or report to standard error when
+ * they succeed, or which read other input, cannot be used with it.
+ * Returns TRUE if all of the options can be used.
+ */
+static BOOL
+CheckMemoOptions(int argc, const char ** argv)
+{
+#ifdef BASH_BUILTIN
+	fprintf(stderr, "Option \"-memo\" cannot be used in the builtin\n");
+
+	return FALSE;
+#else
+	ACTION	found;
+	int	index;
+
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if ((found == ACTION_WHICH) || (found == ACTION_SHADOW) ||
+			(found == ACTION_ELF) || (found == ACTION_ELF_REMOVE) ||
+			(found == ACTION_CLASS_PATH) ||
+			(found == ACTION_CLASS_REMOVE) ||
+			(found == ACTION_BATCH) || (found == ACTION_BATCH_NUL) ||
+			(found == ACTION_AUDIT) || (found == ACTION_STATS) ||
+			(found == ACTION_STATS_JSON) ||
+			(found == ACTION_REPORT_FS) ||
+			(found == ACTION_REPORT_ALIASES) ||
+			(found == ACTION_REFRESH_CACHE) ||
+			(found == ACTION_GLOB) ||
+			(strcmp(argv[index], OPTION_OPTIMIZE) == 0) ||
+			(strcmp(argv[index], OPTION_INPUT) == 0) ||
+			(strcmp(argv[index], OPTION_METRICS) == 0) ||
+			(strcmp(argv[index], OPTION_WATCH) == 0))
+		{
+			fprintf(stderr, "Option \"%s\" cannot be used with -memo\n",
+				argv[index]);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+#endif
+}
+
+
+/*
+ * Check that the options given before -exec are ones which produce a new
+ * path list for the command to be run with.  Options which print other
+ * things, or which read other input, cannot be used with it.
+ * Returns TRUE if the options are allowed.
+ */
+static BOOL
+CheckExecOptions(int argc, const char ** argv)
+{
+#ifdef BASH_BUILTIN
+	fprintf(stderr, "Option \"-exec\" cannot be used in the builtin\n");
+
+	return FALSE;
+#else
+	ACTION	found;
+	int	index;
+
+	for (index = 0; index < argc; index++)
+	{
+		found = FindAction(argv[index]);
+
+		if ((found == ACTION_LIST) || (found == ACTION_LIST_SORTED) ||
+			(found == ACTION_WHICH) || (found == ACTION_SHADOW) ||
+			(found == ACTION_ELF) || (found == ACTION_CLASS_PATH) ||
+			(found == ACTION_SHELL_SH) ||
+			(found == ACTION_SHELL_CSH) ||
+			(found == ACTION_SHELL_FISH) ||
+			(found == ACTION_BATCH) || (found == ACTION_BATCH_NUL) ||
+			(found == ACTION_AUDIT) || (found == ACTION_MEMO) ||
+			(found == ACTION_FINGERPRINT) ||
+			(strcmp(argv[index], OPTION_INPUT) == 0) ||
+			(strcmp(argv[index], OPTION_METRICS) == 0) ||
+			(strcmp(argv[index], OPTION_WATCH) == 0))
+		{
+			fprintf(stderr, "Option \"%s\" cannot be used with -exec\n",
+				argv[index]);
+
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+#endif
+}
+
+
+/*
+ * Run the command given after -exec in place of this program, with the
+ * variable set in its environment to the final path list.  The command
+ * is found using PATH as usual, which is the new path list if that is the
+ * variable, or in the final path list itself for -execw.
+ * Only returns if the command could not be run, in which case the exit
+ * status is 127 if it was not found and 126 otherwise, as for the shell.
+ */
+static int
+RunCommand(const char * varName)
+{
+	const char **	dirTable;
+	const char *	command;
+	char		fullPath[PATH_MAX];
+	OUTPUT		output;
+	int		dirCount;
+	int		index;
+	int		error;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	AppendPaths(&output);
+	AppendBytes(&output, "", 1);
+
+	if (setenv(varName, output.data, 1) != 0)
+	{
+		fprintf(stderr, "Cannot set variable \"%s\": %s\n", varName,
+			strerror(errno));
+
+		free(output.data);
+
+		return ReportStats(126);
+	}
+
+	free(output.data);
+
+	/*
+	 * For -execw, find the first executable file with the name of the
+	 * command in the final path list, as done for -which.
+	 */
+	command = execArgv[0];
+
+	if (execWhichFlag && (strchr(command, ROOT_CHARACTER) == NULL))
+	{
+		dirCount = PathCount(pathContext);
+		dirTable = (const char **) malloc(sizeof(const char *) *
+			(dirCount + 1));
+
+		if (dirTable == NULL)
+		{
+			fprintf(stderr, "Cannot allocate path table\n");
+
+			return ReportStats(126);
+		}
+
+		PathTable(pathContext, dirTable);
+
+		for (index = 0; index < dirCount; index++)
+		{
+			if ((snprintf(fullPath, sizeof(fullPath), "%s/%s",
+				dirTable[index], command) <
+					(int) sizeof(fullPath)) &&
+				IsExecutable(fullPath))
+			{
+				break;
+			}
+		}
+
+		free(dirTable);
+
+		if (index >= dirCount)
+		{
+			fprintf(stderr, "Command \"%s\" not found\n", command);
+
+			return ReportStats(127);
+		}
+
+		command = fullPath;
+	}
+
+	ReportStats(0);
+	fflush(stderr);
+
+	if (execWhichFlag)
+		execv(command, (char * const *) execArgv);
+	else
+		execvp(command, (char * const *) execArgv);
+
+	error = errno;
+
+	fprintf(stderr, "Cannot run \"%s\": %s\n", command, strerror(error));
+
+	return ((error == ENOENT) ? 127 : 126);
+}
+
+
+/*
+ * Print the output saved by an earlier run whose inputs had the same
+ * fingerprint, if there is one.
+ * Returns TRUE if the saved output was printed.
+ */
+static BOOL
+PrintSavedOutput(uint64_t fingerprint)
+{
+	const SAVED_ENTRY *	entry;
+	struct	stat		statbuf;
+	char			savedName[PATH_MAX];
+	char *			map;
+	size_t			mapSize;
+	size_t			offset;
+	BOOL			found;
+	int			fd;
+
+	if (!GetCacheName(SAVED_FILE_NAME, savedName, sizeof(savedName)))
+		return FALSE;
+
+	fd = open(savedName, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+		return FALSE;
+
+	if ((fstat(fd, &statbuf) < 0) ||
+		(statbuf.st_size < (off_t) sizeof(SAVED_HEADER)))
+	{
+		close(fd);
+
+		return FALSE;
+	}
+
+	mapSize = statbuf.st_size;
+	map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return FALSE;
+
+	found = FALSE;
+	offset = 0;
+
+	while ((entry = NextSavedEntry(map, mapSize, &offset)) != NULL)
+	{
+		if (entry->fingerprint != fingerprint)
+			continue;
+
+		fwrite((const char *) (entry + 1), 1, entry->outputSize,
+			stdout);
+
+		found = TRUE;
+
+		break;
+	}
+
+	munmap(map, mapSize);
+
+	return found;
+}
+
+
+/*
+ * Save the output of this run for later runs with the same fingerprint,
+ * in front of the entries saved earlier, keeping only the most recent
+ * ones.  Failures are ignored since the output is just made again by the
+ * next run.  The saved output is freed.
+ */
+static void
+SaveOutput(uint64_t fingerprint)
+{
+	static	const char	padding[8];
+	const SAVED_ENTRY *	entry;
+	SAVED_HEADER		header;
+	SAVED_ENTRY		newEntry;
+	OUTPUT			output;
+	struct	stat		statbuf;
+	char			savedName[PATH_MAX];
+	char *			map;
+	size_t			mapSize;
+	size_t			offset;
+	int			count;
+	int			fd;
+
+	if ((savedOutput.used > SAVED_MAX_OUTPUT) ||
+		!GetCacheName(SAVED_FILE_NAME, savedName, sizeof(savedName)))
+	{
+		free(savedOutput.data);
+		savedOutput.data = NULL;
+
+		return;
+	}
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = SAVED_MAGIC;
+
+	memset(&newEntry, 0, sizeof(newEntry));
+	newEntry.fingerprint = fingerprint;
+	newEntry.outputSize = savedOutput.used;
+
+	AppendBytes(&output, (const char *) &header, sizeof(header));
+	AppendBytes(&output, (const char *) &newEntry, sizeof(newEntry));
+
+	if (savedOutput.used > 0)
+		AppendBytes(&output, savedOutput.data, savedOutput.used);
+
+	AppendBytes(&output, padding, (0 - savedOutput.used) & 7);
+
+	/*
+	 * Copy the entries saved earlier other than any for the same
+	 * fingerprint, up to the most which are kept.
+	 */
+	count = 1;
+	map = MAP_FAILED;
+	mapSize = 0;
+	fd = open(savedName, O_RDONLY | O_CLOEXEC);
+
+	if (fd >= 0)
+	{
+		if ((fstat(fd, &statbuf) == 0) && (statbuf.st_size > 0))
+		{
+			mapSize = statbuf.st_size;
+			map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE,
+				fd, 0);
+		}
+
+		close(fd);
+	}
+
+	if (map != MAP_FAILED)
+	{
+		offset = 0;
+
+		while ((count < SAVED_MAX_ENTRIES) &&
+			((entry = NextSavedEntry(map, mapSize, &offset)) != NULL))
+		{
+			if (entry->fingerprint == fingerprint)
+				continue;
+
+			AppendBytes(&output, (const char *) entry,
+				sizeof(SAVED_ENTRY) + entry->outputSize);
+			AppendBytes(&output, padding,
+				(0 - entry->outputSize) & 7);
+
+			count++;
+		}
+
+		munmap(map, mapSize);
+	}
+
+	WriteFileSafely(savedName, output.data, output.used);
+
+	free(output.data);
+	free(savedOutput.data);
+	savedOutput.data = NULL;
+}
+
+
+/*
+ * Return the next entry of a mapped file of saved results, which is the
+ * first one if the offset is zero, and advance the offset past it.
+ * Returns NULL at the end of the entries or if the file is not valid.
+ */
+static const SAVED_ENTRY *
+NextSavedEntry(const char * map, size_t mapSize, size_t * offsetPtr)
+{
+	const SAVED_HEADER *	header;
+	const SAVED_ENTRY *	entry;
+	size_t			offset;
+
+	header = (const SAVED_HEADER *) map;
+
+	if ((mapSize < sizeof(SAVED_HEADER)) || (header->magic != SAVED_MAGIC))
+		return NULL;
+
+	offset = *offsetPtr;
+
+	if (offset == 0)
+		offset = sizeof(SAVED_HEADER);
+
+	if ((offset >= mapSize) || (mapSize - offset < sizeof(SAVED_ENTRY)))
+		return NULL;
+
+	entry = (const SAVED_ENTRY *) (map + offset);
+	offset += sizeof(SAVED_ENTRY);
+
+	if (entry->outputSize > mapSize - offset)
+		return NULL;
+
+	*offsetPtr = offset + ((entry->outputSize + 7) & ~((size_t) 7));
+
+	return entry;
+}
+
+
+/*
+ * Find the status of a table of paths in batch mode, using the results
+ * remembered from earlier path lists in this run when there are some.
+ * The other paths have their status found together, and are remembered.
+ */
+static int
+StatPathsMemo(void * data, PATH_STAT * table, int count,
+	const PATH_CHECK * check)
+{
+	MEMO_SLOT *	slot;
+	PATH_STAT *	needTable;
+	const char *	path;
+	int *		needIndex;
+	unsigned int	hash;
+	unsigned int	index;
+	int		needCount;
+	int		entry;
+	int		status;
+
+	if (memoTable == NULL)
+		memoTable = (MEMO_SLOT *) calloc(MEMO_SLOTS, sizeof(MEMO_SLOT));
+
+	needTable = (PATH_STAT *) malloc(sizeof(PATH_STAT) * (count + 1));
+	needIndex = (int *) malloc(sizeof(int) * (count + 1));
+
+	if ((memoTable == NULL) || (needTable == NULL) || (needIndex == NULL))
+	{
+		free(needTable);
+		free(needIndex);
+
+		return StatPathsCounted(data, table, count, check);
+	}
+
+	/*
+	 * Use the remembered results for the paths which have them.
+	 */
+	needCount = 0;
+
+	for (entry = 0; entry < count; entry++)
+	{
+		hash = HashPath(table[entry].path);
+		index = hash & (MEMO_SLOTS - 1);
+
+		while ((memoTable[index].path != NULL) &&
+			((memoTable[index].hash != hash) ||
+			(strcmp(memoTable[index].path, table[entry].path) != 0)))
+		{
+			index = (index + 1) & (MEMO_SLOTS - 1);
+		}
+
+		/*
+		 * The result keeps the caller's path name rather than the
+		 * remembered copy, since the copy is freed if the results
+		 * are forgotten below.
+		 */
+		if (memoTable[index].path != NULL)
+		{
+			path = table[entry].path;
+			table[entry] = memoTable[index].info;
+			table[entry].path = path;
+			table[entry].statNs = 0;
+
+			continue;
+		}
+
+		needTable[needCount].path = table[entry].path;
+		needIndex[needCount++] = entry;
+	}
+
+	if (needCount == 0)
+	{
+		free(needTable);
+		free(needIndex);
+
+		return PATH_OK;
+	}
+
+	/*
+	 * Find the status of the other paths.
+	 */
+	if ((useCacheFlag || refreshCacheFlag) && !noCacheFlag)
+		status = StatPathsCached(data, needTable, needCount, check);
+	else
+		status = StatPathsCounted(data, needTable, needCount, check);
+
+	if (status != PATH_OK)
+	{
+		free(needTable);
+		free(needIndex);
+
+		return status;
+	}
+
+	/*
+	 * Copy the results back and remember them, forgetting all of the
+	 * old ones first if there would be too many.
+	 */
+	if (memoCount + needCount > MEMO_MAX_ENTRIES)
+		ClearMemo();
+
+	for (entry = 0; entry < needCount; entry++)
+	{
+		table[needIndex[entry]] = needTable[entry];
+
+		if (memoCount >= MEMO_MAX_ENTRIES)
+			continue;
+
+		hash = HashPath(needTable[entry].path);
+		index = hash & (MEMO_SLOTS - 1);
+
+		while (memoTable[index].path != NULL)
+			index = (index + 1) & (MEMO_SLOTS - 1);
+
+		slot = &memoTable[index];
+		slot->path = strdup(needTable[entry].path);
+
+		if (slot->path == NULL)
+			continue;
+
+		slot->hash = hash;
+		slot->info = needTable[entry];
+		memoCount++;
+	}
+
+	free(needTable);
+	free(needIndex);
+
+	return PATH_OK;
+}
+
+
+/*
+ * Forget all of the remembered results of checking paths.
+ */
+static void
+ClearMemo(void)
+{
+	int	index;
+
+	if (memoTable == NULL)
+		return;
+
+	for (index = 0; index < MEMO_SLOTS; index++)
+	{
+		free(memoTable[index].path);
+		memoTable[index].path = NULL;
+	}
+
+	memoCount = 0;
+}
+
+
+/*
+ * Find the status of a table of paths using the library, and add up the
+ * number of paths whose status was found and the time taken for them
+ * if the times are being reported.  This is used directly, or by the
+ * routines which remember results for the paths they still need.
+ */
+static int
+StatPathsCounted(void * data, PATH_STAT * table, int count,
+	const PATH_CHECK * check)
+{
+	int	status;
+	int	index;
+
+	status = PathStat(table, count, check);
+
+	if (!statsFlag || (status != PATH_OK))
+		return status;
+
+	for (index = 0; index < count; index++)
+	{
+		statCalls++;
+		statTotalNs += table[index].statNs;
+
+		if (table[index].statNs <= statSlowestNs)
+			continue;
+
+		statSlowestNs = table[index].statNs;
+		snprintf(statSlowestPath, sizeof(statSlowestPath), "%s",
+			table[index].path);
+	}
+
+	return status;
+}
+
+
+/*
+ * Return the current time in nanoseconds if the times of the work are
+ * being reported, or else zero.
+ */
+static long long
+StatsTime(void)
+{
+	struct	timespec	ts;
+
+	if (!statsFlag)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+
+/*
+ * Add the time since the start of a phase to its total if the times of
+ * the work are being reported, and make the start of the next phase now.
+ */
+static void
+EndPhase(int phase, long long * startPtr)
+{
+	long long	now;
+
+	if (!statsFlag)
+		return;
+
+	now = StatsTime();
+	phaseTimes[phase] += now - *startPtr;
+	*startPtr = now;
+}
+
+
+/*
+ * Add the time spent on a group of paths to its total, remembering the
+ * action which was applied to them.  The time for groups beyond the
+ * table is just added up together.
+ */
+static void
+AddGroupTime(int argIndex, int pathCount, long long ns)
+{
+	STATS_GROUP *	group;
+	int		index;
+
+	for (index = 0; index < statsGroupCount; index++)
+	{
+		group = &statsGroups[index];
+
+		if (group->argIndex == argIndex)
+		{
+			group->runCount++;
+			group->ns += ns;
+
+			return;
+		}
+	}
+
+	if (statsGroupCount >= STATS_MAX_GROUPS)
+	{
+		statsOtherGroupNs += ns;
+
+		return;
+	}
+
+	group = &statsGroups[statsGroupCount++];
+	group->argIndex = argIndex;
+	group->pathCount = pathCount;
+	group->action = action;
+	group->runCount = 1;
+	group->ns = ns;
+}
+
+
+/*
+ * Print the times of the phases of the work and the counts of the work
+ * done to standard error, as text or JSON, if they are wanted.
+ * Returns the specified exit status.
+ */
+static int
+ReportStats(int status)
+{
+	PATH_STATS	pathStats;
+	STATS_GROUP *	group;
+	long long	total;
+	int		index;
+
+	if (!statsFlag)
+		return status;
+
+	fflush(stdout);
+
+	memset(&pathStats, 0, sizeof(pathStats));
+
+	if (pathContext != NULL)
+		PathGetStats(pathContext, &pathStats);
+
+	total = 0;
+
+	for (index = 0; index < PHASE_COUNT; index++)
+		total += phaseTimes[index];
+
+	if (statsJsonFlag)
+	{
+		fprintf(stderr, "{\"phases\": {");
+
+		for (index = 0; index < PHASE_COUNT; index++)
+		{
+			fprintf(stderr, "\"%s\": %lld, ", phaseNames[index],
+				phaseTimes[index]);
+		}
+
+		fprintf(stderr, "\"total\": %lld}, \"groups\": [", total);
+
+		for (index = 0; index < statsGroupCount; index++)
+		{
+			group = &statsGroups[index];
+
+			fprintf(stderr, "%s{\"argument\": %d, \"action\": "
+				"\"%s\", \"paths\": %d, \"runs\": %ld, "
+				"\"ns\": %lld}", (index ? ", " : ""),
+				group->argIndex + 1, ActionName(group->action),
+				group->pathCount, group->runCount, group->ns);
+		}
+
+		fprintf(stderr, "], \"otherGroupsNs\": %lld, ",
+			statsOtherGroupNs);
+
+		fprintf(stderr, "\"counters\": {\"lookups\": %ld, "
+			"\"compares\": %ld, \"bytesCopied\": %ld, "
+			"\"hashGrowths\": %ld, \"statCalls\": %ld, "
+			"\"statNs\": %lld, \"slowestStatNs\": %lld, "
+			"\"slowestStatPath\": ",
+			pathStats.lookups, pathStats.compares,
+			pathStats.bytesCopied, pathStats.hashGrowths,
+			statCalls, statTotalNs, statSlowestNs);
+
+		PrintJsonString(statSlowestPath);
+
+		fprintf(stderr, "}}\n");
+
+		return status;
+	}
+
+	fprintf(stderr, "Phase times (microseconds):\n");
+
+	for (index = 0; index < PHASE_COUNT; index++)
+	{
+		fprintf(stderr, "  %-22s %12.1f\n", phaseNames[index],
+			phaseTimes[index] / 1000.0);
+
+		if (index != PHASE_ARGUMENTS)
+			continue;
+
+		for (group = statsGroups;
+			group < &statsGroups[statsGroupCount]; group++)
+		{
+			fprintf(stderr, "    argument %-3d %-4s %5d paths "
+				"%12.1f\n", group->argIndex + 1,
+				ActionName(group->action), group->pathCount,
+				group->ns / 1000.0);
+		}
+
+		if (statsOtherGroupNs)
+		{
+			fprintf(stderr, "    other groups %22.1f\n",
+				statsOtherGroupNs / 1000.0);
+		}
+	}
+
+	fprintf(stderr, "  %-22s %12.1f\n", "total", total / 1000.0);
+
+	fprintf(stderr, "Counts:\n");
+	fprintf(stderr, "  %-22s %12ld\n", "path lookups",
+		pathStats.lookups);
+	fprintf(stderr, "  %-22s %12ld\n", "name comparisons",
+		pathStats.compares);
+	fprintf(stderr, "  %-22s %12ld\n", "bytes copied",
+		pathStats.bytesCopied);
+	fprintf(stderr, "  %-22s %12ld\n", "hash table growths",
+		pathStats.hashGrowths);
+	fprintf(stderr, "  %-22s %12ld\n", "paths examined", statCalls);
+	fprintf(stderr, "  %-22s %12.1f\n", "examine time (us)",
+		statTotalNs / 1000.0);
+
+	if (statCalls > 0)
+	{
+		fprintf(stderr, "  %-22s %12.1f %s\n", "slowest (us)",
+			statSlowestNs / 1000.0, statSlowestPath);
+	}
+
+	return status;
+}
+
+
+/*
+ * Print a string to standard error as a quoted JSON string.
+ */
+static void
+PrintJsonString(const char * str)
+{
+	int	ch;
+
+	fputc('"', stderr);
+
+	while ((ch = (unsigned char) *str++) != '\0')
+	{
+		if ((ch == '"') || (ch == '\\'))
+			fprintf(stderr, "\\%c", ch);
+		else if (ch < ' ')
+			fprintf(stderr, "\\u%04x", ch);
+		else
+			fputc(ch, stderr);
+	}
+
+	fputc('"', stderr);
+}
+
+
+/*
+ * Return the name of the option which selects an action.
+ */
+static const char *
+ActionName(ACTION action)
+{
+	const OPTION *	option;
+
+	for (option = optionTable; option->name; option++)
+	{
+		if (option->action == action)
+			return option->name;
+	}
+
+	return "?";
+}
+
+
+/*
+ * Handle the command line when the output is to be commands for a shell.
+ * Each variable name option starts a new group of arguments which are
+ * applied to that variable, and any arguments before the first one are
+ * applied to PATH.  The commands to set all of the variables are only
+ * printed if every group succeeds, so that a partial result is never
+ * evaluated by the shell.  Groups which only check paths print nothing.
+ * Returns the exit status for the program.
+ */
+static int
+HandleShellGroups(int argc, const char ** argv)
+{
+	OUTPUT		output;
+	const char *	varName;
+	long long	startTime;
+	BOOL		leading;
+	int		start;
+	int		index;
+	int		result;
+	int		status;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	varName = "PATH";
+	leading = FALSE;
+	status = 0;
+	start = 0;
+
+	for (index = 0; index <= argc; index++)
+	{
+		if ((index < argc) && (strcmp(argv[index], OPTION_VAR) != 0))
+		{
+			if ((FindShell(argv[index]) == SHELL_NONE) &&
+				(FindAction(argv[index]) != ACTION_STATS) &&
+				(FindAction(argv[index]) != ACTION_STATS_JSON))
+			{
+				leading = TRUE;
+			}
+
+			continue;
+		}
+
+		/*
+		 * Handle the group which ends here, unless it is a group
+		 * before the first variable name option containing nothing
+		 * but the shell and statistics options.
+		 */
+		if ((start > 0) || leading || (index == argc))
+		{
+			result = HandleVariable(varName, index - start,
+				argv + start);
+
+			if (result == 1)
+			{
+				free(output.data);
+
+				return 1;
+			}
+
+			if (result == RESULT_PRINT)
+			{
+				startTime = StatsTime();
+				AppendAssignment(&output, varName);
+				EndPhase(PHASE_OUTPUT, &startTime);
+			}
+			else if (result != 0)
+				status = result;
+		}
+
+		if (index == argc)
+			break;
+
+		/*
+		 * Get the name of the variable for the next group.
+		 */
+		if ((index + 1 >= argc) || !IsVariableName(argv[index + 1]))
+		{
+			fprintf(stderr, "Missing or invalid environment variable name\n");
+			free(output.data);
+
+			return 1;
+		}
+
+		varName = argv[++index];
+		start = index + 1;
+	}
+
+	if (status != 0)
+	{
+		free(output.data);
+
+		return status;
+	}
+
+#ifdef BASH_BUILTIN
+	/*
+	 * The builtin sets all of the variables itself.
+	 */
+	AppendBytes(&output, "", 1);
+
+	status = (SetVariables(output.data) ? 0 : 1);
+
+	free(output.data);
+
+	return status;
+#else
+	if (output.used > 0)
+		fwrite(output.data, 1, output.used, stdout);
+
+	if (memoFlag)
+		AppendBytes(&savedOutput, output.data, output.used);
+
+	free(output.data);
+
+	return 0;
+#endif
+}
+
+
+/*
+ * Return the type of shell selected by an argument, or SHELL_NONE if the
+ * argument is not one of the shell options.
+ */
+static SHELL
+FindShell(const char * name)
+{
+	const OPTION *	option;
+
+	for (option = optionTable; option->name; option++)
+	{
+		if (strcmp(name, option->name) != 0)
+			continue;
+
+		if (option->action == ACTION_SHELL_SH)
+			return SHELL_SH;
+
+		if (option->action == ACTION_SHELL_CSH)
+			return SHELL_CSH;
+
+		if (option->action == ACTION_SHELL_FISH)
+			return SHELL_FISH;
+	}
+
+	return SHELL_NONE;
+}
+
+
+/*
+ * Return the action of the option with the specified name, or ACTION_NONE
+ * if it is not an option.
+ */
+static ACTION
+FindAction(const char * name)
+{
+	const OPTION *	option;
+
+	for (option = optionTable; option->name; option++)
+	{
+		if (strcmp(name, option->name) == 0)
+			return option->action;
+	}
+
+	return ACTION_NONE;
+}
+
+
+/*
+ * Append the command to set an environment variable to the final path
+ * list to the output, in the syntax of the shell being used.
+ */
+static void
+AppendAssignment(OUTPUT * output, const char * varName)
+{
+	const char **	listTable;
+	int		listCount;
+	int		index;
+
+#ifdef BASH_BUILTIN
+	/*
+	 * The builtin just needs the name and value of each variable.
+	 */
+	AppendBytes(output, varName, strlen(varName) + 1);
+	AppendPaths(output);
+	AppendBytes(output, "", 1);
+
+	return;
+#endif
+
+	switch (shellType)
+	{
+		case SHELL_CSH:
+			AppendOutput(output, "setenv ");
+			AppendOutput(output, varName);
+			AppendOutput(output, " '");
+			break;
+
+		case SHELL_FISH:
+			AppendOutput(output, "set -gx --path ");
+			AppendOutput(output, varName);
+			break;
+
+		default:
+			AppendOutput(output, varName);
+			AppendOutput(output, "='");
+			break;
+	}
+
+	/*
+	 * Add the paths, which are separate arguments for fish.
+	 */
+	listTable = MakePathTable();
+	listCount = PathCount(pathContext);
+
+	for (index = 0; index < listCount; index++)
+	{
+		if (shellType == SHELL_FISH)
+			AppendOutput(output, " '");
+		else if (index > 0)
+			AppendBytes(output, ":", 1);
+
+		AppendQuoted(output, listTable[index]);
+
+		if (shellType == SHELL_FISH)
+			AppendOutput(output, "'");
+	}
+
+	free(listTable);
+
+	switch (shellType)
+	{
+		case SHELL_CSH:
+			AppendOutput(output, "';\n");
+			break;
+
+		case SHELL_FISH:
+			AppendOutput(output, ";\n");
+			break;
+
+		default:
+			AppendOutput(output, "'; export ");
+			AppendOutput(output, varName);
+			AppendOutput(output, ";\n");
+			break;
+	}
+}
+
+
+/*
+ * Append a string to the output so that it can be placed within single
+ * quotes for the shell being used.  For sh and csh a quote is written
+ * by ending the quoted string and adding an escaped quote, and csh also
+ * needs history characters escaped.  Fish allows escapes within quotes.
+ */
+static void
+AppendQuoted(OUTPUT * output, const char * str)
+{
+	char	buf[2];
+
+	buf[1] = '\0';
+
+	for (; *str; str++)
+	{
+		if (*str == '\'')
+		{
+			AppendOutput(output, (shellType == SHELL_FISH) ?
+				"\\'" : "'\\''");
+
+			continue;
+		}
+
+		if ((*str == '\\') && (shellType == SHELL_FISH))
+		{
+			AppendOutput(output, "\\\\");
+
+			continue;
+		}
+
+		if ((*str == '!') && (shellType == SHELL_CSH))
+		{
+			AppendOutput(output, "\\!");
+
+			continue;
+		}
+
+		if ((*str == '\n') && (shellType == SHELL_CSH))
+		{
+			AppendOutput(output, "\\\n");
+
+			continue;
+		}
+
+		buf[0] = *str;
+		AppendOutput(output, buf);
+	}
+}
+
+
+/*
+ * Append a string to the output.
+ */
+static void
+AppendOutput(OUTPUT * output, const char * str)
+{
+	AppendBytes(output, str, strlen(str));
+}
+
+
+/*
+ * Append bytes to the output, growing it as needed.
+ * This exits on an malloc failure.
+ */
+static void
+AppendBytes(OUTPUT * output, const char * str, size_t len)
+{
+	char *	data;
+	size_t	size;
+
+	if (output->used + len > output->size)
+	{
+		size = (output->size ? output->size * 2 : 1024);
+
+		while (output->used + len > size)
+			size *= 2;
+
+		data = (char *) realloc(output->data, size);
+
+		if (data == NULL)
+		{
+			fprintf(stderr, "Cannot allocate %ld bytes\n",
+				(long) size);
+
+			exit(1);
+		}
+
+		output->data = data;
+		output->size = size;
+	}
+
+	memcpy(output->data + output->used, str, len);
+	output->used += len;
+}
+
+
+/*
+ * Append the current path list to the output as a path string.
+ */
+static void
+AppendPaths(OUTPUT * output)
+{
+	const char **	listTable;
+	int		listCount;
+	int		index;
+
+	listTable = MakePathTable();
+	listCount = PathCount(pathContext);
+
+	for (index = 0; index < listCount; index++)
+	{
+		if (index > 0)
+			AppendBytes(output, ":", 1);
+
+		AppendOutput(output, listTable[index]);
+	}
+
+	free(listTable);
+}
+
+
+/*
+ * Return whether a string is a valid name for a shell variable.
+ */
+static BOOL
+IsVariableName(const char * name)
+{
+	if ((*name != '_') && !isalpha((unsigned char) *name))
+		return FALSE;
+
+	while (*++name)
+	{
+		if ((*name != '_') && !isalnum((unsigned char) *name))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * Handle an option argument name (including the leading dash).
+ * Returns TRUE on success.
+ */
+static BOOL
+HandleOption(const char * name)
+{
+	const OPTION *	option;
+
+	/*
+	 * Scan the option table looking for the option name.
+	 */
+	option = optionTable;
+
+	while ((option->name != NULL) && (strcmp(name, option->name) != 0))
+		option++;
+
+	/*
+	 * Options which print something other than the path list cannot
+	 * be used when the output is commands for a shell.
+	 */
+	if ((shellType != SHELL_NONE) && ((option->action == ACTION_LIST) ||
+		(option->action == ACTION_LIST_SORTED) ||
+		(option->action == ACTION_WHICH) ||
+		(option->action == ACTION_SHADOW) ||
+		(option->action == ACTION_ELF) ||
+		(option->action == ACTION_CLASS_PATH) ||
+		(option->action == ACTION_AUDIT) ||
+		(option->action == ACTION_BATCH) ||
+		(option->action == ACTION_BATCH_NUL)))
+	{
+		fprintf(stderr, "Option \"%s\" cannot be used with shell output\n",
+			name);
+
+		return FALSE;
+	}
+
+	/*
+	 * Switch on the option type.
+	 */
+	switch (option->action)
+	{
+		case ACTION_AFTER:
+		case ACTION_BEFORE:
+		case ACTION_REMOVE:
+		case ACTION_REMOVE_AFTER:
+		case ACTION_REMOVE_BEFORE:
+		case ACTION_MOVE_AFTER:
+		case ACTION_MOVE_BEFORE:
+			action = option->action;
+			break;
+
+		case ACTION_TEST_PRESENCE:
+			action = option->action;
+			testPresenceFlag = TRUE;
+			break;
+
+		case ACTION_WHICH:
+			action = option->action;
+			whichFlag = TRUE;
+			break;
+
+		case ACTION_WHICH_ALL:
+			whichAllFlag = TRUE;
+			break;
+
+		case ACTION_SHADOW:
+			shadowFlag = TRUE;
+			break;
+
+		case ACTION_ELF:
+			action = option->action;
+			break;
+
+		case ACTION_ELF_REMOVE:
+			action = ACTION_ELF;
+			elfRemoveFlag = TRUE;
+			break;
+
+		case ACTION_CLASS_PATH:
+			classPathFlag = TRUE;
+			break;
+
+		case ACTION_CLASS_REMOVE:
+			classPathFlag = TRUE;
+			classRemoveFlag = TRUE;
+			break;
+
+		case ACTION_GLOB:
+			globFlag = TRUE;
+			break;
+
+		case ACTION_SHELL_SH:
+		case ACTION_SHELL_CSH:
+		case ACTION_SHELL_FISH:
+		case ACTION_BATCH:
+		case ACTION_BATCH_NUL:
+		case ACTION_AUDIT:
+		case ACTION_MEMO:
+		case ACTION_FINGERPRINT:
+		case ACTION_STATS:
+		case ACTION_STATS_JSON:
+		case ACTION_NORMALIZE:
+			/*
+			 * These were handled before the arguments.
+			 */
+			break;
+
+		case ACTION_SET:
+			PathClear(pathContext);
+			action = ACTION_AFTER;
+			break;
+
+		case ACTION_LIST:
+			listFlag = TRUE;
+			break;
+
+		case ACTION_LIST_SORTED:
+			listSortedFlag = TRUE;
+			break;
+
+		case ACTION_ALLOW_FILES:
+			allowFilesFlag = TRUE;
+			break;
+
+		case ACTION_DISABLE_DOT:
+			disableDotFlag = TRUE;
+			break;
+
+		case ACTION_CHECK_INVALID:
+			checkInvalidFlag = TRUE;
+			break;
+
+		case ACTION_REMOVE_INVALID:
+			removeInvalidFlag = TRUE;
+			break;
+
+		case ACTION_CHECK_RELATIVE:
+			checkRelativeFlag = TRUE;
+			break;
+
+		case ACTION_REMOVE_RELATIVE:
+			removeRelativeFlag = TRUE;
+			break;
+
+		case ACTION_DEMOTE_NETWORK:
+			demoteNetworkFlag = TRUE;
+			break;
+
+		case ACTION_REPORT_FS:
+			reportFsFlag = TRUE;
+			break;
+
+		case ACTION_REMOVE_ALIASES:
+			removeAliasesFlag = TRUE;
+			break;
+
+		case ACTION_REPORT_ALIASES:
+			reportAliasesFlag = TRUE;
+			break;
+
+		case ACTION_USE_CACHE:
+			useCacheFlag = TRUE;
+			break;
+
+		case ACTION_REFRESH_CACHE:
+			refreshCacheFlag = TRUE;
+			break;
+
+		case ACTION_NO_CACHE:
+			noCacheFlag = TRUE;
+			break;
+
+		default:
+			/*
+			 * The option is not in the table.
+			 * Print an error message.
+			 */
+			fprintf(stderr, "Unknown option \"%s\"\n", name);
+
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * Handle a list of path names to be acted on by the current action.
+ * This list is determined by the number of path names on the command line
+ * following one option and before another one.  If glob patterns are
+ * being expanded, then path names which are patterns are replaced by the
+ * paths they match.
+ */
+static void
+HandlePathList(int listCount, const char ** listTable)
+{
+	if (globFlag && (action != ACTION_WHICH) && (action != ACTION_ELF))
+	{
+		HandlePatterns(listCount, listTable);
+
+		return;
+	}
+
+	ApplyPathList(listCount, listTable);
+}
+
+
+/*
+ * Apply the current action to a list of path names which have had any
+ * glob patterns expanded.
+ */
+static void
+ApplyPathList(int listCount, const char ** listTable)
+{
+	/*
+	 * Handle a few actions specially whose action depends on having all
+	 * of the paths in the list at once.
+	 */
+	switch (action)
+	{
+		case ACTION_BEFORE:
+		case ACTION_REMOVE_BEFORE:
+		case ACTION_MOVE_BEFORE:
+			/*
+			 * Actions which put paths at the beginning must
+			 * be executed in reverse order in order to get
+			 * the right result.
+			 */
+			while (listCount-- > 0)
+				HandlePath(listTable[listCount], action);
+
+			return;
+
+		case ACTION_WHICH:
+			/*
+			 * These are command names rather than paths,
+			 * which are looked up once the list is final.
+			 */
+			while (listCount-- > 0)
+				whichTable[whichCount++] = *listTable++;
+
+			return;
+
+		case ACTION_ELF:
+			/*
+			 * These are the names of ELF files whose libraries
+			 * are looked up once the list is final.
+			 */
+			while (listCount-- > 0)
+				elfTable[elfCount++] = *listTable++;
+
+			return;
+
+		default:
+			/*
+			 * Break to do the default case.
+			 */
+			break;
+	}
+
+	/*
+	 * Apply the action each of the paths in list in the specified order.
+	 */
+	while (listCount-- > 0)
+		HandlePath(*listTable++, action);
+}
+
+
+/*
+ * Handle a list of path names which can be glob patterns, replacing each
+ * pattern by the paths it matches and then applying the action to the
+ * resulting list.  For the actions which add paths the patterns match
+ * directories, which are found for all of the patterns in parallel and
+ * sorted by name.  For the other actions they match the paths already in
+ * the path list, in their list order.  A pattern which matches nothing
+ * is used literally, as are the other path names, after removing the
+ * backslashes which quote glob characters.
+ * This exits on an malloc failure.
+ */
+static void
+HandlePatterns(int listCount, const char ** listTable)
+{
+	GLOB_EXPANSION *	table;
+	GLOB_EXPANSION *	expansion;
+	const char **		newTable;
+	BOOL			expand;
+	int			newCount;
+	int			index;
+	int			match;
+
+	table = (GLOB_EXPANSION *) calloc(listCount, sizeof(GLOB_EXPANSION));
+
+	if (table == NULL)
+	{
+		fprintf(stderr, "Cannot allocate pattern table\n");
+		exit(1);
+	}
+
+	expand = ((action == ACTION_AFTER) || (action == ACTION_BEFORE) ||
+		(action == ACTION_REMOVE_AFTER) ||
+		(action == ACTION_REMOVE_BEFORE));
+
+	for (index = 0; index < listCount; index++)
+	{
+		table[index].pattern = listTable[index];
+		SetGlob(&table[index], expand);
+	}
+
+	if (expand)
+		ExpandPatterns(table, listCount);
+	else
+	{
+		for (index = 0; index < listCount; index++)
+		{
+			if (table[index].glob)
+				MatchListPaths(&table[index]);
+		}
+	}
+
+	/*
+	 * Make the new list of paths from the matches and the arguments
+	 * which are used literally.
+	 */
+	newCount = 0;
+
+	for (expansion = table; expansion < &table[listCount]; expansion++)
+	{
+		if (expansion->failed)
+		{
+			fprintf(stderr, "Cannot expand pattern \"%s\": %s\n",
+				expansion->pattern, strerror(ENOMEM));
+			exit(1);
+		}
+
+		if (expansion->count > 0)
+		{
+			newCount += expansion->count;
+
+			continue;
+		}
+
+		expansion->literal = strdup(expansion->pattern);
+
+		if (expansion->literal == NULL)
+		{
+			fprintf(stderr, "Cannot allocate pattern table\n");
+			exit(1);
+		}
+
+		Unescape(expansion->literal);
+		newCount++;
+	}
+
+	newTable = (const char **) malloc(sizeof(const char *) *
+		(newCount + 1));
+
+	if (newTable == NULL)
+	{
+		fprintf(stderr, "Cannot allocate pattern table\n");
+		exit(1);
+	}
+
+	newCount = 0;
+
+	for (expansion = table; expansion < &table[listCount]; expansion++)
+	{
+		if (expansion->literal)
+			newTable[newCount++] = expansion->literal;
+
+		for (match = 0; match < expansion->count; match++)
+			newTable[newCount++] = expansion->matches[match];
+	}
+
+	ApplyPathList(newCount, newTable);
+
+	for (expansion = table; expansion < &table[listCount]; expansion++)
+	{
+		for (match = 0; match < expansion->count; match++)
+			free(expansion->matches[match]);
+
+		free(expansion->matches);
+		free(expansion->glob);
+		free(expansion->literal);
+	}
+
+	free(newTable);
+	free(table);
+}
+
+
+/*
+ * Set the pattern to be matched for a path argument, if it is one.
+ * In a class path, a trailing asterisk after a slash is a wildcard for
+ * the jar files in the directory, so it is never expanded.  Instead the
+ * directory part is matched if it is a pattern, and the wildcard is
+ * added back to each match.  The paths in the path list already have
+ * the wildcard, so for them it has to match literally.
+ * This exits on an malloc failure.
+ */
+static void
+SetGlob(GLOB_EXPANSION * expansion, BOOL expand)
+{
+	const char *	pattern;
+	size_t		length;
+
+	pattern = expansion->pattern;
+	length = strlen(pattern);
+
+	if (classListFlag && (length >= 2) && (pattern[length - 1] == '*') &&
+		(pattern[length - 2] == ROOT_CHARACTER))
+	{
+		expansion->glob = (char *) malloc(length + 2);
+
+		if (expansion->glob == NULL)
+		{
+			fprintf(stderr, "Cannot allocate pattern table\n");
+			exit(1);
+		}
+
+		memcpy(expansion->glob, pattern, length - 2);
+		expansion->glob[length - 2] = '\0';
+
+		if (!IsPattern(expansion->glob))
+		{
+			free(expansion->glob);
+			expansion->glob = NULL;
+
+			return;
+		}
+
+		if (expand)
+			expansion->suffix = "/*";
+		else
+			strcpy(expansion->glob + length - 2, "/\\*");
+
+		return;
+	}
+
+	if (!IsPattern(pattern))
+		return;
+
+	expansion->glob = strdup(pattern);
+
+	if (expansion->glob == NULL)
+	{
+		fprintf(stderr, "Cannot allocate pattern table\n");
+		exit(1);
+	}
+}
+
+
+/*
+ * Return whether a path argument is a glob pattern, which is when it has
+ * a glob character which is not quoted by a backslash.
+ */
+static BOOL
+IsPattern(const char * str)
+{
+	for (; *str; str++)
+	{
+		if ((*str == '\\') && (str[1] != '\0'))
+			str++;
+		else if ((*str == '*') || (*str == '?') || (*str == '['))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+/*
+ * Remove the backslashes which quote the following characters of a path
+ * argument in place, as the shell does.
+ */
+static void
+Unescape(char * str)
+{
+	char *	out;
+
+	for (out = str; *str; str++)
+	{
+		if ((*str == '\\') && (str[1] != '\0'))
+			str++;
+
+		*out++ = *str;
+	}
+
+	*out = '\0';
+}
+
+
+/*
+ * Find the directories matching the glob patterns in a table of path
+ * arguments using a group of threads which each take the next argument
+ * from the table until they are all done.  The matches for each pattern
+ * are sorted by name.
+ */
+static void
+ExpandPatterns(GLOB_EXPANSION * table, int count)
+{
+	GLOB_BATCH	batch;
+	pthread_t	threads[SCAN_MAX_WORKERS];
+	int		patternCount;
+	int		threadCount;
+	int		index;
+
+	batch.table = table;
+	batch.count = count;
+	batch.next = 0;
+
+	patternCount = 0;
+
+	for (index = 0; index < count; index++)
+		patternCount += (table[index].glob != NULL);
+
+	for (threadCount = 0; START_WORKERS &&
+		(threadCount < SCAN_MAX_WORKERS) &&
+		(threadCount < patternCount - 1); threadCount++)
+	{
+		if (pthread_create(&threads[threadCount], NULL,
+			GlobWorker, &batch) != 0)
+		{
+			break;
+		}
+	}
+
+	GlobWorker(&batch);
+
+	while (threadCount-- > 0)
+		pthread_join(threads[threadCount], NULL);
+}
+
+
+/*
+ * Thread routine which expands the patterns in a batch of path arguments
+ * until there are none left.
+ */
+static void *
+GlobWorker(void * arg)
+{
+	GLOB_BATCH *		batch;
+	GLOB_EXPANSION *	expansion;
+	char			path[PATH_MAX];
+	int			index;
+
+	batch = (GLOB_BATCH *) arg;
+
+	while ((index = __sync_fetch_and_add(&batch->next, 1)) < batch->count)
+	{
+		expansion = &batch->table[index];
+
+		if (expansion->glob == NULL)
+			continue;
+
+		if (*expansion->glob == ROOT_CHARACTER)
+		{
+			strcpy(path, "/");
+			GlobDirectory(expansion, path, 1, expansion->glob + 1);
+		}
+		else
+		{
+			path[0] = '\0';
+			GlobDirectory(expansion, path, 0, expansion->glob);
+		}
+
+		qsort(expansion->matches, expansion->count, sizeof(char *),
+			SortCallback);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Add the directories matching the rest of a glob pattern, starting from
+ * the directory whose name is in the buffer, which is either empty for
+ * the current directory or ends with a slash.  Components of the pattern
+ * with glob characters are matched against the entries of the directory,
+ * where a leading DOT must be matched explicitly, and other components are
+ * used with their quoting backslashes removed.  The buffer is changed
+ * beyond its current contents.
+ */
+static void
+GlobDirectory(GLOB_EXPANSION * expansion, char * path, size_t pathLength,
+	const char * pattern)
+{
+	struct	stat		statbuf;
+	struct	dirent *	dirent;
+	DIR *			dir;
+	const char *		end;
+	char			component[NAME_MAX + 1];
+	size_t			length;
+
+	end = strchr(pattern, '/');
+	length = (end ? (size_t) (end - pattern) : strlen(pattern));
+
+	if (length > NAME_MAX)
+		return;
+
+	memcpy(component, pattern, length);
+	component[length] = '\0';
+
+	if (!IsPattern(component))
+	{
+		Unescape(component);
+		length = strlen(component);
+
+		if (pathLength + length + 2 > PATH_MAX)
+			return;
+
+		memcpy(path + pathLength, component, length + 1);
+		pathLength += length;
+
+		if (end == NULL)
+		{
+			if ((stat(path, &statbuf) == 0) &&
+				S_ISDIR(statbuf.st_mode))
+			{
+				AddMatch(expansion, path);
+			}
+
+			return;
+		}
+
+		path[pathLength++] = '/';
+		path[pathLength] = '\0';
+
+		GlobDirectory(expansion, path, pathLength, end + 1);
+
+		return;
+	}
+
+	dir = opendir(pathLength ? path : DOT_PATH);
+
+	if (dir == NULL)
+		return;
+
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		if ((strcmp(dirent->d_name, ".") == 0) ||
+			(strcmp(dirent->d_name, "..") == 0) ||
+			(fnmatch(component, dirent->d_name, FNM_PERIOD) != 0))
+		{
+			continue;
+		}
+
+#ifdef _DIRENT_HAVE_D_TYPE
+		/*
+		 * Skip entries which are known not to be directories.
+		 */
+		if ((dirent->d_type != DT_DIR) && (dirent->d_type != DT_LNK) &&
+			(dirent->d_type != DT_UNKNOWN))
+		{
+			continue;
+		}
+#endif
+
+		length = strlen(dirent->d_name);
+
+		if (pathLength + length + 2 > PATH_MAX)
+			continue;
+
+		memcpy(path + pathLength, dirent->d_name, length + 1);
+
+		if (end == NULL)
+		{
+			if ((stat(path, &statbuf) == 0) &&
+				S_ISDIR(statbuf.st_mode))
+			{
+				AddMatch(expansion, path);
+			}
+
+			continue;
+		}
+
+		path[pathLength + length] = '/';
+		path[pathLength + length + 1] = '\0';
+
+		GlobDirectory(expansion, path, pathLength + length + 1,
+			end + 1);
+	}
+
+	closedir(dir);
+}
+
+
+/*
+ * Find the paths in the path list which match a glob pattern, where
+ * a slash or a leading DOT in a component must be matched explicitly.
+ */
+static void
+MatchListPaths(GLOB_EXPANSION * expansion)
+{
+	const char **	listTable;
+	int		listCount;
+	int		index;
+
+	listTable = MakePathTable();
+	listCount = PathCount(pathContext);
+
+	for (index = 0; index < listCount; index++)
+	{
+		if (fnmatch(expansion->glob, listTable[index],
+			FNM_PATHNAME | FNM_PERIOD) == 0)
+		{
+			AddMatch(expansion, listTable[index]);
+		}
+	}
+
+	free(listTable);
+}
+
+
+/*
+ * Add a copy of a path to the matches for a pattern, followed by the
+ * suffix for the pattern if it has one.
+ * A failure to allocate memory is remembered to be reported later,
+ * since this can be called by threads.
+ */
+static void
+AddMatch(GLOB_EXPANSION * expansion, const char * path)
+{
+	char **	matches;
+	char *	copy;
+	size_t	length;
+	size_t	suffixLength;
+	int	size;
+
+	if (expansion->failed)
+		return;
+
+	if (expansion->count >= expansion->size)
+	{
+		size = (expansion->size ? expansion->size * 2 : 16);
+		matches = (char **) realloc(expansion->matches,
+			sizeof(char *) * size);
+
+		if (matches == NULL)
+		{
+			expansion->failed = TRUE;
+
+			return;
+		}
+
+		expansion->matches = matches;
+		expansion->size = size;
+	}
+
+	length = strlen(path);
+	suffixLength = (expansion->suffix ? strlen(expansion->suffix) : 0);
+	copy = (char *) malloc(length + suffixLength + 1);
+
+	if (copy == NULL)
+	{
+		expansion->failed = TRUE;
+
+		return;
+	}
+
+	memcpy(copy, path, length);
+	memcpy(copy + length, expansion->suffix ? expansion->suffix : "",
+		suffixLength + 1);
+
+	expansion->matches[expansion->count++] = copy;
+}
+
+
+/*
+ * Handle the specified path according to the specified action.
+ * This exits on an malloc failure.
+ */
+static void
+HandlePath(const char * path, ACTION action)
+{
+	int	status;
+
+	/*
+	 * See if the path is in the path list.
+	 * If not, remember this failure for later.
+	 */
+	if (action == ACTION_TEST_PRESENCE)
+	{
+		if (!PathContains(pathContext, path))
+			testFailedFlag = TRUE;
+
+		return;
+	}
+
+	status = PathApply(pathContext, action, path);
+
+	if (status == PATH_ERR_ARGUMENT)
+	{
+		fprintf(stderr, "Unknown action %d\n", action);
+		exit(1);
+	}
+
+	if (status != PATH_OK)
+	{
+		fprintf(stderr, "Cannot add path \"%s\": %s\n", path,
+			PathErrorString(status));
+		exit(1);
+	}
+}
+
+/*
+ * Initialize the path list to be empty, creating the context which holds
+ * it if this is the first time.
+ * This exits on an malloc failure.
+ */
+static void
+InitPaths(void)
+{
+	/*
+	 * If the path list was used before, then just empty it.
+	 */
+	if (pathContext != NULL)
+	{
+		PathClear(pathContext);
+
+		return;
+	}
+
+	if (PathCreate(NULL, &pathContext) != PATH_OK)
+	{
+		fprintf(stderr, "Cannot allocate path list\n");
+
+		exit(1);
+	}
+}
+
+/*
+ * Compute the hash value of a path name.
+ * This is the FNV-1a hash of the characters of the path.
+ */
+static unsigned int
+HashPath(const char * path)
+{
+	unsigned int	hash;
+
+	hash = HASH_BASIS;
+
+	while (*path)
+	{
+		hash ^= (unsigned char) *path++;
+		hash *= HASH_PRIME;
+	}
+
+	return hash;
+}
+
+
+/*
+ * Check the list of paths for validity.  Depending on the options set,
+ * remove invalid paths from the list or generate error messages for them,
+ * and move the paths on network filesystems to the end of the list.
+ * Returns TRUE if there were no errors generated.
+ */
+static BOOL
+CheckPathList(void)
+{
+	PATH_CHECK	check;
+	int		status;
+
+	memset(&check, 0, sizeof(check));
+
+	if (checkInvalidFlag)
+		check.flags |= PATH_CHECK_INVALID;
+
+	if (removeInvalidFlag)
+		check.flags |= PATH_REMOVE_INVALID;
+
+	if (checkRelativeFlag)
+		check.flags |= PATH_CHECK_RELATIVE;
+
+	if (removeRelativeFlag)
+		check.flags |= PATH_REMOVE_RELATIVE;
+
+	if (allowFilesFlag)
+		check.flags |= PATH_ALLOW_FILES;
+
+	if (disableDotFlag)
+		check.flags |= PATH_PLAIN_DOT;
+
+	if (demoteNetworkFlag)
+		check.flags |= PATH_DEMOTE_NETWORK;
+
+	if (reportFsFlag)
+		check.flags |= PATH_FS_TYPES;
+
+	if (removeAliasesFlag)
+		check.flags |= PATH_REMOVE_ALIASES;
+
+	if (reportAliasesFlag)
+		check.flags |= PATH_REMOVE_ALIASES | PATH_REPORT_ALIASES;
+
+	if (rootName)
+	{
+		check.flags |= PATH_IN_ROOT;
+		check.rootFd = rootFd;
+	}
+
+	if (statsFlag)
+	{
+		check.flags |= PATH_TIME_STAT;
+		check.statFunc = StatPathsCounted;
+	}
+
+	if (auditFlag)
+		check.flags |= PATH_CHECK_INVALID | PATH_CHECK_RELATIVE;
+
+#ifdef BASH_BUILTIN
+	check.flags |= PATH_SERIAL;
+#endif
+
+	check.timeoutMs = timeoutMs;
+	check.reportFunc = ReportProblem;
+
+	if ((useCacheFlag || refreshCacheFlag) && !noCacheFlag &&
+		(rootName == NULL))
+	{
+		check.statFunc = StatPathsCached;
+	}
+
+	if (batchFlag || (auditFlag && (auditRootName == NULL)))
+		check.statFunc = StatPathsMemo;
+
+	status = PathCheck(pathContext, &check);
+
+	if ((status != PATH_OK) && (status != PATH_ERR_INVALID))
+	{
+		fprintf(stderr, "Cannot check paths: %s\n",
+			PathErrorString(status));
+	}
+
+	return (status == PATH_OK);
+}
+
+
+/*
+ * Open the root directory given by -root within which the paths are
+ * checked.  It is only opened once for all of the path lists which use
+ * the same directory, such as in batch mode.
+ * Returns TRUE if successful.
+ */
+static BOOL
+OpenRoot(void)
+{
+	if ((rootFd >= 0) && (strcmp(rootFdName, rootName) == 0))
+		return TRUE;
+
+	if (rootFd >= 0)
+		close(rootFd);
+
+	free(rootFdName);
+
+	rootFdName = strdup(rootName);
+	rootFd = open(rootName, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (rootFdName == NULL)
+	{
+		fprintf(stderr, "Cannot allocate root directory name\n");
+
+		exit(1);
+	}
+
+	if (rootFd < 0)
+	{
+		fprintf(stderr, "Cannot open root directory \"%s\": %s\n",
+			rootName, strerror(errno));
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * Print an error message for a problem found when checking a path,
+ * or the type of its filesystem.  In batch mode the message says which
+ * path list the path is from.  When auditing processes the problem is
+ * just counted for the process being audited.
+ */
+static void
+ReportProblem(void * data, const PATH_STAT * info, int problem,
+	const PATH_CHECK * check)
+{
+	if (auditFlag)
+	{
+		if (problem == PATH_PROBLEM_RELATIVE)
+			auditProcess->relative++;
+		else if (problem == PATH_PROBLEM_ALIAS)
+			auditProcess->duplicates++;
+		else if (problem != PATH_PROBLEM_FS_TYPE)
+			auditProcess->invalid++;
+
+		return;
+	}
+
+	if (batchFlag)
+		fprintf(stderr, "Record %ld: ", recordNumber);
+
+	switch (problem)
+	{
+		case PATH_PROBLEM_RELATIVE:
+			fprintf(stderr, "Path \"%s\" is relative\n",
+				info->path);
+			break;
+
+		case PATH_PROBLEM_SLOW:
+			fprintf(stderr, "Path \"%s\": No response within %d ms\n",
+				info->path, check->timeoutMs);
+			break;
+
+		case PATH_PROBLEM_ERROR:
+			fprintf(stderr, "Path \"%s\": %s\n", info->path,
+				strerror(info->error));
+			break;
+
+		case PATH_PROBLEM_NOT_DIR:
+			fprintf(stderr, "Path \"%s\": Not a directory\n",
+				info->path);
+			break;
+
+		case PATH_PROBLEM_FS_TYPE:
+			fprintf(stderr, "Path \"%s\": %s filesystem\n",
+				info->path, (info->fsType ?
+					info->fsType->name : "unknown"));
+			break;
+
+		case PATH_PROBLEM_ALIAS:
+			fprintf(stderr, "Path \"%s\" is the same as \"%s\"\n",
+				info->path, info->aliasOf);
+			break;
+	}
+}
+
+/*
+ * Find the status of a table of paths using the results which were saved
+ * in the cache file by earlier runs when they are still up to date.
+ * Only the paths which are missing from the cache, or whose parent
+ * directory has changed since, have their status found again, and then
+ * the cache file is rewritten with the new results.
+ */
+static int
+StatPathsCached(void * data, PATH_STAT * table, int count,
+	const PATH_CHECK * check)
+{
+	const CACHE_SLOT *	slot;
+	const PATH_FS_TYPE *	fsType;
+	CACHE_STAMP *		stamps;
+	CACHE_PARENT *		parents;
+	BOOL *			validStamps;
+	PATH_STAT *		needTable;
+	int *			needIndex;
+	char *			map;
+	char			cacheName[PATH_MAX];
+	struct	stat		statbuf;
+	size_t			mapSize;
+	int			needCount;
+	int			parentCount;
+	int			index;
+	int			entry;
+	int			fd;
+
+	parentCount = 16;
+
+	while (parentCount < 2 * count)
+		parentCount *= 2;
+
+	parents = (CACHE_PARENT *) calloc(parentCount, sizeof(CACHE_PARENT));
+	stamps = (CACHE_STAMP *) malloc(sizeof(CACHE_STAMP) * (count + 1));
+	validStamps = (BOOL *) malloc(sizeof(BOOL) * (count + 1));
+	needTable = (PATH_STAT *) malloc(sizeof(PATH_STAT) * (count + 1));
+	needIndex = (int *) malloc(sizeof(int) * (count + 1));
+
+	if ((parents == NULL) || (stamps == NULL) || (validStamps == NULL) ||
+		(needTable == NULL) || (needIndex == NULL) ||
+		!GetCacheName(CACHE_FILE_NAME, cacheName, sizeof(cacheName)))
+	{
+		free(parents);
+		free(stamps);
+		free(validStamps);
+		free(needTable);
+		free(needIndex);
+
+		return StatPathsCounted(data, table, count, check);
+	}
+
+	/*
+	 * Map the existing cache file if there is one which belongs to us,
+	 * unless all the paths are being checked again anyway.
+	 */
+	map = NULL;
+	mapSize = 0;
+
+	fd = refreshCacheFlag ? -1 : open(cacheName, O_RDONLY);
+
+	if (fd >= 0)
+	{
+		if ((fstat(fd, &statbuf) == 0) &&
+			(statbuf.st_uid == getuid()) &&
+			(statbuf.st_size >= (off_t) sizeof(CACHE_HEADER)))
+		{
+			mapSize = statbuf.st_size;
+			map = mmap(NULL, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+
+			if (map == MAP_FAILED)
+				map = NULL;
+		}
+
+		close(fd);
+	}
+
+	/*
+	 * Look up each path in the cache, and use the saved result if its
+	 * parent directory is unchanged.  The stamp of each parent directory
+	 * is only found once even when it is shared by several paths.
+	 * Filesystem types are only saved if they were wanted, so they may
+	 * have to be found now.
+	 */
+	needCount = 0;
+
+	for (index = 0; index < count; index++)
+	{
+		validStamps[index] = GetCacheStamp(table[index].path,
+			&stamps[index], parents, parentCount);
+
+		slot = NULL;
+
+		if (map && validStamps[index])
+			slot = FindCacheSlot(map, mapSize, table[index].path);
+
+		/*
+		 * A filesystem type which this program does not know,
+		 * such as from a cache file written by another version,
+		 * means that the path has to be looked up again.
+		 */
+		fsType = NULL;
+
+		if (slot && (slot->fsState == CACHE_FS_TYPE))
+		{
+			fsType = FindCacheFsType(slot);
+
+			if (fsType == NULL)
+				slot = NULL;
+		}
+
+		if (slot && (memcmp(&slot->stamp, &stamps[index],
+			sizeof(CACHE_STAMP)) == 0) && (!(demoteNetworkFlag ||
+			reportFsFlag) || (slot->fsState != CACHE_UNKNOWN_FS_TYPE)))
+		{
+			table[index].error = slot->error;
+			table[index].mode = slot->mode;
+			table[index].dev = slot->dev;
+			table[index].ino = slot->ino;
+			table[index].slow = FALSE;
+			table[index].fsType = fsType;
+			table[index].statNs = 0;
+
+			continue;
+		}
+
+		needTable[needCount].path = table[index].path;
+		needIndex[needCount++] = index;
+	}
+
+	/*
+	 * Find the status of the paths which were not in the cache,
+	 * and copy the results back into the original table.
+	 */
+	StatPathsCounted(data, needTable, needCount, check);
+
+	for (index = 0; index < needCount; index++)
+	{
+		entry = needIndex[index];
+		table[entry] = needTable[index];
+
+		/*
+		 * The status follows a symbolic link, whose target can be
+		 * removed or replaced without changing the parent directory
+		 * of the link, so the result for a link is not saved.
+		 */
+		if (validStamps[entry] && !table[entry].slow &&
+			(lstat(table[entry].path, &statbuf) == 0) &&
+			S_ISLNK(statbuf.st_mode))
+		{
+			validStamps[entry] = FALSE;
+		}
+	}
+
+	/*
+	 * Save the results in a new cache file if anything changed.
+	 */
+	if (needCount > 0)
+		WriteCache(map, mapSize, table, stamps, validStamps, count);
+
+	if (map)
+		munmap(map, mapSize);
+
+	free(needTable);
+	free(needIndex);
+	free(validStamps);
+	free(stamps);
+	free(parents);
+
+	return PATH_OK;
+}
+
+
+/*
+ * Get the name of a cache file in the runtime directory into the
+ * supplied buffer.  Returns FALSE if there is no runtime directory
+ * to keep it in.
+ */
+static BOOL
+GetCacheName(const char * fileName, char * buf, int bufSize)
+{
+	const char *	dir;
+
+	dir = getenv("XDG_RUNTIME_DIR");
+
+	if ((dir == NULL) || (*dir != ROOT_CHARACTER))
+		return FALSE;
+
+	return (snprintf(buf, bufSize, "%s/%s", dir, fileName) < bufSize);
+}
+
+
+/*
+ * Get the stamp of the parent directory of an absolute path, using the
+ * table of parent directories already found if possible.
+ * Returns FALSE if the result for the path cannot be cached,
+ * either because its parent directory cannot be found or because
+ * its last component is a DOT or DOT-DOT which has no parent entry.
+ */
+static BOOL
+GetCacheStamp(const char * path, CACHE_STAMP * stamp,
+	CACHE_PARENT * parents, int parentCount)
+{
+	CACHE_PARENT *	parent;
+	struct	stat	statbuf;
+	char		parentName[PATH_MAX];
+	const char *	last;
+	unsigned int	hash;
+	int		len;
+	int		index;
+
+	/*
+	 * Find the last component of the path ignoring trailing slashes.
+	 * The parent directory is the part of the path before that, or
+	 * the root directory itself.
+	 */
+	len = strlen(path);
+
+	while ((len > 1) && (path[len - 1] == ROOT_CHARACTER))
+		len--;
+
+	last = path + len;
+
+	while (last[-1] != ROOT_CHARACTER)
+		last--;
+
+	if (((path + len - last == 1) && (last[0] == '.')) ||
+		((path + len - last == 2) && (last[0] == '.') &&
+			(last[1] == '.')))
+	{
+		return FALSE;
+	}
+
+	len = last - path;
+
+	if (len > 1)
+		len--;
+
+	if (len >= PATH_MAX)
+		return FALSE;
+
+	/*
+	 * Look for the parent directory in the table.
+	 */
+	hash = HASH_BASIS;
+
+	for (index = 0; index < len; index++)
+	{
+		hash ^= (unsigned char) path[index];
+		hash *= HASH_PRIME;
+	}
+
+	index = hash & (parentCount - 1);
+
+	while (parents[index].length != 0)
+	{
+		parent = &parents[index];
+
+		if ((parent->hash == hash) && (parent->length == len) &&
+			(memcmp(parent->name, path, len) == 0))
+		{
+			*stamp = parent->stamp;
+
+			return parent->valid;
+		}
+
+		index = (index + 1) & (parentCount - 1);
+	}
+
+	/*
+	 * It is not there, so find its stamp and add it to the table.
+	 */
+	parent = &parents[index];
+	parent->name = path;
+	parent->length = len;
+	parent->hash = hash;
+	parent->valid = FALSE;
+
+	memset(&parent->stamp, 0, sizeof(CACHE_STAMP));
+
+	memcpy(parentName, path, len);
+	parentName[len] = '\0';
+
+	if (stat(parentName, &statbuf) == 0)
+	{
+		parent->valid = TRUE;
+		parent->stamp.dev = statbuf.st_dev;
+		parent->stamp.ino = statbuf.st_ino;
+		parent->stamp.ctimeSec = statbuf.st_ctim.tv_sec;
+		parent->stamp.ctimeNsec = statbuf.st_ctim.tv_nsec;
+	}
+
+	*stamp = parent->stamp;
+
+	return parent->valid;
+}
+
+
+/*
+ * Check that the header of a mapped cache file is sensible and agrees
+ * with the size of the file.  Returns the header, or NULL if it is bad.
+ */
+static const CACHE_HEADER *
+CheckCacheHeader(const char * map, size_t mapSize)
+{
+	const CACHE_HEADER *	header;
+
+	if ((map == NULL) || (mapSize < sizeof(CACHE_HEADER)))
+		return NULL;
+
+	header = (const CACHE_HEADER *) map;
+
+	if ((header->magic != CACHE_MAGIC) || (header->slotCount == 0) ||
+		(header->slotCount & (header->slotCount - 1)) ||
+		(header->slotCount > CACHE_MAX_ENTRIES * 2) ||
+		(mapSize != sizeof(CACHE_HEADER) + header->slotCount *
+			sizeof(CACHE_SLOT) + header->namesSize))
+	{
+		return NULL;
+	}
+
+	return header;
+}
+
+
+/*
+ * Find the slot for a path in a mapped cache file.
+ * The header and the slots of the file are checked to be sensible.
+ * Returns NULL if the path is not present.
+ */
+static const CACHE_SLOT *
+FindCacheSlot(const char * map, size_t mapSize, const char * path)
+{
+	const CACHE_HEADER *	header;
+	const CACHE_SLOT *	slots;
+	const CACHE_SLOT *	slot;
+	const char *		names;
+	unsigned int		hash;
+	unsigned int		index;
+	unsigned int		probes;
+	size_t			len;
+
+	header = CheckCacheHeader(map, mapSize);
+
+	if (header == NULL)
+		return NULL;
+
+	slots = (const CACHE_SLOT *) (map + sizeof(CACHE_HEADER));
+	names = (const char *) (slots + header->slotCount);
+	hash = HashPath(path);
+	len = strlen(path);
+
+	index = hash & (header->slotCount - 1);
+
+	for (probes = 0; probes < header->slotCount; probes++)
+	{
+		slot = &slots[index];
+
+		if (slot->nameLength == 0)
+			return NULL;
+
+		if ((slot->hash == hash) && (slot->nameLength == len) &&
+			(slot->nameOffset <= header->namesSize) &&
+			(len <= header->namesSize - slot->nameOffset) &&
+			(memcmp(names + slot->nameOffset, path, len) == 0))
+		{
+			return slot;
+		}
+
+		index = (index + 1) & (header->slotCount - 1);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Find the filesystem type saved in a slot of a cache file by its magic
+ * number, since the cache may have been written by another version with
+ * a different table of types.  Returns NULL if the type is not known.
+ */
+static const PATH_FS_TYPE *
+FindCacheFsType(const CACHE_SLOT * slot)
+{
+	const PATH_FS_TYPE *	fsType;
+
+	for (fsType = PathFsTypes(); fsType->name; fsType++)
+	{
+		if ((uint32_t) fsType->type == slot->fsMagic)
+			return fsType;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Write a new cache file containing the up to date results from the table
+ * of paths, followed by as many of the other entries of the old cache
+ * file as will fit.  The new file replaces the old one atomically.
+ * Returns TRUE if the cache file was written.
+ */
+static BOOL
+WriteCache(const char * map, size_t mapSize, const PATH_STAT * table,
+	const CACHE_STAMP * stamps, const BOOL * validStamps, int count)
+{
+	const CACHE_HEADER *	oldHeader;
+	const CACHE_SLOT *	oldSlots;
+	const CACHE_SLOT *	oldSlot;
+	const char *		oldNames;
+	CACHE_HEADER *		header;
+	CACHE_SLOT *		slots;
+	CACHE_SLOT *		slot;
+	char *			names;
+	char *			buf;
+	char			cacheName[PATH_MAX];
+	unsigned int		slotCount;
+	unsigned int		namesSize;
+	unsigned int		hash;
+	unsigned int		oldIndex;
+	unsigned int		index;
+	unsigned int		len;
+	size_t			bufSize;
+	int			entry;
+	BOOL			success;
+
+	if (!GetCacheName(CACHE_FILE_NAME, cacheName, sizeof(cacheName)))
+		return FALSE;
+
+	/*
+	 * Size the new file generously for the old and new entries.
+	 */
+	oldHeader = CheckCacheHeader(map, mapSize);
+
+	slotCount = 16;
+
+	while (slotCount < 2 * (count + (oldHeader ?
+		oldHeader->entryCount : 0)) && (slotCount < 2 * CACHE_MAX_ENTRIES))
+	{
+		slotCount *= 2;
+	}
+
+	namesSize = 0;
+
+	for (entry = 0; entry < count; entry++)
+		namesSize += strlen(table[entry].path);
+
+	if (oldHeader)
+		namesSize += oldHeader->namesSize;
+
+	bufSize = sizeof(CACHE_HEADER) + slotCount * sizeof(CACHE_SLOT) +
+		namesSize;
+
+	buf = (char *) calloc(1, bufSize);
+
+	if (buf == NULL)
+		return FALSE;
+
+	header = (CACHE_HEADER *) buf;
+	slots = (CACHE_SLOT *) (buf + sizeof(CACHE_HEADER));
+	names = (char *) (slots + slotCount);
+
+	header->magic = CACHE_MAGIC;
+	header->slotCount = slotCount;
+	header->entryCount = 0;
+	header->namesSize = 0;
+
+	/*
+	 * Add the new results first, and then the old entries which are
+	 * for other paths, as long as the table stays half empty.
+	 * Slow paths have no result, and are not saved.
+	 */
+	for (entry = 0; entry < count; entry++)
+	{
+		if (!validStamps[entry] || table[entry].slow ||
+			(header->entryCount >= slotCount / 2))
+		{
+			continue;
+		}
+
+		hash = HashPath(table[entry].path);
+		len = strlen(table[entry].path);
+		index = hash & (slotCount - 1);
+
+		while (slots[index].nameLength != 0)
+		{
+			if ((slots[index].hash == hash) &&
+				(slots[index].nameLength == len) &&
+				(memcmp(names + slots[index].nameOffset,
+					table[entry].path, len) == 0))
+			{
+				break;
+			}
+
+			index = (index + 1) & (slotCount - 1);
+		}
+
+		if (slots[index].nameLength != 0)
+			continue;
+
+		slot = &slots[index];
+		slot->hash = hash;
+		slot->nameOffset = header->namesSize;
+		slot->nameLength = len;
+		slot->error = table[entry].error;
+		slot->mode = table[entry].mode;
+		slot->dev = table[entry].dev;
+		slot->ino = table[entry].ino;
+		slot->stamp = stamps[entry];
+		slot->fsState = CACHE_UNKNOWN_FS_TYPE;
+
+		if (demoteNetworkFlag || reportFsFlag)
+			slot->fsState = CACHE_NO_FS_TYPE;
+
+		if ((demoteNetworkFlag || reportFsFlag) && table[entry].fsType)
+		{
+			slot->fsState = CACHE_FS_TYPE;
+			slot->fsMagic = (uint32_t) table[entry].fsType->type;
+		}
+
+		memcpy(names + header->namesSize, table[entry].path, len);
+		header->namesSize += len;
+		header->entryCount++;
+	}
+
+	if (oldHeader)
+	{
+		oldSlots = (const CACHE_SLOT *) (map + sizeof(CACHE_HEADER));
+		oldNames = (const char *) (oldSlots + oldHeader->slotCount);
+
+		for (oldIndex = 0; oldIndex < oldHeader->slotCount; oldIndex++)
+		{
+			oldSlot = &oldSlots[oldIndex];
+			len = oldSlot->nameLength;
+
+			if ((len == 0) || (oldSlot->nameOffset >
+				oldHeader->namesSize) || (len >
+				oldHeader->namesSize - oldSlot->nameOffset) ||
+				(header->entryCount >= slotCount / 2))
+			{
+				continue;
+			}
+
+			index = oldSlot->hash & (slotCount - 1);
+
+			while (slots[index].nameLength != 0)
+			{
+				if ((slots[index].hash == oldSlot->hash) &&
+					(slots[index].nameLength == len) &&
+					(memcmp(names + slots[index].nameOffset,
+						oldNames + oldSlot->nameOffset,
+						len) == 0))
+				{
+					break;
+				}
+
+				index = (index + 1) & (slotCount - 1);
+			}
+
+			if (slots[index].nameLength != 0)
+				continue;
+
+			slots[index] = *oldSlot;
+			slots[index].nameOffset = header->namesSize;
+
+			memcpy(names + header->namesSize,
+				oldNames + oldSlot->nameOffset, len);
+
+			header->namesSize += len;
+			header->entryCount++;
+		}
+	}
+
+	bufSize = sizeof(CACHE_HEADER) + slotCount * sizeof(CACHE_SLOT) +
+		header->namesSize;
+
+	success = WriteFileSafely(cacheName, buf, bufSize);
+
+	free(buf);
+
+	return success;
+}
+
+
+/*
+ * Write the contents of a file under a temporary name in the same
+ * directory and then rename it, so that readers of the file only ever
+ * see the old or the new contents.  Returns TRUE if it was written.
+ */
+static BOOL
+WriteFileSafely(const char * name, const char * buf, size_t size)
+{
+	char	tempName[PATH_MAX + 8];
+	int	fd;
+	BOOL	success;
+
+	if (snprintf(tempName, sizeof(tempName), "%s.XXXXXX", name) >=
+		(int) sizeof(tempName))
+	{
+		return FALSE;
+	}
+
+	fd = mkstemp(tempName);
+
+	if (fd < 0)
+		return FALSE;
+
+	success = (write(fd, buf, size) == (ssize_t) size);
+
+	if (close(fd) < 0)
+		success = FALSE;
+
+	if (success && (rename(tempName, name) < 0))
+		success = FALSE;
+
+	if (!success)
+		unlink(tempName);
+
+	return success;
+}
+
+
+/*
+ * Make a table of the names of the paths in their list order.
+ * The table is NOT terminated with a null pointer.
+ * This exits on an malloc failure.
+ */
+static const char **
+MakePathTable(void)
+{
+	const char **	table;
+
+	table = (const char **) malloc(sizeof(const char *) *
+		(PathCount(pathContext) + 1));
+
+	if (table == NULL)
+	{
+		fprintf(stderr, "Cannot allocate path table\n");
+
+		exit(1);
+	}
+
+	PathTable(pathContext, table);
+
+	return table;
+}
+
+/*
+ * Look up the command names which were given for the -which option in
+ * the directories of the final path list, and print where they are found.
+ * The index of commands is read from the index file if one was given and
+ * it is still up to date, and otherwise it is built by reading all of the
+ * directories and then saved in the index file if one was given.
+ * Returns TRUE if all of the commands were found.
+ */
+static BOOL
+FindCommands(void)
+{
+	const char **	dirTable;
+	const char *	image;
+	char *		builtImage;
+	char *		map;
+	struct	stat	statbuf;
+	OUTPUT		output;
+	size_t		mapSize;
+	size_t		builtSize;
+	int		index;
+	int		fd;
+	BOOL		found;
+
+	dirTable = MakePathTable();
+
+	/*
+	 * Try to use the existing index file.
+	 */
+	image = NULL;
+	map = NULL;
+	mapSize = 0;
+
+	if (indexName)
+	{
+		fd = open(indexName, O_RDONLY);
+
+		if (fd >= 0)
+		{
+			if ((fstat(fd, &statbuf) == 0) &&
+				(statbuf.st_size >= (off_t) sizeof(INDEX_HEADER)))
+			{
+				mapSize = statbuf.st_size;
+				map = mmap(NULL, mapSize, PROT_READ,
+					MAP_PRIVATE, fd, 0);
+
+				if (map == MAP_FAILED)
+					map = NULL;
+			}
+
+			close(fd);
+		}
+
+		if (map)
+			image = CheckIndex(map, mapSize, dirTable, PathCount(pathContext));
+	}
+
+	/*
+	 * If there is no usable index file, then build a new index and
+	 * save it if required.
+	 */
+	builtImage = NULL;
+
+	if (image == NULL)
+	{
+		builtImage = BuildIndex(dirTable, PathCount(pathContext), SCAN_ALL,
+			&builtSize);
+
+		if (builtImage == NULL)
+		{
+			fprintf(stderr, "Cannot allocate command index\n");
+
+			if (map)
+				munmap(map, mapSize);
+
+			free(dirTable);
+
+			return FALSE;
+		}
+
+		if (indexName && !WriteFileSafely(indexName, builtImage,
+			builtSize))
+		{
+			fprintf(stderr, "Cannot write index file \"%s\"\n",
+				indexName);
+		}
+
+		image = builtImage;
+	}
+
+	/*
+	 * Now look up each of the commands.
+	 */
+	found = TRUE;
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	for (index = 0; index < whichCount; index++)
+	{
+		if (!FindCommand(image, whichTable[index], whichAllFlag,
+			&output))
+		{
+			fprintf(stderr, "Command \"%s\" not found\n",
+				whichTable[index]);
+
+			found = FALSE;
+		}
+
+		fwrite(output.data, 1, output.used, stdout);
+		output.used = 0;
+	}
+
+	if (map)
+		munmap(map, mapSize);
+
+	free(output.data);
+	free(builtImage);
+	free(dirTable);
+
+	return found;
+}
+
+
+/*
+ * Look up one command name in an index and output the full path of the
+ * first executable file with that name, or of all of them if required,
+ * each on its own line.  A command name containing a slash is not looked
+ * up in the path list.
+ * Returns TRUE if the command was found.
+ */
+static BOOL
+FindCommand(const char * image, const char * name, BOOL all,
+	OUTPUT * output)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_DIR *	dirs;
+	const INDEX_SLOT *	slot;
+	const uint32_t *	refs;
+	const char *		names;
+	const INDEX_DIR *	dir;
+	char			fullPath[PATH_MAX];
+	uint32_t		ref;
+	BOOL			found;
+
+	if (strchr(name, ROOT_CHARACTER))
+	{
+		if (!IsExecutable(name))
+			return FALSE;
+
+		AppendOutput(output, name);
+		AppendOutput(output, "\n");
+
+		return TRUE;
+	}
+
+	slot = FindIndexSlot(image, name);
+
+	if (slot == NULL)
+		return FALSE;
+
+	header = (const INDEX_HEADER *) image;
+	dirs = (const INDEX_DIR *) (header + 1);
+	refs = (const uint32_t *) ((const INDEX_SLOT *) (dirs +
+		header->dirCount) + header->slotCount);
+	names = (const char *) (refs + header->refCount);
+
+	/*
+	 * The directories containing the name are in list order, so the
+	 * first one in which it is an executable file is the one used.
+	 */
+	found = FALSE;
+
+	for (ref = slot->firstRef; ref < slot->firstRef + slot->refCount;
+		ref++)
+	{
+		dir = &dirs[refs[ref]];
+
+		if (snprintf(fullPath, sizeof(fullPath), "%.*s/%s",
+			(int) dir->nameLength, names + dir->nameOffset,
+			name) >= (int) sizeof(fullPath))
+		{
+			continue;
+		}
+
+		if (!IsExecutable(fullPath))
+			continue;
+
+		AppendOutput(output, fullPath);
+		AppendOutput(output, "\n");
+		found = TRUE;
+
+		if (!all)
+			break;
+	}
+
+	return found;
+}
+
+
+/*
+ * Return whether a path is an executable file.
+ */
+static BOOL
+IsExecutable(const char * path)
+{
+	struct	stat	statbuf;
+
+	return ((stat(path, &statbuf) == 0) && S_ISREG(statbuf.st_mode) &&
+		(access(path, X_OK) == 0));
+}
+
+
+/*
+ * Watch the directories of the final path list and serve the index of
+ * the commands in them to clients of a local socket, keeping it current
+ * as commands are added or removed.  The directories are read once, and
+ * then only those with changes reported by inotify for themselves or for
+ * the directories above them are read again.  If an index file was given,
+ * then it is rewritten after every change so that other programs can map
+ * the current index.  This only returns when stopped by a signal.
+ * Returns TRUE if the daemon ran successfully.
+ */
+static BOOL
+WatchPaths(void)
+{
+#if defined(BASH_BUILTIN)
+	fprintf(stderr, "Option \"%s\" cannot be used in the builtin\n",
+		OPTION_WATCH);
+
+	return FALSE;
+#elif !defined(HAVE_WATCH)
+	fprintf(stderr, "Directories cannot be watched on this system\n");
+
+	return FALSE;
+#else
+	const char **	dirTable;
+	DIR_SCAN *	scans;
+	BOOL *		changed;
+	WATCH_ENTRY *	watchTable;
+	WATCH_CLIENT *	clients;
+	WATCH_CLIENT *	client;
+	struct	pollfd	pollTable[WATCH_MAX_CLIENTS + 2];
+	struct	sigaction	sa;
+	struct	timespec	now;
+	struct	timespec	waitTime;
+	sigset_t	stopMask;
+	sigset_t	oldMask;
+	char *		image;
+	long long	changeTime;
+	long long	nowMs;
+	unsigned long	generation;
+	int		watchCount;
+	int		dirCount;
+	int		notifyFd;
+	int		listenFd;
+	int		pollCount;
+	int		timeout;
+	int		index;
+	int		fd;
+	BOOL		pending;
+	BOOL		status;
+
+	dirTable = MakePathTable();
+	dirCount = PathCount(pathContext);
+
+	scans = (DIR_SCAN *) calloc(dirCount + 1, sizeof(DIR_SCAN));
+	changed = (BOOL *) calloc(dirCount + 1, sizeof(BOOL));
+	clients = (WATCH_CLIENT *) malloc(sizeof(WATCH_CLIENT) *
+		WATCH_MAX_CLIENTS);
+
+	if ((scans == NULL) || (changed == NULL) || (clients == NULL))
+	{
+		fprintf(stderr, "Cannot allocate watch tables\n");
+
+		exit(1);
+	}
+
+	for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+		clients[index].fd = -1;
+
+	status = FALSE;
+	image = NULL;
+	watchTable = NULL;
+	watchCount = 0;
+	listenFd = -1;
+
+	/*
+	 * Start watching before the directories are first read so that no
+	 * changes are missed, and then read all of them.
+	 */
+	notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+	if (notifyFd < 0)
+	{
+		fprintf(stderr, "Cannot start watching directories: %s\n",
+			strerror(errno));
+
+		goto done;
+	}
+
+	if (!AddWatches(notifyFd, dirTable, dirCount, &watchTable,
+		&watchCount))
+	{
+		goto done;
+	}
+
+	for (index = 0; index < dirCount; index++)
+	{
+		scans[index].path = dirTable[index];
+		scans[index].mode = SCAN_ALL;
+		changed[index] = TRUE;
+	}
+
+	if (!ReadDirectories(scans, dirTable, dirCount, changed, &image))
+		goto done;
+
+	generation = 1;
+
+	listenFd = OpenWatchSocket(watchName);
+
+	if (listenFd < 0)
+		goto done;
+
+	/*
+	 * Stop cleanly when interrupted or terminated.  The signals are
+	 * blocked except while waiting, so that one which arrives after the
+	 * flag is tested still interrupts the wait instead of being missed.
+	 */
+	watchStopped = 0;
+	sigemptyset(&stopMask);
+	sigaddset(&stopMask, SIGINT);
+	sigaddset(&stopMask, SIGTERM);
+	sigaddset(&stopMask, SIGHUP);
+	sigprocmask(SIG_BLOCK, &stopMask, &oldMask);
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = StopWatching;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGHUP, &sa, NULL);
+
+	pending = FALSE;
+	changeTime = 0;
+
+	while (!watchStopped)
+	{
+		/*
+		 * Wait for changes or requests.  If there are changes which
+		 * have not been handled yet, then only wait until they have
+		 * settled.
+		 */
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		nowMs = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+		timeout = -1;
+
+		if (pending)
+		{
+			timeout = (int) (changeTime + WATCH_SETTLE_MS - nowMs);
+
+			if (timeout < 0)
+				timeout = 0;
+		}
+
+		pollTable[0].fd = notifyFd;
+		pollTable[0].events = POLLIN;
+		pollTable[1].fd = listenFd;
+		pollTable[1].events = POLLIN;
+		pollCount = 2;
+
+		for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+		{
+			pollTable[pollCount].fd = clients[index].fd;
+			pollTable[pollCount].events = POLLIN;
+			pollTable[pollCount].revents = 0;
+			pollCount++;
+		}
+
+		waitTime.tv_sec = timeout / 1000;
+		waitTime.tv_nsec = (timeout % 1000) * 1000000L;
+
+		if (ppoll(pollTable, pollCount,
+			(timeout < 0) ? NULL : &waitTime, &oldMask) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			fprintf(stderr, "Cannot wait for changes: %s\n",
+				strerror(errno));
+
+			goto done;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		nowMs = now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+
+		/*
+		 * Remember which directories have changed, and restart the
+		 * time for them to settle.
+		 */
+		if ((pollTable[0].revents & POLLIN) &&
+			ReadChanges(notifyFd, dirTable, dirCount, watchTable,
+				watchCount, changed))
+		{
+			pending = TRUE;
+			changeTime = nowMs;
+		}
+
+		/*
+		 * If the changes have settled, then read the directories
+		 * again, watch any directories which have appeared, and tell
+		 * the clients waiting for the change.
+		 */
+		if (pending && (nowMs - changeTime >= WATCH_SETTLE_MS))
+		{
+			pending = FALSE;
+
+			if (!AddWatches(notifyFd, dirTable, dirCount,
+				&watchTable, &watchCount))
+			{
+				goto done;
+			}
+
+			if (!ReadDirectories(scans, dirTable, dirCount,
+				changed, &image))
+			{
+				goto done;
+			}
+
+			generation++;
+
+			for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+			{
+				client = &clients[index];
+
+				if ((client->fd < 0) || !client->waiting)
+					continue;
+
+				client->waiting = FALSE;
+
+				if (!SendGeneration(client, generation) ||
+					!ReadRequests(client, image, generation))
+				{
+					close(client->fd);
+					client->fd = -1;
+				}
+			}
+		}
+
+		/*
+		 * Handle the requests from the clients, and close those
+		 * which have gone away.
+		 */
+		for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+		{
+			client = &clients[index];
+
+			if ((client->fd < 0) ||
+				!(pollTable[index + 2].revents &
+					(POLLIN | POLLHUP | POLLERR)))
+			{
+				continue;
+			}
+
+			if (!ReadRequests(client, image, generation))
+			{
+				close(client->fd);
+				client->fd = -1;
+			}
+		}
+
+		/*
+		 * Accept a new client if there is room for it.
+		 */
+		if (pollTable[1].revents & POLLIN)
+		{
+			fd = accept4(listenFd, NULL, NULL,
+				SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+			if (fd < 0)
+				continue;
+
+			for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+			{
+				if (clients[index].fd < 0)
+					break;
+			}
+
+			if (index >= WATCH_MAX_CLIENTS)
+			{
+				close(fd);
+
+				continue;
+			}
+
+			client = &clients[index];
+			client->fd = fd;
+			client->used = 0;
+			client->waiting = FALSE;
+		}
+	}
+
+	status = TRUE;
+
+done:
+	for (index = 0; index < WATCH_MAX_CLIENTS; index++)
+	{
+		if (clients[index].fd >= 0)
+			close(clients[index].fd);
+	}
+
+	/*
+	 * The signals were blocked once the socket was opened.
+	 */
+	if (listenFd >= 0)
+	{
+		sigprocmask(SIG_SETMASK, &oldMask, NULL);
+		close(listenFd);
+		unlink(watchName);
+	}
+
+	if (notifyFd >= 0)
+		close(notifyFd);
+
+	for (index = 0; index < dirCount; index++)
+		free(scans[index].names);
+
+	free(scans);
+	free(changed);
+	free(clients);
+	free(watchTable);
+	free(image);
+	free(dirTable);
+
+	return status;
+#endif
+}
+
+
+#if defined(HAVE_WATCH)
+/*
+ * Open the socket on which the daemon of -watch listens for clients.
+ * A socket left by a daemon which is no longer running is replaced, but
+ * one which still has a daemon listening on it is not.
+ * Returns the socket, or -1 on an error.
+ */
+static int
+OpenWatchSocket(const char * name)
+{
+	struct	sockaddr_un	addr;
+	struct	stat		statbuf;
+	int			fd;
+
+	if (strlen(name) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Socket name \"%s\" is too long\n", name);
+
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, name);
+
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (fd < 0)
+	{
+		fprintf(stderr, "Cannot create socket: %s\n", strerror(errno));
+
+		return -1;
+	}
+
+	if ((lstat(name, &statbuf) == 0) && S_ISSOCK(statbuf.st_mode))
+	{
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+		{
+			fprintf(stderr, "Socket \"%s\" is already being served\n",
+				name);
+
+			close(fd);
+
+			return -1;
+		}
+
+		unlink(name);
+	}
+
+	if ((bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) ||
+		(listen(fd, WATCH_MAX_CLIENTS) < 0))
+	{
+		fprintf(stderr, "Cannot listen on socket \"%s\": %s\n",
+			name, strerror(errno));
+
+		close(fd);
+
+		return -1;
+	}
+
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+
+	return fd;
+}
+
+
+/*
+ * Watch each directory of the path list and each of the directories
+ * above it, so that the directory appearing, disappearing, or being
+ * replaced is seen as well as the changes within it.  This is done again
+ * after changes so that newly created directories are watched, and the
+ * watches which are no longer needed are removed.  Directories which do
+ * not exist are simply not watched.
+ * Returns TRUE if successful.
+ */
+static BOOL
+AddWatches(int notifyFd, const char ** dirTable, int dirCount,
+	WATCH_ENTRY ** tablePtr, int * countPtr)
+{
+	WATCH_ENTRY *	oldTable;
+	WATCH_ENTRY *	table;
+	const char *	path;
+	char		prefix[PATH_MAX];
+	int		oldCount;
+	int		count;
+	int		size;
+	int		dirIndex;
+	int		length;
+	int		index;
+	int		other;
+	int		wd;
+
+	oldTable = *tablePtr;
+	oldCount = *countPtr;
+
+	size = 0;
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+	{
+		size++;
+
+		for (path = dirTable[dirIndex]; *path; path++)
+		{
+			if (*path == ROOT_CHARACTER)
+				size++;
+		}
+	}
+
+	table = (WATCH_ENTRY *) malloc(sizeof(WATCH_ENTRY) * (size + 1));
+
+	if (table == NULL)
+	{
+		fprintf(stderr, "Cannot allocate watch table\n");
+
+		return FALSE;
+	}
+
+	count = 0;
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+	{
+		path = dirTable[dirIndex];
+		length = strlen(path);
+
+		if (length >= (int) sizeof(prefix))
+			continue;
+
+		/*
+		 * Watch the directory itself, and then the directories
+		 * above it which are found by the slashes in its name.
+		 */
+		wd = inotify_add_watch(notifyFd, path, WATCH_DIR_EVENTS);
+
+		if (wd >= 0)
+		{
+			table[count].wd = wd;
+			table[count].dirIndex = dirIndex;
+			table[count].length = length;
+			count++;
+		}
+
+		for (index = 0; index < length; index++)
+		{
+			if (path[index] != ROOT_CHARACTER)
+				continue;
+
+			other = ((index == 0) ? 1 : index);
+			memcpy(prefix, path, other);
+			prefix[other] = '\0';
+
+			wd = inotify_add_watch(notifyFd, prefix,
+				WATCH_PARENT_EVENTS);
+
+			if (wd < 0)
+				continue;
+
+			table[count].wd = wd;
+			table[count].dirIndex = dirIndex;
+			table[count].length = other;
+			count++;
+		}
+	}
+
+	/*
+	 * Remove the old watches which are no longer used.
+	 */
+	for (index = 0; index < oldCount; index++)
+	{
+		for (other = 0; other < count; other++)
+		{
+			if (table[other].wd == oldTable[index].wd)
+				break;
+		}
+
+		if (other >= count)
+			inotify_rm_watch(notifyFd, oldTable[index].wd);
+	}
+
+	free(oldTable);
+
+	*tablePtr = table;
+	*countPtr = count;
+
+	return TRUE;
+}
+
+
+/*
+ * Read the events which are waiting from inotify, and mark the directories
+ * which they affect as changed.  An event in a directory above one of the
+ * path list only affects it if it is for the entry leading towards it.
+ * If events were lost, then every directory is marked as changed.
+ * Returns TRUE if any directories were marked.
+ */
+static BOOL
+ReadChanges(int notifyFd, const char ** dirTable, int dirCount,
+	const WATCH_ENTRY * table, int count, BOOL * changed)
+{
+	const struct inotify_event *	event;
+	const WATCH_ENTRY *	entry;
+	const char *		path;
+	const char *		end;
+	union
+	{
+		struct	inotify_event	event;
+		char	buf[WATCH_EVENT_SIZE];
+	} events;
+	ssize_t			used;
+	ssize_t			offset;
+	int			index;
+	int			start;
+	BOOL			found;
+
+	found = FALSE;
+
+	while ((used = read(notifyFd, &events, sizeof(events))) > 0)
+	{
+		for (offset = 0; offset < used;
+			offset += sizeof(struct inotify_event) + event->len)
+		{
+			event = (const struct inotify_event *)
+				(events.buf + offset);
+
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				for (index = 0; index < dirCount; index++)
+					changed[index] = TRUE;
+
+				found = TRUE;
+
+				continue;
+			}
+
+			for (entry = table; entry < table + count; entry++)
+			{
+				if (entry->wd != event->wd)
+					continue;
+
+				path = dirTable[entry->dirIndex];
+
+				/*
+				 * Any event for the directory itself, or for
+				 * a directory above it going away, is a change.
+				 */
+				if ((path[entry->length] == '\0') ||
+					(event->mask & (IN_DELETE_SELF |
+						IN_MOVE_SELF | IN_IGNORED)))
+				{
+					changed[entry->dirIndex] = TRUE;
+					found = TRUE;
+
+					continue;
+				}
+
+				if (event->len == 0)
+					continue;
+
+				/*
+				 * See if the event is for the next part of the
+				 * name of the directory.
+				 */
+				start = entry->length;
+
+				if (path[start] == ROOT_CHARACTER)
+					start++;
+
+				end = strchr(path + start, ROOT_CHARACTER);
+
+				if (end == NULL)
+					end = path + strlen(path);
+
+				if ((strncmp(event->name, path + start,
+					end - (path + start)) == 0) &&
+					(event->name[end - (path + start)] == '\0'))
+				{
+					changed[entry->dirIndex] = TRUE;
+					found = TRUE;
+				}
+			}
+		}
+	}
+
+	return found;
+}
+
+
+/*
+ * Read the directories of the path list which have changed and make a
+ * new index of the commands in all of them, which replaces the previous
+ * one.  The new index is also written to the index file if one was given.
+ * Returns TRUE if successful.
+ */
+static BOOL
+ReadDirectories(DIR_SCAN * scans, const char ** dirTable, int dirCount,
+	BOOL * changed, char ** imagePtr)
+{
+	DIR_SCAN *	table;
+	char *		image;
+	size_t		size;
+	int		count;
+	int		index;
+
+	table = (DIR_SCAN *) malloc(sizeof(DIR_SCAN) * (dirCount + 1));
+
+	if (table == NULL)
+	{
+		fprintf(stderr, "Cannot allocate directory table\n");
+
+		return FALSE;
+	}
+
+	/*
+	 * Collect the changed directories into a table so that they are
+	 * read in parallel, and then put back the results.
+	 */
+	count = 0;
+
+	for (index = 0; index < dirCount; index++)
+	{
+		if (!changed[index])
+			continue;
+
+		free(scans[index].names);
+		table[count++] = scans[index];
+	}
+
+	ScanDirectories(table, count);
+
+	count = 0;
+
+	for (index = 0; index < dirCount; index++)
+	{
+		if (!changed[index])
+			continue;
+
+		scans[index] = table[count++];
+		changed[index] = FALSE;
+	}
+
+	free(table);
+
+	image = MakeIndex(scans, dirTable, dirCount, &size);
+
+	if (image == NULL)
+	{
+		fprintf(stderr, "Cannot allocate command index\n");
+
+		return FALSE;
+	}
+
+	if (indexName && !WriteFileSafely(indexName, image, size))
+	{
+		fprintf(stderr, "Cannot write index file \"%s\"\n",
+			indexName);
+	}
+
+	free(*imagePtr);
+	*imagePtr = image;
+
+	return TRUE;
+}
+
+
+/*
+ * Read what a client has sent and handle each complete request line.
+ * A client waiting for a change keeps its following requests until the
+ * change happens, and is dropped if they do not fit in its buffer.
+ * Returns FALSE if the client has gone away or is to be dropped.
+ */
+static BOOL
+ReadRequests(WATCH_CLIENT * client, const char * image,
+	unsigned long generation)
+{
+	char *	line;
+	char *	end;
+	ssize_t	count;
+	size_t	length;
+
+	for (;;)
+	{
+		/*
+		 * Handle all of the complete requests which are buffered.
+		 */
+		while (!client->waiting)
+		{
+			line = client->line;
+			end = memchr(line, '\n', client->used);
+
+			if (end == NULL)
+				break;
+
+			*end = '\0';
+			length = end + 1 - line;
+
+			if ((end > line) && (end[-1] == '\r'))
+				end[-1] = '\0';
+
+			if (!HandleRequest(client, line, image, generation))
+				return FALSE;
+
+			client->used -= length;
+			memmove(line, line + length, client->used);
+		}
+
+		if (client->used >= sizeof(client->line))
+			return FALSE;
+
+		count = read(client->fd, client->line + client->used,
+			sizeof(client->line) - client->used);
+
+		if (count == 0)
+			return FALSE;
+
+		if (count < 0)
+			return ((errno == EAGAIN) || (errno == EINTR));
+
+		client->used += count;
+	}
+}
+
+
+/*
+ * Handle one request from a client of the daemon of -watch and send the
+ * reply, which is ended by an empty line.  The requests are:
+ * 	which name	the first place the command is found
+ * 	all name	all of the places the command is found
+ * 	generation	the number of the current index
+ * 	wait number	the number of the index once it is not this one
+ * Returns FALSE if the reply could not be sent.
+ */
+static BOOL
+HandleRequest(WATCH_CLIENT * client, char * line, const char * image,
+	unsigned long generation)
+{
+	OUTPUT	output;
+	char *	arg;
+	BOOL	status;
+
+	output.data = NULL;
+	output.used = 0;
+	output.size = 0;
+
+	arg = strchr(line, ' ');
+
+	if (arg)
+		*arg++ = '\0';
+
+	if ((strcmp(line, "which") == 0) && arg && *arg)
+		FindCommand(image, arg, FALSE, &output);
+	else if ((strcmp(line, "all") == 0) && arg && *arg)
+		FindCommand(image, arg, TRUE, &output);
+	else if ((strcmp(line, "generation") == 0) && (arg == NULL))
+		return SendGeneration(client, generation);
+	else if ((strcmp(line, "wait") == 0) && arg && *arg)
+	{
+		/*
+		 * Only reply once the index is different.
+		 */
+		if (strtoul(arg, NULL, 10) != generation)
+			return SendGeneration(client, generation);
+
+		client->waiting = TRUE;
+
+		return TRUE;
+	}
+	else
+		AppendOutput(&output, "error unknown request\n");
+
+	AppendOutput(&output, "\n");
+
+	status = SendReply(client, output.data, output.used);
+
+	free(output.data);
+
+	return status;
+}
+
+
+/*
+ * Send the number of the current index to a client.
+ * Returns TRUE if it was sent.
+ */
+static BOOL
+SendGeneration(WATCH_CLIENT * client, unsigned long generation)
+{
+	char	buf[32];
+
+	snprintf(buf, sizeof(buf), "%lu\n\n", generation);
+
+	return SendReply(client, buf, strlen(buf));
+}
+
+
+/*
+ * Send a reply to a client.  A client which does not read its replies
+ * so that they cannot be sent at once is dropped.
+ * Returns TRUE if the whole reply was sent.
+ */
+static BOOL
+SendReply(WATCH_CLIENT * client, const char * data, size_t size)
+{
+	ssize_t	count;
+	size_t	offset;
+
+	offset = 0;
+
+	while (offset < size)
+	{
+		count = send(client->fd, data + offset, size - offset,
+			MSG_NOSIGNAL);
+
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			return FALSE;
+		}
+
+		offset += count;
+	}
+
+	return TRUE;
+}
+
+
+/*
+ * Signal handler which stops the daemon of -watch.
+ */
+static void
+StopWatching(int sig)
+{
+	watchStopped = 1;
+}
+#endif
+
+
+/*
+ * Report the commands in the directories of the final path list which are
+ * shadowed by commands with the same name in earlier directories.
+ * For each such command, in order of name, the directory where it is found
+ * is printed followed by the directories which it shadows.
+ * Returns TRUE if any commands are shadowed.
+ */
+static BOOL
+ReportShadows(void)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_DIR *	dirs;
+	const INDEX_SLOT *	slots;
+	const INDEX_SLOT **	shadowTable;
+	const uint32_t *	refs;
+	const char *		names;
+	const INDEX_DIR *	dir;
+	const char **		dirTable;
+	char *			image;
+	size_t			size;
+	unsigned int		index;
+	unsigned int		ref;
+	int			shadowCount;
+
+	dirTable = MakePathTable();
+	image = BuildIndex(dirTable, PathCount(pathContext), SCAN_EXEC, &size);
+
+	if (image == NULL)
+	{
+		fprintf(stderr, "Cannot allocate command index\n");
+
+		exit(1);
+	}
+
+	header = (const INDEX_HEADER *) image;
+	dirs = (const INDEX_DIR *) (header + 1);
+	slots = (const INDEX_SLOT *) (dirs + header->dirCount);
+	refs = (const uint32_t *) (slots + header->slotCount);
+	names = (const char *) (refs + header->refCount);
+
+	/*
+	 * Collect the commands which are in more than one directory,
+	 * and sort them by name.
+	 */
+	shadowTable = (const INDEX_SLOT **) malloc(sizeof(INDEX_SLOT *) *
+		(header->slotCount + 1));
+
+	if (shadowTable == NULL)
+	{
+		fprintf(stderr, "Cannot allocate command table\n");
+
+		exit(1);
+	}
+
+	shadowCount = 0;
+
+	for (index = 0; index < header->slotCount; index++)
+	{
+		if (slots[index].refCount > 1)
+			shadowTable[shadowCount++] = &slots[index];
+	}
+
+	shadowNames = names;
+
+	qsort(shadowTable, shadowCount, sizeof(const INDEX_SLOT *),
+		SlotSortCallback);
+
+	/*
+	 * Print each command with the directory it is found in first.
+	 */
+	for (index = 0; index < (unsigned int) shadowCount; index++)
+	{
+		fprintf(stdout, "%.*s:", (int) shadowTable[index]->nameLength,
+			names + shadowTable[index]->nameOffset);
+
+		for (ref = 0; ref < shadowTable[index]->refCount; ref++)
+		{
+			dir = &dirs[refs[shadowTable[index]->firstRef + ref]];
+
+			fprintf(stdout, "%s%.*s", (ref == 1) ? " shadows " : " ",
+				(int) dir->nameLength, names + dir->nameOffset);
+		}
+
+		fputc('\n', stdout);
+	}
+
+	free(shadowTable);
+	free(image);
+	free(dirTable);
+
+	return (shadowCount > 0);
+}
+
+
+/*
+ * Check the final path list as a class path for the -cp or -cpr options.
+ * An index of the classes and other resources in all of the jar files
+ * and directories is built in parallel.  Apart from the manifest and
+ * other files in META-INF, which every jar file has, a name is only used
+ * from the first entry which contains it.  An entry is shadowed if all of
+ * its names are in earlier entries, and it is redundant if none of its
+ * names are only in it.  For -cp, the classes in more than one entry are
+ * printed in order of name followed by the entries which contain them,
+ * and then the empty, shadowed and redundant entries are printed.  For -cpr,
+ * the empty and shadowed entries are removed, which does not change where
+ * any name is found, and they are reported to standard error.
+ * Returns TRUE if there was anything to report or remove.
+ */
+static BOOL
+CheckClassPath(void)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_DIR *	dirs;
+	const INDEX_SLOT *	slots;
+	const INDEX_SLOT *	slot;
+	const INDEX_SLOT **	dupTable;
+	const uint32_t *	refs;
+	const char *		names;
+	const char *		problem;
+	const char **		dirTable;
+	const INDEX_DIR *	dir;
+	char *			image;
+	int *			nameCounts;
+	int *			uniqueCounts;
+	int *			shadowedCounts;
+	size_t			size;
+	unsigned int		index;
+	unsigned int		ref;
+	int			dirCount;
+	int			dupCount;
+	int			entryCount;
+	int			previous;
+	int			dirIndex;
+	int			problemCount;
+
+	dirTable = MakePathTable();
+	dirCount = PathCount(pathContext);
+	image = BuildIndex(dirTable, dirCount, SCAN_CLASSES, &size);
+
+	nameCounts = (int *) calloc(dirCount + 1, sizeof(int));
+	uniqueCounts = (int *) calloc(dirCount + 1, sizeof(int));
+	shadowedCounts = (int *) calloc(dirCount + 1, sizeof(int));
+
+	if ((image == NULL) || (nameCounts == NULL) ||
+		(uniqueCounts == NULL) || (shadowedCounts == NULL))
+	{
+		fprintf(stderr, "Cannot allocate class index\n");
+
+		exit(1);
+	}
+
+	header = (const INDEX_HEADER *) image;
+	dirs = (const INDEX_DIR *) (header + 1);
+	slots = (const INDEX_SLOT *) (dirs + header->dirCount);
+	refs = (const uint32_t *) (slots + header->slotCount);
+	names = (const char *) (refs + header->refCount);
+
+	dupTable = (const INDEX_SLOT **) malloc(sizeof(INDEX_SLOT *) *
+		(header->slotCount + 1));
+
+	if (dupTable == NULL)
+	{
+		fprintf(stderr, "Cannot allocate class table\n");
+
+		exit(1);
+	}
+
+	/*
+	 * Count the names in each entry, those which are also in an
+	 * earlier entry, and those which are in no other entry.  A name
+	 * can appear more than once in a jar file, so the repeated
+	 * entry numbers for a name are skipped.
+	 */
+	dupCount = 0;
+
+	for (index = 0; index < header->slotCount; index++)
+	{
+		slot = &slots[index];
+
+		if (slot->nameLength == 0)
+			continue;
+
+		previous = -1;
+		entryCount = 0;
+
+		for (ref = 0; ref < slot->refCount; ref++)
+		{
+			dirIndex = refs[slot->firstRef + ref];
+
+			if (dirIndex == previous)
+				continue;
+
+			nameCounts[dirIndex]++;
+
+			if (previous >= 0)
+				shadowedCounts[dirIndex]++;
+
+			previous = dirIndex;
+			entryCount++;
+		}
+
+		if (entryCount == 1)
+			uniqueCounts[previous]++;
+
+		if ((entryCount > 1) && (slot->nameLength > 6) &&
+			(memcmp(names + slot->nameOffset + slot->nameLength - 6,
+				".class", 6) == 0))
+		{
+			dupTable[dupCount++] = slot;
+		}
+	}
+
+	/*
+	 * Print the duplicated classes sorted by name, with the entry
+	 * they are loaded from first.
+	 */
+	if (!classRemoveFlag)
+	{
+		shadowNames = names;
+
+		qsort(dupTable, dupCount, sizeof(const INDEX_SLOT *),
+			SlotSortCallback);
+
+		for (index = 0; index < (unsigned int) dupCount; index++)
+		{
+			slot = dupTable[index];
+
+			PrintClassName(names + slot->nameOffset,
+				slot->nameLength - 6);
+			fputc(':', stdout);
+
+			previous = -1;
+			entryCount = 0;
+
+			for (ref = 0; ref < slot->refCount; ref++)
+			{
+				dirIndex = refs[slot->firstRef + ref];
+
+				if (dirIndex == previous)
+					continue;
+
+				dir = &dirs[dirIndex];
+
+				fprintf(stdout, "%s%.*s",
+					(entryCount == 1) ? " shadows " : " ",
+					(int) dir->nameLength,
+					names + dir->nameOffset);
+
+				previous = dirIndex;
+				entryCount++;
+			}
+
+			fputc('\n', stdout);
+		}
+	}
+
+	/*
+	 * Print or remove the entries which contribute nothing.
+	 */
+	problemCount = 0;
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+	{
+		if (nameCounts[dirIndex] == 0)
+			problem = "empty";
+		else if (shadowedCounts[dirIndex] == nameCounts[dirIndex])
+			problem = "shadowed";
+		else if (uniqueCounts[dirIndex] == 0)
+			problem = "redundant";
+		else
+			continue;
+
+		if (!classRemoveFlag)
+		{
+			fprintf(stdout, "%s: %s\n", dirTable[dirIndex], problem);
+			problemCount++;
+
+			continue;
+		}
+
+		if (shadowedCounts[dirIndex] == nameCounts[dirIndex])
+		{
+			fprintf(stderr, "Removed %s class path entry \"%s\"\n",
+				problem, dirTable[dirIndex]);
+
+			HandlePath(dirTable[dirIndex], ACTION_REMOVE);
+			problemCount++;
+		}
+	}
+
+	free(dupTable);
+	free(shadowedCounts);
+	free(uniqueCounts);
+	free(nameCounts);
+	free(image);
+	free(dirTable);
+
+	return ((dupCount > 0) && !classRemoveFlag) || (problemCount > 0);
+}
+
+
+/*
+ * Print the name of a class file in a class path as the name of the class,
+ * which has periods instead of slashes between the package names.
+ */
+static void
+PrintClassName(const char * name, int length)
+{
+	while (length-- > 0)
+	{
+		fputc((*name == ROOT_CHARACTER) ? '.' : *name, stdout);
+		name++;
+	}
+}
+
+
+/*
+ * Reorder the final path list so that the commands in the profile given
+ * by -optimize are found after searching as few directories as possible,
+ * without changing the directory in which any command is found.  A
+ * directory holding a command must stay before every later directory
+ * which holds a command of the same name, and relative paths do not move
+ * since the commands they hold depend on the current directory.  Within
+ * these limits the directories are put in a greedy order of how often
+ * commands are found in them.  The estimated number of directories
+ * searched for each command is reported before and after.
+ * Returns TRUE if successful.
+ */
+static BOOL
+OptimizePaths(void)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_SLOT *	slots;
+	const INDEX_SLOT *	slot;
+	const uint32_t *	refs;
+	const char **		dirTable;
+	const char **		newTable;
+	char *			image;
+	char *			before;
+	double *		weights;
+	int *			order;
+	double			total;
+	double			missing;
+	double			oldCost;
+	double			newCost;
+	size_t			size;
+	unsigned int		index;
+	unsigned int		ref;
+	int			dirCount;
+	int			start;
+	int			end;
+	BOOL			success;
+
+	dirTable = MakePathTable();
+	dirCount = PathCount(pathContext);
+
+	if (dirCount > OPTIMIZE_MAX_PATHS)
+	{
+		fprintf(stderr, "Too many paths to optimize\n");
+
+		free(dirTable);
+
+		return FALSE;
+	}
+
+	image = BuildIndex(dirTable, dirCount, SCAN_EXEC, &size);
+	weights = (double *) calloc(dirCount + 1, sizeof(double));
+	before = (char *) calloc((size_t) dirCount * dirCount + 1, 1);
+	order = (int *) malloc(sizeof(int) * (dirCount + 1));
+	newTable = (const char **) malloc(sizeof(const char *) * (dirCount + 1));
+
+	if ((image == NULL) || (weights == NULL) || (before == NULL) ||
+		(order == NULL) || (newTable == NULL))
+	{
+		fprintf(stderr, "Cannot allocate tables for optimizing\n");
+
+		exit(1);
+	}
+
+	header = (const INDEX_HEADER *) image;
+	slots = (const INDEX_SLOT *) ((const INDEX_DIR *) (header + 1) +
+		header->dirCount);
+	refs = (const uint32_t *) (slots + header->slotCount);
+
+	/*
+	 * Each command in more than one directory requires the directory
+	 * it is found in to stay before the others.
+	 */
+	for (index = 0; index < header->slotCount; index++)
+	{
+		slot = &slots[index];
+
+		for (ref = 1; ref < slot->refCount; ref++)
+		{
+			before[refs[slot->firstRef] * dirCount +
+				refs[slot->firstRef + ref]] = TRUE;
+		}
+	}
+
+	success = ReadProfile(image, weights, &total, &missing);
+
+	if (success && (total <= 0))
+	{
+		fprintf(stderr, "Profile \"%s\" has no commands\n",
+			optimizeName);
+
+		success = FALSE;
+	}
+
+	if (success)
+	{
+		for (start = 0; start < dirCount; start++)
+			order[start] = start;
+
+		oldCost = LookupCost(order, dirCount, weights, missing, total);
+
+		/*
+		 * Order each run of absolute paths between the relative ones.
+		 */
+		for (start = 0; start < dirCount; start = end + 1)
+		{
+			end = start;
+
+			while ((end < dirCount) &&
+				(dirTable[end][0] == ROOT_CHARACTER))
+			{
+				end++;
+			}
+
+			OrderPaths(order, start, end, weights, before, dirCount);
+		}
+
+		/*
+		 * Keep the original order unless the new one is better.
+		 */
+		newCost = LookupCost(order, dirCount, weights, missing, total);
+
+		if (newCost < oldCost)
+		{
+			for (start = 0; start < dirCount; start++)
+				newTable[start] = dirTable[order[start]];
+
+			if (PathReorder(pathContext, newTable, dirCount) != PATH_OK)
+			{
+				fprintf(stderr, "Cannot reorder paths\n");
+
+				success = FALSE;
+			}
+		}
+		else
+			newCost = oldCost;
+
+		if (success)
+		{
+			fprintf(stderr, "Directories searched per command: "
+				"%.2f before, %.2f after\n", oldCost, newCost);
+		}
+	}
+
+	free(newTable);
+	free(order);
+	free(before);
+	free(weights);
+	free(image);
+	free(dirTable);
+
+	return success;
+}
+
+
+/*
+ * Read the profile of commands given by -optimize, adding the count for
+ * each command to the weight of the directory where it is found.  Each
+ * line is a command name, optionally preceded by a count, so that both a
+ * list of commands which were run and the output of "uniq -c" can be used.
+ * Commands which are not found, which are searched for in every directory,
+ * are added up separately.  Blank lines and comments are ignored.
+ * Returns TRUE if the profile was read.
+ */
+static BOOL
+ReadProfile(const char * image, double * weights, double * totalPtr,
+	double * missingPtr)
+{
+	const INDEX_SLOT *	slot;
+	const uint32_t *	refs;
+	const INDEX_HEADER *	header;
+	FILE *		fp;
+	char		line[PROFILE_LINE_SIZE];
+	char *		cp;
+	char *		name;
+	double		count;
+
+	header = (const INDEX_HEADER *) image;
+	refs = (const uint32_t *) ((const INDEX_SLOT *) ((const INDEX_DIR *)
+		(header + 1) + header->dirCount) + header->slotCount);
+
+	fp = fopen(optimizeName, "r");
+
+	if (fp == NULL)
+	{
+		fprintf(stderr, "Cannot open profile \"%s\": %s\n",
+			optimizeName, strerror(errno));
+
+		return FALSE;
+	}
+
+	*totalPtr = 0;
+	*missingPtr = 0;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		cp = line;
+
+		while ((*cp == ' ') || (*cp == '\t'))
+			cp++;
+
+		count = 1;
+
+		if ((*cp >= '0') && (*cp <= '9'))
+		{
+			count = strtod(cp, &cp);
+
+			while ((*cp == ' ') || (*cp == '\t'))
+				cp++;
+		}
+
+		name = cp;
+
+		while (*cp && (*cp != ' ') && (*cp != '\t') && (*cp != '\n'))
+			cp++;
+
+		*cp = '\0';
+
+		if ((*name == '\0') || (*name == '#') || (count <= 0) ||
+			strchr(name, ROOT_CHARACTER))
+		{
+			continue;
+		}
+
+		*totalPtr += count;
+
+		slot = FindIndexSlot(image, name);
+
+		if (slot == NULL)
+		{
+			*missingPtr += count;
+
+			continue;
+		}
+
+		weights[refs[slot->firstRef]] += count;
+	}
+
+	fclose(fp);
+
+	return TRUE;
+}
+
+
+/*
+ * Order a run of paths from the start index up to the end index.
+ * Each time, the path with the highest weight of those whose required
+ * earlier paths have all been placed is placed next, and then any
+ * neighbouring paths which can be swapped to put the higher weight first
+ * are swapped until there are no more.  Equal weights keep their order.
+ */
+static void
+OrderPaths(int * order, int start, int end, const double * weights,
+	const char * before, int count)
+{
+	int *	waitCounts;
+	BOOL *	placed;
+	int	index;
+	int	other;
+	int	best;
+	int	pos;
+	BOOL	swapped;
+
+	if (end - start < 2)
+		return;
+
+	waitCounts = (int *) calloc(count, sizeof(int));
+	placed = (BOOL *) calloc(count, sizeof(BOOL));
+
+	if ((waitCounts == NULL) || (placed == NULL))
+	{
+		fprintf(stderr, "Cannot allocate tables for optimizing\n");
+
+		exit(1);
+	}
+
+	for (index = start; index < end; index++)
+	{
+		for (other = start; other < end; other++)
+		{
+			if (before[other * count + index])
+				waitCounts[index]++;
+		}
+	}
+
+	for (pos = start; pos < end; pos++)
+	{
+		best = -1;
+
+		for (index = start; index < end; index++)
+		{
+			if (placed[index] || waitCounts[index])
+				continue;
+
+			if ((best < 0) || (weights[index] > weights[best]))
+				best = index;
+		}
+
+		order[pos] = best;
+		placed[best] = TRUE;
+
+		for (other = start; other < end; other++)
+		{
+			if (before[best * count + other])
+				waitCounts[other]--;
+		}
+	}
+
+	do
+	{
+		swapped = FALSE;
+
+		for (pos = start; pos < end - 1; pos++)
+		{
+			index = order[pos];
+			other = order[pos + 1];
+
+			if ((weights[other] > weights[index]) &&
+				!before[index * count + other])
+			{
+				order[pos] = other;
+				order[pos + 1] = index;
+				swapped = TRUE;
+			}
+		}
+	}
+	while (swapped);
+
+	free(waitCounts);
+	free(placed);
+}
+
+
+/*
+ * Return the average number of directories searched for each command in
+ * the profile with the paths in the specified order.  Commands which are
+ * not found are searched for in every directory.
+ */
+static double
+LookupCost(const int * order, int count, const double * weights,
+	double missing, double total)
+{
+	double	probes;
+	int	pos;
+
+	probes = missing * count;
+
+	for (pos = 0; pos < count; pos++)
+		probes += weights[order[pos]] * (pos + 1);
+
+	return probes / total;
+}
+
+
+/*
+ * Check the final path list as a list of library directories for the
+ * ELF files given by -elf or -elfr, by simulating how the dynamic loader
+ * finds the libraries needed by each of them.  Paths in which no library
+ * is found are unused, and are either printed or removed.  The number of
+ * failed attempts to open libraries in the paths for each ELF file is
+ * reported, both as it is and as it would be without the unused paths.
+ * A directory which does not exist is only tried once by the loader.
+ * Returns the number of unused paths, or -1 on an error.
+ */
+static int
+CheckLibraryPaths(void)
+{
+#if defined(HAVE_ELF)
+	const char **	dirTable;
+	BOOL *		usedTable;
+	BOOL *		missingTable;
+	BOOL *		triedTable;
+	int *		startTable;
+	struct	stat	statbuf;
+	long		failed;
+	long		prunedFailed;
+	int		dirCount;
+	int		unusedCount;
+	int		file;
+	int		index;
+	int		lookup;
+	int		end;
+	BOOL		success;
+
+	dirTable = MakePathTable();
+	dirCount = PathCount(pathContext);
+
+	usedTable = (BOOL *) calloc(dirCount + 1, sizeof(BOOL));
+	missingTable = (BOOL *) calloc(dirCount + 1, sizeof(BOOL));
+	triedTable = (BOOL *) calloc(dirCount + 1, sizeof(BOOL));
+	startTable = (int *) malloc(sizeof(int) * (elfCount + 1));
+
+	if ((usedTable == NULL) || (missingTable == NULL) ||
+		(triedTable == NULL) || (startTable == NULL))
+	{
+		fprintf(stderr, "Cannot allocate tables for libraries\n");
+
+		exit(1);
+	}
+
+	for (index = 0; index < dirCount; index++)
+	{
+		missingTable[index] = ((stat(dirTable[index], &statbuf) < 0) ||
+			!S_ISDIR(statbuf.st_mode));
+	}
+
+	/*
+	 * Find the libraries of each file, remembering where in the
+	 * path list each search of the path list ended.
+	 */
+	elfLookupCount = 0;
+	success = TRUE;
+
+	for (file = 0; file < elfCount; file++)
+	{
+		startTable[file] = elfLookupCount;
+
+		if (!SimulateLoader(elfTable[file], dirTable, dirCount,
+			usedTable))
+		{
+			success = FALSE;
+		}
+	}
+
+	startTable[elfCount] = elfLookupCount;
+
+	unusedCount = 0;
+
+	for (file = 0; success && (file < elfCount); file++)
+	{
+		failed = 0;
+		prunedFailed = 0;
+
+		memset(triedTable, 0, sizeof(BOOL) * dirCount);
+
+		for (lookup = startTable[file]; lookup < startTable[file + 1];
+			lookup++)
+		{
+			end = elfLookups[lookup];
+
+			if (end < 0)
+				end = dirCount;
+
+			for (index = 0; index < end; index++)
+			{
+				if (missingTable[index])
+				{
+					if (triedTable[index])
+						continue;
+
+					triedTable[index] = TRUE;
+				}
+
+				failed++;
+
+				if (usedTable[index])
+					prunedFailed++;
+			}
+		}
+
+		fprintf(stderr, "%s: %ld failed library opens, "
+			"%ld without unused paths\n", elfTable[file],
+			failed, prunedFailed);
+	}
+
+	/*
+	 * Print or remove the unused paths.
+	 */
+	for (index = 0; success && (index < dirCount); index++)
+	{
+		if (usedTable[index])
+			continue;
+
+		unusedCount++;
+
+		if (elfRemoveFlag)
+			HandlePath(dirTable[index], ACTION_REMOVE);
+		else
+			printf("%s\n", dirTable[index]);
+	}
+
+	free(startTable);
+	free(triedTable);
+	free(missingTable);
+	free(usedTable);
+	free(dirTable);
+
+	return (success ? unusedCount : -1);
+#else
+	fprintf(stderr, "ELF files cannot be read on this system\n");
+
+	return -1;
+#endif
+}
+
+
+#if defined(HAVE_ELF)
+/*
+ * Simulate the dynamic loader finding the libraries needed by an ELF
+ * file, and those needed by the libraries in turn, marking the paths in
+ * which they are found as used.  As for the loader, libraries are loaded
+ * breadth first and a library is only looked for once.  Libraries which
+ * cannot be found are reported but are not an error.
+ * Returns TRUE if the ELF file could be read.
+ */
+static BOOL
+SimulateLoader(const char * fileName, const char ** dirTable, int dirCount,
+	BOOL * usedTable)
+{
+	ELF_OBJECT *	objects;
+	ELF_OBJECT *	object;
+	const char *	name;
+	int		objectCount;
+	int		current;
+	int		index;
+	int		other;
+	int		status;
+
+	objects = (ELF_OBJECT *) calloc(ELF_MAX_OBJECTS, sizeof(ELF_OBJECT));
+
+	if (objects == NULL)
+	{
+		fprintf(stderr, "Cannot allocate tables for libraries\n");
+
+		exit(1);
+	}
+
+	status = ReadElf(fileName, &objects[0].info);
+
+	if (status != ELF_OK)
+	{
+		if (status == ELF_MISSING)
+			fprintf(stderr, "%s: %s\n", fileName, strerror(errno));
+		else
+			fprintf(stderr, "%s: Not a usable ELF file\n", fileName);
+
+		free(objects);
+
+		return FALSE;
+	}
+
+	objects[0].path = strdup(fileName);
+	objects[0].name = fileName;
+	objects[0].read = TRUE;
+	objectCount = 1;
+
+	if (objects[0].path == NULL)
+	{
+		fprintf(stderr, "Cannot allocate tables for libraries\n");
+
+		exit(1);
+	}
+
+	for (current = 0; current < objectCount; current++)
+	{
+		object = &objects[current];
+
+		if (!object->read)
+			continue;
+
+		for (index = 0; index < object->info.neededCount; index++)
+		{
+			name = object->info.needed[index];
+
+			for (other = 0; other < objectCount; other++)
+			{
+				if (strcmp(objects[other].name, name) == 0)
+					break;
+			}
+
+			if ((other < objectCount) ||
+				(objectCount >= ELF_MAX_OBJECTS))
+			{
+				continue;
+			}
+
+			objects[objectCount].name = name;
+			objects[objectCount].path = FindLibrary(objects,
+				current, name, dirTable, dirCount, usedTable);
+
+			if (objects[objectCount].path == NULL)
+			{
+				fprintf(stderr, "%s: Cannot find library \"%s\"\n",
+					fileName, name);
+			}
+			else if (ReadElf(objects[objectCount].path,
+				&objects[objectCount].info) == ELF_OK)
+			{
+				objects[objectCount].read = TRUE;
+			}
+
+			objectCount++;
+		}
+	}
+
+	for (current = 0; current < objectCount; current++)
+	{
+		if (objects[current].read)
+			FreeElf(&objects[current].info);
+
+		free(objects[current].path);
+	}
+
+	free(objects);
+
+	return TRUE;
+}
+
+
+/*
+ * Find a library needed by one of the loaded objects in the same order as
+ * the dynamic loader.  That is the DT_RPATH of the object and then of the
+ * executable if the object has no DT_RUNPATH, then the path list, then
+ * the DT_RUNPATH of the object, and then the system directories.  Where
+ * the search of the path list ended is remembered, and the path the
+ * library is found in is marked as used.
+ * Returns the allocated path name of the library, or NULL if not found.
+ */
+static char *
+FindLibrary(const ELF_OBJECT * objects, int owner, const char * name,
+	const char ** dirTable, int dirCount, BOOL * usedTable)
+{
+	const ELF_OBJECT *	object;
+	const ELF_INFO *	match;
+	char *			path;
+	int			index;
+
+	object = &objects[owner];
+	match = &objects[0].info;
+
+	if (strchr(name, ROOT_CHARACTER))
+		return TryLibrary("", 0, name, match);
+
+	if (object->info.runpath == NULL)
+	{
+		path = SearchLibraryDirs(object->info.rpath, object->path,
+			name, match);
+
+		if (path)
+			return path;
+
+		if ((owner != 0) && (objects[0].info.runpath == NULL))
+		{
+			path = SearchLibraryDirs(objects[0].info.rpath,
+				objects[0].path, name, match);
+
+			if (path)
+				return path;
+		}
+	}
+
+	for (index = 0; index < dirCount; index++)
+	{
+		path = TryLibrary(dirTable[index], strlen(dirTable[index]),
+			name, match);
+
+		if (path)
+		{
+			usedTable[index] = TRUE;
+			AddLibraryLookup(index);
+
+			return path;
+		}
+	}
+
+	AddLibraryLookup(-1);
+
+	path = SearchLibraryDirs(object->info.runpath, object->path, name,
+		match);
+
+	if (path)
+		return path;
+
+	return SearchLibraryDirs(SYSTEM_LIBRARY_DIRS, "", name, match);
+}
+
+
+/*
+ * Look for a library in a colon-separated list of directories such as a
+ * DT_RPATH, where $ORIGIN is the directory of the object which owns it.
+ * Directories using other substitutions are skipped.
+ * Returns the allocated path name of the library, or NULL if not found.
+ */
+static char *
+SearchLibraryDirs(const char * dirs, const char * owner, const char * name,
+	const ELF_INFO * match)
+{
+	const char *	origin;
+	const char *	end;
+	char *		path;
+	char		dir[PATH_MAX];
+	int		originLength;
+	int		length;
+	BOOL		valid;
+
+	if (dirs == NULL)
+		return NULL;
+
+	origin = strrchr(owner, ROOT_CHARACTER);
+	originLength = (origin ? (origin - owner) : 0);
+	origin = owner;
+
+	if (originLength == 0)
+	{
+		origin = (owner[0] == ROOT_CHARACTER) ? "/" : DOT_PATH;
+		originLength = 1;
+	}
+
+	while (*dirs)
+	{
+		end = strchr(dirs, PATH_DIVIDER);
+
+		if (end == NULL)
+			end = dirs + strlen(dirs);
+
+		length = 0;
+		valid = TRUE;
+
+		while (valid && (dirs < end))
+		{
+			if (strncmp(dirs, "$ORIGIN", 7) == 0)
+				dirs += 7;
+			else if (strncmp(dirs, "${ORIGIN}", 9) == 0)
+				dirs += 9;
+			else if ((*dirs == '$') || (length + 1 >= PATH_MAX))
+			{
+				valid = FALSE;
+
+				continue;
+			}
+			else
+			{
+				dir[length++] = *dirs++;
+
+				continue;
+			}
+
+			if (length + originLength >= PATH_MAX)
+				valid = FALSE;
+			else
+			{
+				memcpy(dir + length, origin, originLength);
+				length += originLength;
+			}
+		}
+
+		dirs = end;
+
+		if (*dirs)
+			dirs++;
+
+		if (!valid)
+			continue;
+
+		path = TryLibrary(dir, length, name, match);
+
+		if (path)
+			return path;
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Try to open a library in a directory, which is the current directory
+ * if it is empty, and check that it is an ELF file of the same class and
+ * machine as the file being loaded, since the loader skips any others.
+ * Returns the allocated path name of the library, or NULL if not usable.
+ */
+static char *
+TryLibrary(const char * dir, int dirLength, const char * name,
+	const ELF_INFO * match)
+{
+	unsigned char	header[EI_NIDENT + 4];
+	char		path[PATH_MAX];
+	char *		copy;
+	uint16_t	machine;
+	size_t		nameLength;
+	int		fd;
+	int		count;
+
+	nameLength = strlen(name);
+
+	if (dirLength + nameLength + 2 > PATH_MAX)
+		return NULL;
+
+	if (dirLength > 0)
+	{
+		memcpy(path, dir, dirLength);
+		path[dirLength++] = ROOT_CHARACTER;
+	}
+
+	memcpy(path + dirLength, name, nameLength + 1);
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+
+	count = read(fd, header, sizeof(header));
+
+	close(fd);
+
+	if ((count != sizeof(header)) ||
+		(memcmp(header, ELFMAG, SELFMAG) != 0) ||
+		(header[EI_CLASS] != match->elfClass) ||
+		(header[EI_DATA] != ELF_NATIVE_DATA))
+	{
+		return NULL;
+	}
+
+	/*
+	 * The machine type follows the file type after the identification.
+	 */
+	memcpy(&machine, header + EI_NIDENT + 2, sizeof(machine));
+
+	if (machine != match->machine)
+		return NULL;
+
+	copy = strdup(path);
+
+	if (copy == NULL)
+	{
+		fprintf(stderr, "Cannot allocate library name\n");
+
+		exit(1);
+	}
+
+	return copy;
+}
+
+
+/*
+ * Remember where a search of the path list for a library ended, which
+ * is the index of the path it was found in, or -1 if it was not found.
+ */
+static void
+AddLibraryLookup(int found)
+{
+	if (elfLookupCount >= elfLookupSize)
+	{
+		elfLookupSize = (elfLookupSize ? (elfLookupSize * 2) : 256);
+		elfLookups = (int *) realloc(elfLookups,
+			sizeof(int) * elfLookupSize);
+
+		if (elfLookups == NULL)
+		{
+			fprintf(stderr, "Cannot allocate library lookups\n");
+
+			exit(1);
+		}
+	}
+
+	elfLookups[elfLookupCount++] = found;
+}
+
+
+/*
+ * Read the dependencies of an ELF file by mapping it into memory.
+ * Returns ELF_OK if successful, ELF_MISSING if it could not be opened
+ * with errno set, or ELF_INVALID if it is not a usable ELF file.
+ * This exits on an malloc failure, after unmapping the file.
+ */
+static int
+ReadElf(const char * fileName, ELF_INFO * info)
+{
+	struct	stat	statbuf;
+	void *		image;
+	int		fd;
+	int		status;
+
+	fd = open(fileName, O_RDONLY);
+
+	if (fd < 0)
+		return ELF_MISSING;
+
+	if ((fstat(fd, &statbuf) < 0) || !S_ISREG(statbuf.st_mode) ||
+		(statbuf.st_size < EI_NIDENT))
+	{
+		close(fd);
+
+		return ELF_INVALID;
+	}
+
+	image = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (image == MAP_FAILED)
+		return ELF_INVALID;
+
+	status = ParseElf((const unsigned char *) image, statbuf.st_size, info);
+
+	munmap(image, statbuf.st_size);
+
+	if (status == ELF_MEMORY)
+	{
+		fprintf(stderr, "Cannot allocate ELF strings\n");
+
+		exit(1);
+	}
+
+	return status;
+}
+
+
+/*
+ * Parse the image of an ELF file to find the libraries it needs and its
+ * library search paths, using its program headers so that files without
+ * section headers can be read.  Files without a dynamic section need
+ * no libraries.  Everything is bounds checked against the file size.
+ * Returns ELF_OK if successful, ELF_INVALID if it is not usable, or
+ * ELF_MEMORY if memory could not be allocated.
+ */
+static int
+ParseElf(const unsigned char * image, size_t size, ELF_INFO * info)
+{
+	Elf64_Ehdr	header64;
+	Elf32_Ehdr	header32;
+	Elf64_Phdr	segment;
+	Elf64_Phdr	dynamic;
+	Elf64_Dyn	entry;
+	uint64_t	stringAddress;
+	uint64_t	stringSize;
+	uint64_t	stringOffset;
+	size_t		headerOffset;
+	size_t		headerSize;
+	size_t		entrySize;
+	size_t		offset;
+	int		headerCount;
+	int		index;
+	BOOL		haveDynamic;
+	BOOL		haveStrings;
+
+	memset(info, 0, sizeof(ELF_INFO));
+
+	if ((size < EI_NIDENT) || (memcmp(image, ELFMAG, SELFMAG) != 0) ||
+		(image[EI_DATA] != ELF_NATIVE_DATA))
+	{
+		return ELF_INVALID;
+	}
+
+	info->elfClass = image[EI_CLASS];
+
+	if ((info->elfClass == ELFCLASS64) && (size >= sizeof(header64)))
+	{
+		memcpy(&header64, image, sizeof(header64));
+		info->machine = header64.e_machine;
+		headerOffset = header64.e_phoff;
+		headerCount = header64.e_phnum;
+		headerSize = sizeof(Elf64_Phdr);
+		entrySize = sizeof(Elf64_Dyn);
+	}
+	else if ((info->elfClass == ELFCLASS32) && (size >= sizeof(header32)))
+	{
+		memcpy(&header32, image, sizeof(header32));
+		info->machine = header32.e_machine;
+		headerOffset = header32.e_phoff;
+		headerCount = header32.e_phnum;
+		headerSize = sizeof(Elf32_Phdr);
+		entrySize = sizeof(Elf32_Dyn);
+	}
+	else
+		return ELF_INVALID;
+
+	/*
+	 * Find the dynamic segment.
+	 */
+	memset(&dynamic, 0, sizeof(dynamic));
+	haveDynamic = FALSE;
+
+	for (index = 0; index < headerCount; index++)
+	{
+		if (!GetElfSegment(image, size, info->elfClass,
+			headerOffset + index * headerSize, &segment))
+		{
+			return ELF_INVALID;
+		}
+
+		if (segment.p_type == PT_DYNAMIC)
+		{
+			dynamic = segment;
+			haveDynamic = TRUE;
+		}
+	}
+
+	if (!haveDynamic)
+		return ELF_OK;
+
+	if ((dynamic.p_offset > size) ||
+		(dynamic.p_filesz > size - dynamic.p_offset))
+	{
+		return ELF_INVALID;
+	}
+
+	/*
+	 * Find the string table and count the needed libraries.
+	 */
+	stringAddress = 0;
+	stringSize = 0;
+	haveStrings = FALSE;
+
+	for (offset = dynamic.p_offset;
+		offset + entrySize <= dynamic.p_offset + dynamic.p_filesz;
+		offset += entrySize)
+	{
+		GetElfDynamic(image, size, info->elfClass, offset, &entry);
+
+		if (entry.d_tag == DT_NULL)
+			break;
+
+		if (entry.d_tag == DT_STRTAB)
+		{
+			stringAddress = entry.d_un.d_ptr;
+			haveStrings = TRUE;
+		}
+
+		if (entry.d_tag == DT_STRSZ)
+			stringSize = entry.d_un.d_val;
+
+		if (entry.d_tag == DT_NEEDED)
+			info->neededCount++;
+	}
+
+	if (!haveStrings)
+		return (info->neededCount ? ELF_INVALID : ELF_OK);
+
+	/*
+	 * Convert the address of the string table into its file offset
+	 * using the loaded segment which contains it.
+	 */
+	haveStrings = FALSE;
+	stringOffset = 0;
+
+	for (index = 0; index < headerCount; index++)
+	{
+		GetElfSegment(image, size, info->elfClass,
+			headerOffset + index * headerSize, &segment);
+
+		if ((segment.p_type == PT_LOAD) &&
+			(stringAddress >= segment.p_vaddr) &&
+			(stringAddress - segment.p_vaddr < segment.p_filesz))
+		{
+			stringOffset = segment.p_offset +
+				(stringAddress - segment.p_vaddr);
+			haveStrings = TRUE;
+
+			break;
+		}
+	}
+
+	if (!haveStrings || (stringSize > size) ||
+		(stringOffset > size - stringSize))
+	{
+		return ELF_INVALID;
+	}
+
+	info->strings = (char *) malloc(stringSize + 1);
+	info->needed = (const char **) malloc(sizeof(const char *) *
+		(info->neededCount + 1));
+
+	if ((info->strings == NULL) || (info->needed == NULL))
+	{
+		free((void *) info->needed);
+		free(info->strings);
+		info->needed = NULL;
+		info->strings = NULL;
+
+		return ELF_MEMORY;
+	}
+
+	memcpy(info->strings, image + stringOffset, stringSize);
+	info->strings[stringSize] = '\0';
+	info->neededCount = 0;
+
+	/*
+	 * Now collect the names of the libraries and the search paths.
+	 */
+	for (offset = dynamic.p_offset;
+		offset + entrySize <= dynamic.p_offset + dynamic.p_filesz;
+		offset += entrySize)
+	{
+		GetElfDynamic(image, size, info->elfClass, offset, &entry);
+
+		if (entry.d_tag == DT_NULL)
+			break;
+
+		if (entry.d_un.d_val >= stringSize)
+			continue;
+
+		if (entry.d_tag == DT_NEEDED)
+		{
+			info->needed[info->neededCount++] =
+				info->strings + entry.d_un.d_val;
+		}
+
+		if (entry.d_tag == DT_RPATH)
+			info->rpath = info->strings + entry.d_un.d_val;
+
+		if (entry.d_tag == DT_RUNPATH)
+			info->runpath = info->strings + entry.d_un.d_val;
+	}
+
+	return ELF_OK;
+}
+
+
+/*
+ * Get a program header of either class of ELF file in the 64 bit form.
+ * Returns FALSE if it is outside of the file.
+ */
+static BOOL
+GetElfSegment(const unsigned char * image, size_t size, int elfClass,
+	size_t offset, Elf64_Phdr * segment)
+{
+	Elf32_Phdr	segment32;
+
+	if (elfClass == ELFCLASS64)
+	{
+		if ((offset > size) || (sizeof(Elf64_Phdr) > size - offset))
+			return FALSE;
+
+		memcpy(segment, image + offset, sizeof(Elf64_Phdr));
+
+		return TRUE;
+	}
+
+	if ((offset > size) || (sizeof(Elf32_Phdr) > size - offset))
+		return FALSE;
+
+	memcpy(&segment32, image + offset, sizeof(segment32));
+
+	segment->p_type = segment32.p_type;
+	segment->p_offset = segment32.p_offset;
+	segment->p_vaddr = segment32.p_vaddr;
+	segment->p_filesz = segment32.p_filesz;
+
+	return TRUE;
+}
+
+
+/*
+ * Get a dynamic section entry of either class of ELF file in the 64 bit
+ * form.  Returns FALSE if it is outside of the file.
+ */
+static BOOL
+GetElfDynamic(const unsigned char * image, size_t size, int elfClass,
+	size_t offset, Elf64_Dyn * entry)
+{
+	Elf32_Dyn	entry32;
+
+	if (elfClass == ELFCLASS64)
+	{
+		if ((offset > size) || (sizeof(Elf64_Dyn) > size - offset))
+			return FALSE;
+
+		memcpy(entry, image + offset, sizeof(Elf64_Dyn));
+
+		return TRUE;
+	}
+
+	if ((offset > size) || (sizeof(Elf32_Dyn) > size - offset))
+		return FALSE;
+
+	memcpy(&entry32, image + offset, sizeof(entry32));
+
+	entry->d_tag = entry32.d_tag;
+	entry->d_un.d_val = entry32.d_un.d_val;
+
+	return TRUE;
+}
+
+
+/*
+ * Free the memory used for the dependencies of an ELF file.
+ */
+static void
+FreeElf(ELF_INFO * info)
+{
+	free(info->strings);
+	free((void *) info->needed);
+}
+#endif
 
-			return 1;
-		}
 
-		varName = argv[index];
-	}
+/*
+ * Function called by qsort to compare the names of two slots of an index.
+ * The names are in the name area of the index being reported.
+ */
+static int
+SlotSortCallback(const void * addr1, const void * addr2)
+{
+	const INDEX_SLOT *	slot1;
+	const INDEX_SLOT *	slot2;
+	unsigned int		len;
+	int			result;
 
-	/*
-	 * Get the value of the environment variable and copy it so we
-	 * can safely modify it.  Don't complain about an undefined
-	 * environment variable, but treat it as an empty list to help
-	 * shell programmers create a path list from scratch.
-	 */
-	path = getenv(varName);
+	slot1 = *(const INDEX_SLOT **) addr1;
+	slot2 = *(const INDEX_SLOT **) addr2;
 
-	if (path == NULL)
-		path = "";
+	len = (slot1->nameLength < slot2->nameLength) ?
+		slot1->nameLength : slot2->nameLength;
 
-	path = CopyString(path);
+	result = memcmp(shadowNames + slot1->nameOffset,
+		shadowNames + slot2->nameOffset, len);
 
-	/*
-	 * Calculate the maximum number of paths in the new variable
-	 * by adding the number of command line arguments to two more
-	 * than the number of colons in the existing value.  This will
-	 * guarantee that the path table cannot overflow.
-	 */
-	maxPaths = argc + 2;
+	if (result)
+		return result;
 
-	str = path;
+	return (slot1->nameLength > slot2->nameLength) -
+		(slot1->nameLength < slot2->nameLength);
+}
 
-	while ((str = strchr(str, PATH_DIVIDER)) != NULL)
-	{
-		maxPaths++;
-		str++;
-	}
 
-	/*
-	 * Allocate an array which can hold the maximum number of paths.
-	 */
-	pathTable = (const char **) malloc(sizeof(char **) * maxPaths);
+/*
+ * Build an index of the commands in a table of directories.
+ * The directories are read in parallel, and then the index is made from
+ * the names found in them.  If required, only the names of executable
+ * files are entered.
+ * Returns the index, which is allocated, or NULL on an allocation failure.
+ */
+static char *
+BuildIndex(const char ** dirTable, int dirCount, int mode,
+	size_t * sizePtr)
+{
+	DIR_SCAN *	scans;
+	char *		image;
+	int		dirIndex;
 
-	if (pathTable == NULL)
-	{
-		fprintf(stderr, "Cannot allocate new path array");
+	scans = (DIR_SCAN *) calloc(dirCount + 1, sizeof(DIR_SCAN));
 
-		return 1;
-	}
+	if (scans == NULL)
+		return NULL;
 
 	/*
-	 * Initialize the path table with the current path values.
-	 * Be careful to make sure that all empty paths are seen
-	 * (such as that caused by a trailing colon).
+	 * Read all of the directories.
 	 */
-	pathCount = 0;
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+	{
+		scans[dirIndex].path = dirTable[dirIndex];
+		scans[dirIndex].mode = mode;
+	}
 
-	str = path;
+	ScanDirectories(scans, dirCount);
 
-	if (*str)
-		pathTable[pathCount++] = str;
+	image = MakeIndex(scans, dirTable, dirCount, sizePtr);
 
-	while ((str = strchr(str, PATH_DIVIDER)) != NULL)
-	{
-		*str++ = '\0';
-		pathTable[pathCount++] = str;
-	}
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+		free(scans[dirIndex].names);
 
-	/*
-	 * Normalize any null paths by converting them all into the
-	 * explicit name for the current directory.
-	 */
-	for (index = 0; index < pathCount; index++)
+	free(scans);
+
+	return image;
+}
+
+
+/*
+ * Make an index from the names read from a table of directories.
+ * The names are entered into the hash table in order of the directories
+ * along with the numbers of the directories containing them.
+ * Returns the index, which is allocated, or NULL on an allocation failure.
+ */
+static char *
+MakeIndex(const DIR_SCAN * scans, const char ** dirTable, int dirCount,
+	size_t * sizePtr)
+{
+	const DIR_SCAN *	scan;
+	INDEX_HEADER *	header;
+	INDEX_DIR *	dirs;
+	INDEX_SLOT *	slots;
+	INDEX_SLOT *	slot;
+	uint32_t *	refs;
+	uint32_t *	fills;
+	const char **	slotNames;
+	char *		names;
+	char *		image;
+	const char *	name;
+	size_t		size;
+	size_t		namesSize;
+	unsigned int	slotCount;
+	unsigned int	refCount;
+	unsigned int	hash;
+	unsigned int	index;
+	unsigned int	len;
+	int		dirIndex;
+	int		nameIndex;
+	int		pass;
+
+	refCount = 0;
+	namesSize = 0;
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
 	{
-		if (pathTable[index][0] == '\0')
-			pathTable[index] = DOT_PATH;
+		refCount += scans[dirIndex].count;
+		namesSize += strlen(dirTable[dirIndex]);
 	}
 
-	/*
-	 * Remove all duplicate paths from the table.
-	 */
-	RemoveDuplicatePaths();
+	slotCount = 16;
 
-	/*
-	 * Remember if the special DOT path is first or last in the list.
-	 */
-	if (pathCount > 0)
-	{
-		dotFirst = (strcmp(pathTable[0], DOT_PATH) == 0);
+	while (slotCount < 2 * refCount)
+		slotCount *= 2;
 
-		dotLast = (strcmp(pathTable[pathCount - 1],
-			DOT_PATH) == 0);
-	}
+	slotNames = (const char **) calloc(slotCount, sizeof(const char *));
+	fills = (uint32_t *) calloc(slotCount, sizeof(uint32_t));
+	slots = (INDEX_SLOT *) calloc(slotCount, sizeof(INDEX_SLOT));
 
 	/*
-	 * Now parse the command line options and associated paths.
+	 * Enter the names into the hash table in two passes, the first to
+	 * count the directories for each name and the second to fill in
+	 * their numbers, which are then in list order for each name.
 	 */
-	while (argc > 0)
+	image = NULL;
+	refs = NULL;
+
+	if ((slotNames == NULL) || (fills == NULL) || (slots == NULL))
+		goto done;
+
+	for (pass = 0; pass < 2; pass++)
 	{
-		/*
-		 * If this is the special variable name option, then
-		 * just skip over it and its argument since it was
-		 * parsed earlier.
-		 */
-		if (strcmp(*argv, OPTION_VAR) == 0)
+		for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
 		{
-			argc -= 2;
-			argv += 2;
+			scan = &scans[dirIndex];
+			name = scan->names;
 
-			continue;
+			for (nameIndex = 0; nameIndex < scan->count; nameIndex++)
+			{
+				len = strlen(name);
+				hash = HashPath(name);
+				index = hash & (slotCount - 1);
+
+				while (slotNames[index] &&
+					((slots[index].hash != hash) ||
+					(strcmp(slotNames[index], name) != 0)))
+				{
+					index = (index + 1) & (slotCount - 1);
+				}
+
+				slot = &slots[index];
+
+				if (pass == 0)
+				{
+					if (slotNames[index] == NULL)
+					{
+						slotNames[index] = name;
+						slot->hash = hash;
+						slot->nameLength = len;
+						namesSize += len;
+					}
+
+					slot->refCount++;
+				}
+				else
+					refs[fills[index]++] = dirIndex;
+
+				name += len + 1;
+			}
 		}
 
+		if (pass > 0)
+			break;
+
 		/*
-		 * If the argument is an option then handle that.
+		 * Now that the size is known, allocate the index and find
+		 * where the directory numbers for each name begin.
 		 */
-		if (**argv == '-')
-		{
-			argc--;
+		size = sizeof(INDEX_HEADER) + dirCount * sizeof(INDEX_DIR) +
+			slotCount * sizeof(INDEX_SLOT) +
+			refCount * sizeof(uint32_t) + namesSize;
 
-			if (!HandleOption(*argv++))
-				return 1;
+		image = (char *) calloc(1, size);
 
-			continue;
-		}
+		if (image == NULL)
+			goto done;
 
-		/*
-		 * The argument is not an option so it is a path name.
-		 * Count how many path names are in the argument list before
-		 * the next action (if any) so that we can handle them all
-		 * as a group.
-		 */
-		listTable = argv;
-		listCount = 0;
+		header = (INDEX_HEADER *) image;
+		dirs = (INDEX_DIR *) (header + 1);
+		refs = (uint32_t *) ((INDEX_SLOT *) (dirs + dirCount) +
+			slotCount);
+		names = (char *) (refs + refCount);
 
-		while ((argc > 0) && (**argv != '-'))
+		refCount = 0;
+
+		for (index = 0; index < slotCount; index++)
 		{
-			argc--;
-			argv++;
-			listCount++;
+			slots[index].firstRef = refCount;
+			fills[index] = refCount;
+			refCount += slots[index].refCount;
 		}
-
-		/*
-		 * Handle the list of paths which were found.
-		 */
-		HandlePathList(listCount, listTable);
 	}
 
 	/*
-	 * Remove all duplicate paths from the table.
+	 * Fill in the header, the directories and the names.
 	 */
-	RemoveDuplicatePaths();
+	header->magic = INDEX_MAGIC;
+	header->dirCount = dirCount;
+	header->slotCount = slotCount;
+	header->refCount = refCount;
+	header->namesSize = namesSize;
+	header->listHash = HashDirNames(dirTable, dirCount);
 
-	/*
-	 * If the DOT path is handled specially, then possibly move it
-	 * back to its original position in the list.
-	 */
-	if (!disableDotFlag && (pathCount > 0) &&
-		(strcmp(pathTable[0], DOT_PATH) != 0) &&
-		(strcmp(pathTable[pathCount - 1], DOT_PATH) != 0))
+	namesSize = 0;
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
 	{
-		if (dotFirst)
-			HandlePath(DOT_PATH, ACTION_MOVE_BEFORE);
-		else if (dotLast)
-			HandlePath(DOT_PATH, ACTION_MOVE_AFTER);
+		len = strlen(dirTable[dirIndex]);
+
+		dirs[dirIndex].nameOffset = namesSize;
+		dirs[dirIndex].nameLength = len;
+		dirs[dirIndex].valid = scans[dirIndex].valid;
+		dirs[dirIndex].stamp = scans[dirIndex].stamp;
+
+		memcpy(names + namesSize, dirTable[dirIndex], len);
+		namesSize += len;
 	}
 
-	/*
-	 * Check the paths in the list for validity.
-	 * If an error is returned, then exit with a special status
-	 * without printing the path list.
-	 */
-	if (testFailedFlag || !CheckPathList())
-		return 2;
+	for (index = 0; index < slotCount; index++)
+	{
+		if (slotNames[index] == NULL)
+			continue;
 
-	/*
-	 * If we were just checking paths, then exit anyway with success.
-	 */
-	if (testPresenceFlag || checkInvalidFlag || checkRelativeFlag)
-		return 0;
+		slots[index].nameOffset = namesSize;
 
-	/*
-	 * If we want a listing of the paths one per line, then do that.
-	 */
-	if (listFlag || listSortedFlag)
+		memcpy(names + namesSize, slotNames[index],
+			slots[index].nameLength);
+
+		namesSize += slots[index].nameLength;
+	}
+
+	memcpy(dirs + dirCount, slots, slotCount * sizeof(INDEX_SLOT));
+
+	*sizePtr = size;
+
+done:
+	free(slotNames);
+	free(fills);
+	free(slots);
+
+	return image;
+}
+
+
+/*
+ * Check that an index read from a file is sensible and that it is for
+ * the same directories as the final path list, and that none of those
+ * directories have changed since the index was built.
+ * Returns the index, or NULL if it cannot be used.
+ */
+static const char *
+CheckIndex(const char * image, size_t size, const char ** dirTable,
+	int dirCount)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_DIR *	dirs;
+	const INDEX_SLOT *	slots;
+	const char *		names;
+	DIR_STAMP		stamp;
+	BOOL			valid;
+	int			dirIndex;
+	unsigned int		index;
+
+	header = (const INDEX_HEADER *) image;
+
+	if ((header->magic != INDEX_MAGIC) ||
+		(header->dirCount != (uint32_t) dirCount) ||
+		(header->slotCount == 0) ||
+		(header->slotCount & (header->slotCount - 1)) ||
+		(header->slotCount > (1U << 28)) ||
+		(header->refCount > (1U << 28)) ||
+		(header->listHash != HashDirNames(dirTable, dirCount)) ||
+		(size != sizeof(INDEX_HEADER) + dirCount * sizeof(INDEX_DIR) +
+			header->slotCount * sizeof(INDEX_SLOT) +
+			header->refCount * sizeof(uint32_t) + header->namesSize))
 	{
-		/*
-		 * If the path list is to be sorted, do that.
-		 */
-		if (listSortedFlag)
+		return NULL;
+	}
+
+	dirs = (const INDEX_DIR *) (header + 1);
+	slots = (const INDEX_SLOT *) (dirs + dirCount);
+	names = (const char *) ((const uint32_t *) (slots + header->slotCount) +
+		header->refCount);
+
+	for (dirIndex = 0; dirIndex < dirCount; dirIndex++)
+	{
+		if ((dirs[dirIndex].nameOffset > header->namesSize) ||
+			(dirs[dirIndex].nameLength > header->namesSize -
+				dirs[dirIndex].nameOffset) ||
+			(dirs[dirIndex].nameLength != strlen(dirTable[dirIndex])) ||
+			(memcmp(names + dirs[dirIndex].nameOffset,
+				dirTable[dirIndex], dirs[dirIndex].nameLength) != 0))
 		{
-			qsort(pathTable, pathCount, sizeof(const char *),
-				SortCallback);
+			return NULL;
 		}
 
-		/*
-		 * Now display the list of paths.
-		 */
-		for (index = 0; index < pathCount; index++)
-			puts(pathTable[index]);
+		valid = GetDirStamp(dirTable[dirIndex], &stamp);
 
-		return 0;
+		if ((valid != (BOOL) dirs[dirIndex].valid) || (valid &&
+			(memcmp(&stamp, &dirs[dirIndex].stamp,
+				sizeof(DIR_STAMP)) != 0)))
+		{
+			return NULL;
+		}
 	}
 
-	/*
-	 * Print out a new path string in the form ready to be assigned
-	 * into a new environment variable.
-	 */
-	for (index = 0; index < pathCount; index++)
+	for (index = 0; index < header->slotCount; index++)
+	{
+		if ((slots[index].nameOffset > header->namesSize) ||
+			(slots[index].nameLength > header->namesSize -
+				slots[index].nameOffset) ||
+			(slots[index].firstRef > header->refCount) ||
+			(slots[index].refCount > header->refCount -
+				slots[index].firstRef))
+		{
+			return NULL;
+		}
+	}
+
+	return image;
+}
+
+
+/*
+ * Find the slot of a command name in an index.
+ * Returns NULL if the name is not present.
+ */
+static const INDEX_SLOT *
+FindIndexSlot(const char * image, const char * name)
+{
+	const INDEX_HEADER *	header;
+	const INDEX_SLOT *	slots;
+	const char *		names;
+	unsigned int		hash;
+	unsigned int		index;
+	size_t			len;
+
+	header = (const INDEX_HEADER *) image;
+	slots = (const INDEX_SLOT *) ((const INDEX_DIR *) (header + 1) +
+		header->dirCount);
+	names = (const char *) ((const uint32_t *) (slots + header->slotCount) +
+		header->refCount);
+
+	hash = HashPath(name);
+	len = strlen(name);
+	index = hash & (header->slotCount - 1);
+
+	while (slots[index].nameLength != 0)
 	{
-		if (index)
-			fputc(PATH_DIVIDER, stdout);
+		if ((slots[index].hash == hash) &&
+			(slots[index].nameLength == len) &&
+			(memcmp(names + slots[index].nameOffset, name, len) == 0))
+		{
+			return &slots[index];
+		}
+
+		index = (index + 1) & (header->slotCount - 1);
+	}
+
+	return NULL;
+}
+
+
+/*
+ * Read a table of directories using a group of threads, one for each
+ * directory up to a limit.  The calling thread also does its share.
+ */
+static void
+ScanDirectories(DIR_SCAN * table, int count)
+{
+	SCAN_BATCH	batch;
+	pthread_t	threads[SCAN_MAX_WORKERS];
+	int		threadCount;
+
+	batch.table = table;
+	batch.count = count;
+	batch.next = 0;
 
-		fputs(pathTable[index], stdout);
+	for (threadCount = 0; START_WORKERS &&
+		(threadCount < SCAN_MAX_WORKERS) &&
+		(threadCount < count - 1); threadCount++)
+	{
+		if (pthread_create(&threads[threadCount], NULL,
+			ScanWorker, &batch) != 0)
+		{
+			break;
+		}
 	}
 
-	fputc('\n', stdout);
+	ScanWorker(&batch);
 
-	return 0;
+	while (threadCount-- > 0)
+		pthread_join(threads[threadCount], NULL);
 }
 
 
 /*
- * Handle an option argument name (including the leading dash).
- * Returns TRUE on success.
+ * Thread routine which reads directories from a batch
+ * until there are none left.
  */
-static BOOL
-HandleOption(const char * name)
+static void *
+ScanWorker(void * arg)
 {
-	const OPTION *	option;
+	SCAN_BATCH *	batch;
+	int		index;
 
-	/*
-	 * Scan the option table looking for the option name.
-	 */
-	option = optionTable;
+	batch = (SCAN_BATCH *) arg;
 
-	while ((option->name != NULL) && (strcmp(name, option->name) != 0))
-		option++;
+	while ((index = __sync_fetch_and_add(&batch->next, 1)) < batch->count)
+		ScanDirectory(&batch->table[index]);
 
-	/*
-	 * Switch on the option type.
-	 */
-	switch (option->action)
+	return NULL;
+}
+
+
+/*
+ * Read the names of the entries of a directory other than those which are
+ * known to be subdirectories.  The directory is read in large chunks using
+ * getdents64 where that is available.  A directory which cannot be read
+ * simply has no names.
+ */
+static void
+ScanDirectory(DIR_SCAN * scan)
+{
+	int		fd;
+#if defined(__linux__)
+	struct	dirent64_raw
 	{
-		case ACTION_AFTER:
-		case ACTION_BEFORE:
-		case ACTION_REMOVE:
-		case ACTION_REMOVE_AFTER:
-		case ACTION_REMOVE_BEFORE:
-		case ACTION_MOVE_AFTER:
-		case ACTION_MOVE_BEFORE:
-			action = option->action;
-			break;
+		uint64_t	d_ino;
+		int64_t		d_off;
+		unsigned short	d_reclen;
+		unsigned char	d_type;
+		char		d_name[1];
+	} *		dirent;
+	char *		buf;
+	long		used;
+	long		offset;
+#else
+	DIR *		dir;
+	struct	dirent *	dirent;
+#endif
+
+	scan->names = NULL;
+	scan->used = 0;
+	scan->size = 0;
+	scan->count = 0;
+
+	if (scan->mode == SCAN_CLASSES)
+	{
+		ScanClassPath(scan);
 
-		case ACTION_TEST_PRESENCE:
-			action = option->action;
-			testPresenceFlag = TRUE;
-			break;
+		return;
+	}
 
-		case ACTION_SET:
-			pathCount = 0;
-			action = ACTION_AFTER;
-			break;
+	scan->valid = GetDirStamp(scan->path, &scan->stamp);
 
-		case ACTION_LIST:
-			listFlag = TRUE;
-			break;
+	if (!scan->valid)
+		return;
 
-		case ACTION_LIST_SORTED:
-			listSortedFlag = TRUE;
+	fd = open(scan->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+	if (fd < 0)
+		return;
+
+#if defined(__linux__)
+	buf = (char *) malloc(SCAN_BUFFER_SIZE);
+
+	if (buf == NULL)
+	{
+		close(fd);
+
+		return;
+	}
+
+	while ((used = syscall(SYS_getdents64, fd, buf, SCAN_BUFFER_SIZE)) > 0)
+	{
+		for (offset = 0; offset < used; offset += dirent->d_reclen)
+		{
+			dirent = (struct dirent64_raw *) (buf + offset);
+
+			if ((dirent->d_type == DT_DIR) ||
+				(strcmp(dirent->d_name, ".") == 0) ||
+				(strcmp(dirent->d_name, "..") == 0) ||
+				((scan->mode == SCAN_EXEC) &&
+					!IsExecutableAt(fd, dirent->d_name)))
+			{
+				continue;
+			}
+
+			if (!AddScanName(scan, dirent->d_name))
+				break;
+		}
+	}
+
+	free(buf);
+	close(fd);
+#else
+	dir = fdopendir(fd);
+
+	if (dir == NULL)
+	{
+		close(fd);
+
+		return;
+	}
+
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		if ((strcmp(dirent->d_name, ".") == 0) ||
+			(strcmp(dirent->d_name, "..") == 0) ||
+			((scan->mode == SCAN_EXEC) &&
+				!IsExecutableAt(dirfd(dir), dirent->d_name)))
+		{
+			continue;
+		}
+
+		if (!AddScanName(scan, dirent->d_name))
 			break;
+	}
+
+	closedir(dir);
+#endif
+}
+
+
+/*
+ * Return whether a name within an open directory is an executable file.
+ */
+static BOOL
+IsExecutableAt(int dirFd, const char * name)
+{
+	struct	stat	statbuf;
 
-		case ACTION_ALLOW_FILES:
-			allowFilesFlag = TRUE;
-			break;
+	return ((fstatat(dirFd, name, &statbuf, 0) == 0) &&
+		S_ISREG(statbuf.st_mode) &&
+		(statbuf.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) &&
+		(faccessat(dirFd, name, X_OK, 0) == 0));
+}
 
-		case ACTION_DISABLE_DOT:
-			disableDotFlag = TRUE;
-			break;
 
-		case ACTION_CHECK_INVALID:
-			checkInvalidFlag = TRUE;
-			break;
+/*
+ * Add a name to those read from a directory.
+ * Returns FALSE on an allocation failure.
+ */
+static BOOL
+AddScanName(DIR_SCAN * scan, const char * name)
+{
+	char *	names;
+	size_t	len;
+	size_t	size;
 
-		case ACTION_REMOVE_INVALID:
-			removeInvalidFlag = TRUE;
-			break;
+	len = strlen(name) + 1;
 
-		case ACTION_CHECK_RELATIVE:
-			checkRelativeFlag = TRUE;
-			break;
+	if (scan->used + len > scan->size)
+	{
+		size = (scan->size ? scan->size * 2 : 4096);
 
-		case ACTION_REMOVE_RELATIVE:
-			removeRelativeFlag = TRUE;
-			break;
+		while (scan->used + len > size)
+			size *= 2;
 
-		default:
-			/*
-			 * The option is not in the table.
-			 * Print an error message.
-			 */
-			fprintf(stderr, "Unknown option \"%s\"\n", name);
+		names = (char *) realloc(scan->names, size);
 
+		if (names == NULL)
 			return FALSE;
+
+		scan->names = names;
+		scan->size = size;
 	}
 
+	memcpy(scan->names + scan->used, name, len);
+	scan->used += len;
+	scan->count++;
+
 	return TRUE;
 }
 
 
 /*
- * Handle a list of path names to be acted on by the current action.
- * This list is determined by the number of path names on the command line
- * following one option and before another one.
+ * Read the names of the classes and other resources of a class path
+ * entry, which is a jar file, a directory tree of classes, or a directory
+ * followed by an asterisk which stands for all of the jar files in it.
+ * An entry which cannot be read simply has no names.
  */
 static void
-HandlePathList(int listCount, const char ** listTable)
+ScanClassPath(DIR_SCAN * scan)
 {
-	/*
-	 * Handle a few actions specially whose action depends on having all
-	 * of the paths in the list at once.
-	 */
-	switch (action)
+	struct	stat	statbuf;
+	char		path[PATH_MAX];
+	int		length;
+
+	length = strlen(scan->path);
+
+	if ((length > 0) && (scan->path[length - 1] == '*'))
 	{
-		case ACTION_BEFORE:
-		case ACTION_REMOVE_BEFORE:
-		case ACTION_MOVE_BEFORE:
-			/*
-			 * Actions which put paths at the beginning must
-			 * be executed in reverse order in order to get
-			 * the right result.
-			 */
-			while (listCount-- > 0)
-				HandlePath(listTable[listCount], action);
+		ScanJarDir(scan, scan->path, length - 1);
 
-			return;
+		return;
+	}
 
-		default:
-			/*
-			 * Break to do the default case.
-			 */
-			break;
+	if (stat(scan->path, &statbuf) < 0)
+		return;
+
+	if (S_ISREG(statbuf.st_mode))
+	{
+		scan->valid = ScanJar(scan, scan->path);
+
+		return;
 	}
 
-	/*
-	 * Apply the action each of the paths in list in the specified order.
-	 */
-	while (listCount-- > 0)
-		HandlePath(*listTable++, action);
+	if (!S_ISDIR(statbuf.st_mode) || (length >= PATH_MAX))
+		return;
+
+	memcpy(path, scan->path, length + 1);
+
+	scan->valid = TRUE;
+
+	ScanClassDir(scan, path, length, length, 0);
 }
 
 
 /*
- * Handle the specified path according to the specified action.
- * Note: when a path is added to the pathTable, overflow does not need
- * to be checked since the table was allocated large enough for all cases.
+ * Read the names in all of the jar files in a directory for a class path
+ * entry ending with an asterisk.  The name of the directory is given by
+ * its length, and is the current directory if it is empty.
  */
 static void
-HandlePath(const char * path, ACTION action)
+ScanJarDir(DIR_SCAN * scan, const char * dirName, int dirLength)
 {
-	int	index;
-	BOOL	removed;
+	DIR *		dir;
+	struct	dirent *	dirent;
+	char		path[PATH_MAX];
+	int		length;
 
-	if (*path == '\0')
-		path = DOT_PATH;
+	if (dirLength == 0)
+	{
+		dirName = "./";
+		dirLength = 2;
+	}
 
-	/*
-	 * First see which options need to remove the path, and do that.
-	 * Remember whether something was removed from the list.
-	 */
-	removed = FALSE;
+	if (dirLength >= PATH_MAX)
+		return;
 
-	switch (action)
+	memcpy(path, dirName, dirLength);
+	path[dirLength] = '\0';
+
+	dir = opendir(path);
+
+	if (dir == NULL)
+		return;
+
+	scan->valid = TRUE;
+
+	while ((dirent = readdir(dir)) != NULL)
 	{
-		case ACTION_REMOVE:
-		case ACTION_REMOVE_AFTER:
-		case ACTION_REMOVE_BEFORE:
-		case ACTION_MOVE_AFTER:
-		case ACTION_MOVE_BEFORE:
-			removed = RemovePathFromList(path);
-			break;
+		length = strlen(dirent->d_name);
+
+		if ((length < 4) || (dirLength + length >= PATH_MAX) ||
+			((strcmp(dirent->d_name + length - 4, ".jar") != 0) &&
+			(strcmp(dirent->d_name + length - 4, ".JAR") != 0)))
+		{
+			continue;
+		}
+
+		memcpy(path + dirLength, dirent->d_name, length + 1);
+
+		ScanJar(scan, path);
 	}
 
-	/*
-	 * Now do whatever action is required for putting the path back.
-	 */
-	switch (action)
-	{
-		case ACTION_MOVE_AFTER:
-			if (!removed)
-				break;
+	closedir(dir);
+}
 
-			/* fall into next case */
 
-		case ACTION_AFTER:
-		case ACTION_REMOVE_AFTER:
-			pathTable[pathCount++] = path;
-			break;
+/*
+ * Read the names of the files in a directory tree of classes, relative to
+ * the root of the tree.  The path buffer holds the name of the directory
+ * being read, and has room for PATH_MAX characters.
+ */
+static void
+ScanClassDir(DIR_SCAN * scan, char * path, int rootLength, int length,
+	int depth)
+{
+	DIR *		dir;
+	struct	dirent *	dirent;
+	struct	stat	statbuf;
+	int		nameLength;
 
-		case ACTION_MOVE_BEFORE:
-			if (!removed)
-				break;
+	dir = opendir(path);
 
-			/* fall into next case */
+	if (dir == NULL)
+		return;
 
-		case ACTION_BEFORE:
-		case ACTION_REMOVE_BEFORE:
-			memmove(pathTable + 1, pathTable,
-				pathCount * sizeof(char **));
+	while ((dirent = readdir(dir)) != NULL)
+	{
+		if ((strcmp(dirent->d_name, ".") == 0) ||
+			(strcmp(dirent->d_name, "..") == 0))
+		{
+			continue;
+		}
 
-			pathTable[0] = path;
-			pathCount++;
-			break;
+		nameLength = strlen(dirent->d_name);
 
-		case ACTION_REMOVE:
-			break;
+		if (length + nameLength + 2 > PATH_MAX)
+			continue;
 
-		case ACTION_TEST_PRESENCE:
-			/*
-			 * See if the path is in the path table.
-			 * If so then everything is all right.
-			 */
-			for (index = 0; index < pathCount; index++)
+		path[length] = ROOT_CHARACTER;
+		memcpy(path + length + 1, dirent->d_name, nameLength + 1);
+
+		if (stat(path, &statbuf) < 0)
+			continue;
+
+		if (S_ISDIR(statbuf.st_mode))
+		{
+			if (depth < CLASS_MAX_DEPTH)
 			{
-				if (strcmp(path, pathTable[index]) == 0)
-					return;
+				ScanClassDir(scan, path, rootLength,
+					length + 1 + nameLength, depth + 1);
 			}
+		}
+		else if (S_ISREG(statbuf.st_mode))
+		{
+			AddClassName(scan, path + rootLength + 1,
+				length + nameLength - rootLength);
+		}
+	}
 
-			/*
-			 * The path is not present.
-			 * Remember this failure for later.
-			 */
-			testFailedFlag = TRUE;
-			break;
+	path[length] = '\0';
 
-		default:
-			fprintf(stderr, "Unknown action %d\n", action);
-			exit(1);
-	}
+	closedir(dir);
 }
 
 
 /*
- * Look for and remove all occurrances of the specified path from the
- * list of current paths.  Returns TRUE if it was found and removed.
+ * Read the names of the files in a jar file from its central directory,
+ * without reading or decompressing any of the files themselves.  The jar
+ * file is mapped so that only the pages of the central directory are read.
+ * Returns TRUE if the jar file could be read.
  */
 static BOOL
-RemovePathFromList(const char * path)
+ScanJar(DIR_SCAN * scan, const char * path)
 {
-	const char *	srcPath;
-	int		srcOffset;
-	int		destOffset;
+	const unsigned char *	image;
+	const unsigned char *	entry;
+	struct	stat	statbuf;
+	void *		map;
+	uint64_t	offset;
+	uint64_t	end;
+	size_t		nameLength;
+	size_t		entrySize;
+	int		fd;
+	BOOL		valid;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
 
-	destOffset = 0;
+	if (fd < 0)
+		return FALSE;
 
-	for (srcOffset = 0; srcOffset < pathCount; srcOffset++)
+	if ((fstat(fd, &statbuf) < 0) || (statbuf.st_size < ZIP_END_SIZE))
 	{
-		srcPath = pathTable[srcOffset];
+		close(fd);
 
-		if (strcmp(path, srcPath) != 0)
-			pathTable[destOffset++] = srcPath;
+		return FALSE;
 	}
 
-	/*
-	 * Return whether or not the path was found,
-	 * and adjust the count of paths if necessary.
-	 */
-	if (pathCount == destOffset)
+	map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (map == MAP_FAILED)
 		return FALSE;
 
-	pathCount = destOffset;
+	image = (const unsigned char *) map;
+	valid = FindZipDirectory(image, statbuf.st_size, &offset, &end);
 
-	return TRUE;
-}
+	end += offset;
 
+	while (valid && (offset + ZIP_ENTRY_SIZE <= end))
+	{
+		entry = image + offset;
 
-/*
- * Remove all duplicate paths from the table of paths.
- * The count of paths is adjusted as necessary.
- */
-static void
-RemoveDuplicatePaths(void)
-{
-	const char *	srcPath;
-	int		srcOffset;
-	int		destOffset;
-	int		i;
+		if (GetZip32(entry) != ZIP_ENTRY_SIGNATURE)
+			break;
 
-	destOffset = 0;
+		nameLength = GetZip16(entry + 28);
+		entrySize = ZIP_ENTRY_SIZE + nameLength + GetZip16(entry + 30) +
+			GetZip16(entry + 32);
 
-	for (srcOffset = 0; srcOffset < pathCount; srcOffset++)
-	{
-		srcPath = pathTable[srcOffset];
+		if (offset + ZIP_ENTRY_SIZE + nameLength > end)
+			break;
 
-		for (i = 0; i < srcOffset; i++)
+		if ((nameLength > 0) &&
+			(entry[ZIP_ENTRY_SIZE + nameLength - 1] != ROOT_CHARACTER))
 		{
-			if (strcmp(srcPath, pathTable[i]) == 0)
-				break;
+			AddClassName(scan, (const char *) entry + ZIP_ENTRY_SIZE,
+				nameLength);
 		}
 
-		if (i == srcOffset)
-			pathTable[destOffset++] = srcPath;
+		offset += entrySize;
 	}
 
-	pathCount = destOffset;
+	munmap(map, statbuf.st_size);
+
+	return valid;
 }
 
 
 /*
- * Check a path for validity according to the command line options.
- * Depending on the options, an error message is printed for invalid paths.
- * Returns one of the following status values:
- *	STATUS_KEEP		Path is valid and should be kept
- *	STATUS_REMOVE		Path is invalid and must be removed
- *	STATUS_ERROR		Path is invalid and generated an error
+ * Find the central directory of a zip file from its end record, which is
+ * searched for backwards from the end since it can be followed by a
+ * comment.  The zip64 end record is used if the offsets do not fit in
+ * the end record.  Returns FALSE if the file is not a zip file.
  */
-static STATUS
-CheckPath(const char * path)
+static BOOL
+FindZipDirectory(const unsigned char * image, size_t size,
+	uint64_t * offsetPtr, uint64_t * sizePtr)
 {
-	struct	stat	statbuf;
+	const unsigned char *	record;
+	size_t		position;
+	size_t		limit;
+	uint64_t	offset;
 
-	/*
-	 * See if the path is relative.
-	 * If so, then check whether that is allowed.
-	 */
-	if (*path != ROOT_CHARACTER)
+	position = size - ZIP_END_SIZE;
+	limit = (position > ZIP_MAX_COMMENT) ? (position - ZIP_MAX_COMMENT) : 0;
+
+	while (GetZip32(image + position) != ZIP_END_SIGNATURE)
 	{
-		/*
-		 * If we can treat DOT as special, then keep it even when
-		 * all other relative paths are disallowed.
-		 */
-		if (!disableDotFlag && (strcmp(path, DOT_PATH) == 0))
-			return STATUS_KEEP;
+		if (position == limit)
+			return FALSE;
 
-		/*
-		 * If we want to remove relative paths, then return that.
-		 */
-		if (removeRelativeFlag)
-			return STATUS_REMOVE;
+		position--;
+	}
 
-		/*
-		 * If we are checking relative paths, then give an error
-		 * message and return that.
-		 */
-		if (checkRelativeFlag)
-		{
-			fprintf(stderr, "Path \"%s\" is relative\n", path);
+	record = image + position;
+	*sizePtr = GetZip32(record + 12);
+	*offsetPtr = GetZip32(record + 16);
 
-			return STATUS_ERROR;
+	if ((*offsetPtr == 0xffffffff) && (position >= ZIP64_LOCATOR_SIZE) &&
+		(GetZip32(record - ZIP64_LOCATOR_SIZE) ==
+			ZIP64_LOCATOR_SIGNATURE))
+	{
+		offset = GetZip64(record - ZIP64_LOCATOR_SIZE + 8);
+
+		if ((size < ZIP64_END_SIZE) || (offset > size - ZIP64_END_SIZE) ||
+			(GetZip32(image + offset) != ZIP64_END_SIGNATURE))
+		{
+			return FALSE;
 		}
 
-		/*
-		 * The relative path is allowed and should be kept.
-		 */
-		return STATUS_KEEP;
+		*sizePtr = GetZip64(image + offset + 40);
+		*offsetPtr = GetZip64(image + offset + 48);
 	}
 
-	/*
-	 * The path is an absolute one.
-	 * If checking of the validity of paths is not enabled,
-	 * then we want to keep all the absolute paths.
-	 */
-	if (!checkInvalidFlag && !removeInvalidFlag)
-		return STATUS_KEEP;
+	return ((*offsetPtr <= size) && (*sizePtr <= size - *offsetPtr));
+}
 
-	/*
-	 * The absolute path has to be checked for validity.
-	 * Make sure the path is accessible, and give an error message
-	 * if required.
-	 */
-	if (stat(path, &statbuf) < 0)
-	{
-		if (removeInvalidFlag)
-			return STATUS_REMOVE;
 
-		fprintf(stderr, "Path \"%s\": %s\n", path, strerror(errno));
+/*
+ * Get the little endian numbers of the specified sizes from a zip file.
+ */
+static unsigned int
+GetZip16(const unsigned char * data)
+{
+	return data[0] | (data[1] << 8);
+}
+
 
-		return STATUS_ERROR;
-	}
+static uint32_t
+GetZip32(const unsigned char * data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) |
+		((uint32_t) data[3] << 24);
+}
 
-	/*
-	 * If the allow files flag is not set then make sure the path is
-	 * a directory.  If not, then give an error message if required.
-	 */
-	if((!allowFilesFlag) && (!S_ISDIR(statbuf.st_mode)))
-	{
-		if (removeInvalidFlag)
-			return STATUS_REMOVE;
 
-		fprintf(stderr, "Path \"%s\": Not a directory\n", path);
+static uint64_t
+GetZip64(const unsigned char * data)
+{
+	return GetZip32(data) | ((uint64_t) GetZip32(data + 4) << 32);
+}
+
+
+/*
+ * Add the name of a file in a class path entry unless it is in META-INF
+ * or is the description of a module, which are found in every jar file.
+ * Returns FALSE on an allocation failure.
+ */
+static BOOL
+AddClassName(DIR_SCAN * scan, const char * name, size_t length)
+{
+	char	buf[PATH_MAX];
 
-		return STATUS_ERROR;
+	if ((length >= PATH_MAX) ||
+		((length >= 9) && (memcmp(name, "META-INF/", 9) == 0)) ||
+		((length == 17) && (memcmp(name, "module-info.class", 17) == 0)))
+	{
+		return TRUE;
 	}
 
-	/*
-	 * The absolute path is valid and should be kept.
-	 */
-	return STATUS_KEEP;
+	memcpy(buf, name, length);
+	buf[length] = '\0';
+
+	return AddScanName(scan, buf);
 }
 
 
 /*
- * Check the list of paths for validity.  Depending on the options set,
- * remove invalid paths from the list or generate error messages for them.
- * Returns TRUE if there were no errors generated.
+ * Get the stamp of a directory.
+ * Returns FALSE if it cannot be found.
  */
 static BOOL
-CheckPathList(void)
+GetDirStamp(const char * path, DIR_STAMP * stamp)
 {
-	const char *	srcPath;
-	int		srcOffset;
-	int		destOffset;
-	STATUS		status;
-	BOOL		successFlag;
-
-	successFlag = TRUE;
-	destOffset = 0;
+	struct	stat	statbuf;
 
-	for (srcOffset = 0; srcOffset < pathCount; srcOffset++)
-	{
-		/*
-		 * Get the next path and check it for validity.
-		 */
-		srcPath = pathTable[srcOffset];
+	memset(stamp, 0, sizeof(DIR_STAMP));
 
-		status = CheckPath(srcPath);
+	if ((stat(path, &statbuf) < 0) || !S_ISDIR(statbuf.st_mode))
+		return FALSE;
 
-		/*
-		 * Act on the result of checking the path.
-		 * This is either to keep the path, silently remove the path
-		 * from the list, or set an error because of the path.
-		 */
-		switch (status)
-		{
-			case STATUS_KEEP:
-				pathTable[destOffset++] = srcPath;
-				break;
+	stamp->dev = statbuf.st_dev;
+	stamp->ino = statbuf.st_ino;
+	stamp->mtimeSec = statbuf.st_mtim.tv_sec;
+	stamp->mtimeNsec = statbuf.st_mtim.tv_nsec;
 
-			case STATUS_REMOVE:
-				break;
+	return TRUE;
+}
 
-			case STATUS_ERROR:
-				successFlag = FALSE;
-				break;
 
-			default:
-				fprintf(stderr, "Unknown check status %d\n",
-					status);
+/*
+ * Compute a hash value for a table of directory names in their order.
+ */
+static unsigned int
+HashDirNames(const char ** dirTable, int dirCount)
+{
+	unsigned int	hash;
+	int		index;
 
-				return FALSE;
-		}
-	}
+	hash = HASH_BASIS;
 
-	/*
-	 * Update the number of paths remaining in the list.
-	 */
-	pathCount = destOffset;
+	for (index = 0; index < dirCount; index++)
+		hash = (hash ^ HashPath(dirTable[index])) * HASH_PRIME;
 
-	/*
-	 * Return whether we failed or not.
-	 */
-	return successFlag;
+	return hash;
 }
 
 
@@ -967,33 +10256,6 @@ SortCallback(const void * addr1, const void * addr2)
 }
 
 
-/*
- * Copy a NULL-terminated string into our own allocated memory.
- * This exits on an malloc failure.
- */
-static char *
-CopyString(const char * oldStr)
-{
-	int	len;
-	char *	str;
-
-	len = strlen(oldStr) + 1;
-
-	str = malloc(len);
-
-	if (str == NULL)
-	{
-		fprintf(stderr, "Cannot allocate %d bytes\n", len);
-
-		exit(1);
-	}
-
-	memcpy(str, oldStr, len);
-
-	return str;
-}
-
-
 static void
 Usage(void)
 {
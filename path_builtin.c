@@ -0,0 +1,137 @@
+/*
+ * Bash loadable builtin for the path program.
+ * This lets the shell manipulate its path variables without running
+ * a new process, and sets the variables directly instead of printing
+ * the new path list.  It is loaded using:
+ * 	enable -f path.so path
+ *
+ * The real work is done by path.c, which is compiled with BASH_BUILTIN
+ * defined so that it uses the routines here to read and set variables.
+ * Inside the shell it starts no threads and checks paths one at a time,
+ * and the options which would leave anything running in the shell or
+ * which read other input are rejected.
+ */
+
+#include <config.h>
+#include <stdio.h>
+
+#include "builtins.h"
+#include "shell.h"
+#include "bashgetopt.h"
+#include "common.h"
+
+
+/*
+ * Routines provided for path.c.
+ */
+extern	const char *	BuiltinGetVariable(const char * name);
+extern	int	BuiltinSetVariable(const char * name, const char * value);
+extern	int	RunPath(int argc, const char ** argv);
+
+
+/*
+ * Local procedures.
+ */
+extern	int	path_builtin(WORD_LIST * list);
+
+
+/*
+ * Get the value of a shell variable, or NULL if it is not set.
+ * Shell variables are used rather than the environment since the
+ * environment is not updated when the shell changes a variable.
+ */
+const char *
+BuiltinGetVariable(const char * name)
+{
+	return get_string_value(name);
+}
+
+
+/*
+ * Set a shell variable and export it, as is done by:
+ * 	export name=value
+ * Returns nonzero if the variable was set.
+ */
+int
+BuiltinSetVariable(const char * name, const char * value)
+{
+	SHELL_VAR *	var;
+
+	var = find_variable(name);
+
+	if (var && readonly_p(var))
+	{
+		builtin_error("%s: readonly variable", name);
+
+		return 0;
+	}
+
+	var = bind_variable(name, (char *) value, 0);
+
+	if (var == NULL)
+		return 0;
+
+	VSETATTR(var, att_exported);
+	array_needs_making = 1;
+
+	/*
+	 * This flushes the table of remembered commands if PATH is changed.
+	 */
+	stupidly_hack_special_variables((char *) name);
+
+	return 1;
+}
+
+
+/*
+ * The builtin command itself, which converts its arguments into the form
+ * used by the program and runs it.
+ */
+int
+path_builtin(WORD_LIST * list)
+{
+	char **	argv;
+	int	argc;
+	int	status;
+
+	/*
+	 * Leave room for the command name before the arguments.
+	 */
+	argv = strvec_from_word_list(list, 0, 1, &argc);
+
+	argv[0] = "path";
+
+	status = RunPath(argc, (const char **) argv);
+
+	free(argv);
+
+	return status;
+}
+
+
+char *	path_doc[] =
+{
+	"Manipulate PATH-like shell variables.",
+	"",
+	"Modify the path list in PATH, or in the variable given by -var,",
+	"according to the options and paths, and set and export the variable",
+	"with the new path list.  The -l, -ls, -which, -shadow, -elf and -cp",
+	"options print as usual instead of setting the variable.  With -sh,",
+	"each -var option starts a group of arguments for that variable, and",
+	"every variable is set if all of the groups succeed.  Options which",
+	"would leave threads or other work running in the shell, such as",
+	"-timeout, -batch and -audit, are rejected.  Use path -h for the list",
+	"of options.",
+	(char *) NULL
+};
+
+
+struct builtin	path_struct =
+{
+	"path",
+	path_builtin,
+	BUILTIN_ENABLED,
+	path_doc,
+	"path [-var name] [-option [path ...]] ...",
+	0
+};